@@ -64,6 +64,8 @@
 // todo need this for lwip FreeRTOS sys_arch to compile
 #define configENABLE_BACKWARD_COMPATIBILITY     1
 #define configNUM_THREAD_LOCAL_STORAGE_POINTERS 5
+// index 0 for the application, the last one for the TKJHAT I2C engine
+#define configTASK_NOTIFICATION_ARRAY_ENTRIES   2
 
 /* System */
 #define configSTACK_DEPTH_TYPE                  uint32_t
@@ -0,0 +1,52 @@
+/*
+The ACLE intrinsics libs/TKJHAT/src/dsp.c uses, in plain C for the host. With this
+directory on the include path and __ARM_FEATURE_DSP defined, dsp.c compiles its
+DSP extension paths unchanged, so dsp_test can check them against the same
+references as the C versions. Each function follows the instruction in the Armv8-M
+Architecture Reference Manual, halves are the low and high int16 of the word.
+*/
+#ifndef HOST_ARM_ACLE_H
+#define HOST_ARM_ACLE_H
+
+#include <stdint.h>
+
+typedef int32_t int16x2_t;
+
+static inline int32_t acle_low(int16x2_t x) {
+    return (int16_t)(uint16_t)((uint32_t)x & 0xFFFF);
+}
+
+static inline int32_t acle_high(int16x2_t x) {
+    return (int16_t)(uint16_t)((uint32_t)x >> 16);
+}
+
+static inline int32_t acle_saturate(int64_t x, unsigned bits) {
+    int64_t max = ((int64_t)1 << (bits - 1)) - 1;
+    int64_t min = -max - 1;
+    return (int32_t)(x > max ? max : x < min ? min : x);
+}
+
+// SSAT: saturate to a signed range of bits
+static inline int32_t __ssat(int32_t x, unsigned bits) {
+    return acle_saturate(x, bits);
+}
+
+// SMLALD: 64-bit accumulate of the products of the low and of the high halves
+static inline int64_t __smlald(int16x2_t a, int16x2_t b, int64_t acc) {
+    return acc + (int64_t)acle_low(a) * acle_low(b) + (int64_t)acle_high(a) * acle_high(b);
+}
+
+// SMUAD: sum of the products of the halves, wraps like the instruction (it only sets Q)
+static inline int32_t __smuad(int16x2_t a, int16x2_t b) {
+    uint32_t sum = (uint32_t)(acle_low(a) * acle_low(b)) + (uint32_t)(acle_high(a) * acle_high(b));
+    return (int32_t)sum;
+}
+
+// QADD16: saturating sum of the halves
+static inline int16x2_t __qadd16(int16x2_t a, int16x2_t b) {
+    uint32_t low = (uint16_t)acle_saturate((int64_t)acle_low(a) + acle_low(b), 16);
+    uint32_t high = (uint16_t)acle_saturate((int64_t)acle_high(a) + acle_high(b), 16);
+    return (int16x2_t)(high << 16 | low);
+}
+
+#endif
@@ -0,0 +1,40 @@
+/*
+Runs the line drawing benchmark of tkjhat/sdk.h on the host. The display is the
+SSD1306 model of the simulated bus, but only the framebuffer is drawn, so the
+result is the CPU cost of ssd1306_draw_line() on the PC. On the device call
+draw_benchmark() with time_us_32 (or dsp_cycle_counter()) for the real figures.
+
+Usage: draw_bench
+*/
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include <tkjhat/sdk.h>
+
+#include "i2c_sim.h"
+#include "sim_devices.h"
+
+static sim_ssd1306_t oled;
+
+static uint32_t nanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)(now.tv_sec * 1000000000ull + now.tv_nsec);
+}
+
+int main(void) {
+    i2c_sim_reset();
+    sim_ssd1306_init(&oled, SSD1306_I2C_ADDRESS);
+    i2c_sim_attach(&oled.device);
+    init_i2c_default();
+    init_display();
+
+    draw_benchmark_result_t results[DRAW_BENCHMARK_COUNT];
+    if (draw_benchmark(results, nanoseconds) != 0) {
+        fprintf(stderr, "display not available\n");
+        return 1;
+    }
+    draw_benchmark_print(results, 1000000000);
+    return 0;
+}
@@ -0,0 +1,24 @@
+/*
+Runs the DSP kernel benchmark of tkjhat/dsp.h on the host. The host build uses the
+C versions of the kernels, so this shows the cost of the portable code. On the
+device call dsp_benchmark() with dsp_cycle_counter() to get cycles per sample.
+
+Usage: dsp_bench
+*/
+#include <stdint.h>
+#include <time.h>
+
+#include "tkjhat/dsp.h"
+
+static uint32_t nanoseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)(now.tv_sec * 1000000000ull + now.tv_nsec);
+}
+
+int main(void) {
+    dsp_benchmark_result_t results[DSP_BENCHMARK_COUNT];
+    dsp_benchmark(results, nanoseconds);
+    dsp_benchmark_print(results, "ns");
+    return 0;
+}
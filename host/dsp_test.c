@@ -0,0 +1,205 @@
+/*
+Checks the DSP kernels of tkjhat/dsp.h against straightforward 64-bit references:
+random blocks, full scale values, odd lengths for the tails of the two-sample
+loops, unaligned pointers and a biquad with a1 = -2.0.
+
+The test is built twice. dsp_test uses the C versions of the kernels like every
+host build. dsp_test_acle compiles dsp.c with __ARM_FEATURE_DSP and the intrinsics
+of acle/arm_acle.h, so the paths the RP2350 runs are checked against the same
+references. Exits with 1 when a kernel differs.
+
+Usage: dsp_test
+*/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tkjhat/dsp.h"
+
+#ifndef DSP_TEST_NAME
+#define DSP_TEST_NAME "C"
+#endif
+
+#define BLOCK       257     // odd, so the two-sample loops leave a tail
+#define FIR_TAPS    15
+#define ROUNDS      64
+
+static uint32_t random_state = 12345;
+static int failures = 0;
+
+static int16_t next_sample(void) {
+    random_state = random_state * 1664525u + 1013904223u;
+    uint32_t r = random_state >> 16;
+    // Every 16th sample is full scale, where the saturation and the wrapping differ
+    switch (r & 0x0F) {
+        case 0: return INT16_MIN;
+        case 1: return INT16_MAX;
+        default: return (int16_t)r;
+    }
+}
+
+static void fill(int16_t *x, size_t n) {
+    for (size_t i = 0; i < n; i++) x[i] = next_sample();
+}
+
+static int16_t saturate(int64_t x) {
+    return x > INT16_MAX ? INT16_MAX : x < INT16_MIN ? INT16_MIN : (int16_t)x;
+}
+
+static uint32_t square_root(uint64_t x) {
+    uint64_t root = (uint64_t)sqrt((double)x);
+    while (root * root > x) root--;
+    while ((root + 1) * (root + 1) <= x) root++;
+    return (uint32_t)root;
+}
+
+static void check(const char *kernel, size_t mismatches, size_t count) {
+    printf("%-16s %6zu/%-6zu %s\n", kernel, mismatches, count, mismatches == 0 ? "ok" : "FAIL");
+    if (mismatches > 0) failures++;
+}
+
+static void test_dot(void) {
+    static int16_t a[BLOCK + 1], b[BLOCK + 1];
+    size_t mismatches = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        fill(a, BLOCK + 1);
+        fill(b, BLOCK + 1);
+        size_t n = BLOCK - (size_t)round % 4;
+        // a + 1: not aligned to a word
+        int64_t expected = 0;
+        for (size_t i = 0; i < n; i++) expected += (int64_t)a[i + 1] * b[i];
+        if (dsp_dot_q15(&a[1], b, n) != expected) mismatches++;
+    }
+    check("dot", mismatches, ROUNDS);
+}
+
+static void test_fir(void) {
+    static const int16_t coeffs[FIR_TAPS] = {
+        -1200, 800, 2300, -4100, 9000, 16000, 32767, -32768, 32767, 16000, 9000, -4100, 2300, 800, -1200,
+    };
+    static int16_t state[2 * FIR_TAPS];
+    static int16_t in[BLOCK * 2], out[BLOCK * 2];
+    dsp_fir_q15_t fir;
+    dsp_fir_q15_init(&fir, coeffs, state, FIR_TAPS);
+    fill(in, BLOCK * 2);
+    // Two calls, so the delay line carries over
+    dsp_fir_q15(&fir, in, out, BLOCK);
+    dsp_fir_q15(&fir, &in[BLOCK], &out[BLOCK], BLOCK);
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < BLOCK * 2; i++) {
+        int64_t acc = 0;
+        for (size_t k = 0; k < FIR_TAPS && k <= i; k++) acc += (int64_t)coeffs[k] * in[i - k];
+        if (out[i] != saturate((acc + (1 << 14)) >> 15)) mismatches++;
+    }
+    check("fir", mismatches, BLOCK * 2);
+}
+
+static void test_biquad(const char *kernel, int16_t b0, int16_t b1, int16_t b2, int16_t a1, int16_t a2) {
+    static int16_t in[BLOCK * 2], out[BLOCK * 2];
+    dsp_biquad_q14_t bq;
+    dsp_biquad_q14_init(&bq, b0, b1, b2, a1, a2);
+    fill(in, BLOCK * 2);
+    memcpy(out, in, sizeof(out));
+    // In place and in two calls, so the history carries over
+    dsp_biquad_q14(&bq, out, out, BLOCK);
+    dsp_biquad_q14(&bq, &out[BLOCK], &out[BLOCK], BLOCK);
+
+    size_t mismatches = 0;
+    int16_t x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+    for (size_t i = 0; i < BLOCK * 2; i++) {
+        int64_t acc = (int64_t)b0 * in[i] + (int64_t)b1 * x1 + (int64_t)b2 * x2
+                    - (int64_t)a1 * y1 - (int64_t)a2 * y2;
+        int16_t y = saturate((acc + (1 << 13)) >> 14);
+        if (out[i] != y) mismatches++;
+        x2 = x1; x1 = in[i];
+        y2 = y1; y1 = y;
+    }
+    if (bq.x1 != x1 || bq.x2 != x2 || bq.y1 != y1 || bq.y2 != y2) mismatches++;
+    check(kernel, mismatches, BLOCK * 2);
+}
+
+static void test_moving_average(void) {
+    static int16_t window[12];
+    static int16_t in[BLOCK], out[BLOCK];
+    dsp_moving_average_t ma;
+    dsp_moving_average_init(&ma, window, 12);
+    fill(in, BLOCK);
+    dsp_moving_average(&ma, in, out, BLOCK);
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < BLOCK; i++) {
+        int32_t sum = 0;
+        for (size_t k = 0; k < 12 && k <= i; k++) sum += in[i - k];
+        if (out[i] != (int16_t)(sum / 12)) mismatches++;
+    }
+    check("moving_average", mismatches, BLOCK);
+}
+
+static void test_magnitude3(void) {
+    static int16_t xyz[BLOCK * 3 + 1];
+    static uint16_t out[BLOCK];
+    fill(xyz, BLOCK * 3 + 1);
+    xyz[1] = xyz[2] = xyz[3] = INT16_MIN; // the largest sum, SMUAD wraps
+    // xyz + 1: every other vector is not aligned to a word
+    dsp_magnitude3_q15(&xyz[1], out, BLOCK);
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < BLOCK; i++) {
+        const int16_t *v = &xyz[1 + 3 * i];
+        uint64_t sum = (int64_t)v[0] * v[0] + (int64_t)v[1] * v[1] + (int64_t)v[2] * v[2];
+        uint32_t magnitude = square_root(sum);
+        if (out[i] != (magnitude > UINT16_MAX ? UINT16_MAX : magnitude)) mismatches++;
+    }
+    check("magnitude3", mismatches, BLOCK);
+}
+
+static void test_add(void) {
+    static int16_t a[BLOCK], b[BLOCK + 1], out[BLOCK];
+    fill(a, BLOCK);
+    fill(b, BLOCK + 1);
+    dsp_add_q15(a, &b[1], out, BLOCK);
+
+    size_t mismatches = 0;
+    for (size_t i = 0; i < BLOCK; i++) {
+        if (out[i] != saturate((int32_t)a[i] + b[i + 1])) mismatches++;
+    }
+    check("add", mismatches, BLOCK);
+}
+
+static void test_rms(void) {
+    static int16_t x[BLOCK];
+    size_t mismatches = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        fill(x, BLOCK);
+        if (round == 0) {
+            for (size_t i = 0; i < BLOCK; i++) x[i] = INT16_MIN;
+        }
+        size_t n = BLOCK - (size_t)round % 4;
+        int64_t sum = 0;
+        for (size_t i = 0; i < n; i++) sum += (int64_t)x[i] * x[i];
+        if (dsp_rms_q15(x, n) != square_root((uint64_t)sum / n)) mismatches++;
+    }
+    check("rms", mismatches, ROUNDS);
+}
+
+int main(void) {
+    printf("DSP kernels (%s) against the references:\n", DSP_TEST_NAME);
+    printf("%-16s %13s\n", "kernel", "mismatches");
+    test_dot();
+    test_fir();
+    dsp_biquad_q14_t lowpass;
+    dsp_biquad_lowpass_q14(&lowpass, 1000, 16000);
+    test_biquad("biquad_lowpass", lowpass.b0, lowpass.b1, lowpass.b2, lowpass.a1, lowpass.a2);
+    test_biquad("biquad_extremes", INT16_MAX, INT16_MIN, INT16_MAX, INT16_MIN, 16000);
+    test_moving_average();
+    test_magnitude3();
+    test_add();
+    test_rms();
+    if (failures > 0) {
+        printf("\n%d kernel(s) failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,286 @@
+/*
+Runs the TKJHAT drivers (sdk.c, ssd1306.c) against the simulated I2C bus and
+prints deterministic throughput, bus occupancy and latency figures for each bus
+speed. No hardware needed, see host/sim/i2c_sim.h for the time model.
+
+Usage: i2c_sim_bench [-i recording.bin] [-d seconds] [-p]
+    -i  feed the simulated IMU with a recording of host/imu_replay format
+        (default: device lying still)
+    -d  length of the simulated application workload (default: 2 s)
+    -p  print the display contents of the simulated SSD1306 at the end
+
+Workload per speed, like the application: IMU burst read at 200 Hz, display
+cleared and redrawn at 10 Hz, light and temperature/humidity read once a second.
+The IMU latency is the time from the moment a read was due to the moment its
+data arrived. A read that finishes after the next one was due is counted as missed.
+At the end the bus transactions of the SSD1306 command sequences are listed.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <tkjhat/sdk.h>
+#include <tkjhat/i2c_bus.h>
+#include <tkjhat/ssd1306.h>
+
+#include "i2c_sim.h"
+#include "sim_devices.h"
+
+#define IMU_PERIOD_US       5000
+#define DISPLAY_PERIOD_US   100000
+#define SENSORS_PERIOD_US   1000000
+
+typedef struct {
+    uint32_t baudrate;
+    i2c_benchmark_result_t driver;
+    uint32_t imuReads;
+    uint32_t imuMissed;
+    uint64_t imuLatencyTotalUs;
+    uint32_t imuLatencyMaxUs;
+    uint32_t displayUpdates;
+    uint64_t displayBytes;
+    uint64_t displayTotalUs;
+    uint32_t occupancyX10;          // bus occupancy in 0.1 %
+} BenchResult;
+
+static sim_icm42670_t icm;
+static sim_ssd1306_t oled;
+static sim_veml6030_t veml;
+static sim_hdc2021_t hdc;
+
+static ImuSample *load_recording(const char *path, size_t *count) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return NULL;
+    }
+    size_t capacity = 1024;
+    ImuSample *samples = malloc(capacity * sizeof(*samples));
+    *count = 0;
+    ImuRecordParser parser;
+    imu_record_parser_init(&parser);
+
+    int byte;
+    ImuSample sample;
+    while (samples != NULL && (byte = fgetc(file)) != EOF) {
+        if (!imu_record_parse(&parser, (uint8_t)byte, &sample)) {
+            continue;
+        }
+        if (*count == capacity) {
+            capacity *= 2;
+            samples = realloc(samples, capacity * sizeof(*samples));
+            if (samples == NULL) break;
+        }
+        samples[(*count)++] = sample;
+    }
+    fclose(file);
+    return samples;
+}
+
+// Fresh bus and devices, then the same initialization as main() on the device
+static void start_board(const ImuSample *samples, size_t sampleCount) {
+    i2c_sim_reset();
+    sim_icm42670_init(&icm, ICM42670_I2C_ADDRESS);
+    sim_icm42670_set_samples(&icm, samples, sampleCount);
+    sim_ssd1306_init(&oled, SSD1306_I2C_ADDRESS);
+    sim_veml6030_init(&veml, VEML6030_I2C_ADDR);
+    sim_hdc2021_init(&hdc, HDC2021_I2C_ADDRESS);
+    i2c_sim_attach(&icm.device);
+    i2c_sim_attach(&oled.device);
+    i2c_sim_attach(&veml.device);
+    i2c_sim_attach(&hdc.device);
+
+    init_i2c_default();
+    init_display();
+    if (init_ICM42670() == 0) {
+        ICM42670_start_with_default_values();
+        ICM42670_startAccel(1000000 / IMU_PERIOD_US, ICM42670_ACCEL_FSR_DEFAULT);
+        ICM42670_startGyro(1000000 / IMU_PERIOD_US, ICM42670_GYRO_FSR_DEFAULT);
+    }
+    init_veml6030();
+    init_hdc2021_();
+}
+
+static void set_speed(uint32_t baudrate) {
+    const uint8_t addresses[] = {ICM42670_I2C_ADDRESS, SSD1306_I2C_ADDRESS};
+    for (size_t i = 0; i < sizeof(addresses); i++) {
+        i2c_bus_profile_t profile;
+        i2c_bus_get_profile(addresses[i], &profile);
+        profile.baudrate = baudrate;
+        i2c_bus_register_device(addresses[i], &profile);
+    }
+}
+
+static void draw_frame(uint32_t frame) {
+    clear_display();
+    int16_t x = (int16_t)(frame * 4 % 120);
+    draw_line(x, 0, (int16_t)(127 - x), 63);
+}
+
+static void run_workload(BenchResult *result, uint32_t seconds) {
+    i2c_sim_reset_stats();
+    uint64_t start = time_us_64();
+    uint64_t end = start + (uint64_t)seconds * 1000000;
+    uint64_t nextImu = start, nextDisplay = start, nextSensors = start;
+
+    while (nextImu < end) {
+        // One task on the host: the earliest due job runs, late jobs run as soon as possible
+        uint64_t due = nextImu;
+        if (nextDisplay < due) due = nextDisplay;
+        if (nextSensors < due) due = nextSensors;
+        uint64_t now = time_us_64();
+        if (now < due) {
+            busy_wait_us(due - now);
+        }
+
+        if (due == nextImu) {
+            int16_t accel[3], gyro[3], t;
+            ICM42670_read_sensor_data_raw(accel, gyro, &t);
+            uint32_t latency = (uint32_t)(time_us_64() - nextImu);
+            result->imuReads++;
+            result->imuLatencyTotalUs += latency;
+            if (latency > result->imuLatencyMaxUs) result->imuLatencyMaxUs = latency;
+            nextImu += IMU_PERIOD_US;
+            while (nextImu < time_us_64()) {
+                result->imuMissed++;
+                nextImu += IMU_PERIOD_US;
+            }
+        } else if (due == nextDisplay) {
+            uint32_t before = oled.data_bytes + oled.command_bytes;
+            uint64_t started = time_us_64();
+            draw_frame(result->displayUpdates++);
+            result->displayTotalUs += time_us_64() - started;
+            result->displayBytes += oled.data_bytes + oled.command_bytes - before;
+            nextDisplay += DISPLAY_PERIOD_US;
+        } else {
+            veml6030_read_light();
+            hdc2021_read_temperature();
+            hdc2021_read_humidity();
+            nextSensors += SENSORS_PERIOD_US;
+        }
+    }
+
+    i2c_sim_stats_t stats;
+    i2c_sim_get_stats(&stats);
+    result->occupancyX10 = stats.elapsed_ns > 0 ? (uint32_t)(stats.busy_ns * 1000 / stats.elapsed_ns) : 0;
+}
+
+typedef struct {
+    const char *name;
+    uint32_t transactions;
+    uint64_t bytes;
+    uint64_t busNs;
+} CommandResult;
+
+static void measure_command(ssd1306_t *display, int operation, CommandResult *result) {
+    i2c_sim_device_stats_t before = oled.device.stats;
+    switch (operation) {
+        case 0: ssd1306_init(display, 128, 64, SSD1306_I2C_ADDRESS, i2c_default); break;
+        case 1: ssd1306_poweroff(display); break;
+        case 2: ssd1306_poweron(display); break;
+        case 3: ssd1306_contrast(display, 0x7f); break;
+        case 4: ssd1306_invert(display, 1); break;
+        default:
+            ssd1306_draw_pixel(display, 10, 10);
+            ssd1306_show(display);
+            break;
+    }
+    result->transactions = oled.device.stats.transactions - before.transactions;
+    result->bytes = oled.device.stats.bytes_written - before.bytes_written;
+    result->busNs = oled.device.stats.bus_ns - before.bus_ns;
+}
+
+// Bus transactions of the SSD1306 command sequences at 400 kHz, commands go out as command lists
+static void print_commands(void) {
+    static const char *names[] = {"init", "power off", "power on", "contrast", "invert", "pixel update"};
+    const size_t count = sizeof(names) / sizeof(names[0]);
+
+    start_board(NULL, 0);
+    set_speed(400 * 1000);
+    ssd1306_t display = {.external_vcc = false};
+    printf("\nSSD1306 commands at 400 kHz:\n");
+    printf("  %-14s %12s %8s %8s\n", "operation", "transactions", "bytes", "bus us");
+    for (size_t i = 0; i < count; i++) {
+        if (i == 1) ssd1306_show(&display); // the first frame after init is sent whole
+        CommandResult result = {.name = names[i]};
+        measure_command(&display, (int)i, &result);
+        printf("  %-14s %12lu %8lu %8lu\n", result.name, (unsigned long)result.transactions,
+               (unsigned long)result.bytes, (unsigned long)(result.busNs / 1000));
+    }
+    ssd1306_deinit(&display);
+}
+
+static void print_results(const BenchResult *results, size_t count) {
+    printf("\nDriver throughput (i2c_benchmark):\n");
+    i2c_benchmark_result_t driver[count];
+    for (size_t i = 0; i < count; i++) driver[i] = results[i].driver;
+    i2c_benchmark_print(driver, count);
+
+    printf("\nWorkload (IMU 200 Hz, display 10 Hz, sensors 1 Hz):\n");
+    printf("  %8s %8s %12s %12s %8s %14s %15s\n", "kHz", "bus %", "imu avg us", "imu max us", "missed",
+           "display B/upd", "display us/upd");
+    for (size_t i = 0; i < count; i++) {
+        const BenchResult *r = &results[i];
+        printf("  %8lu %6lu.%lu %12lu %12lu %8lu %14lu %15lu\n", (unsigned long)(r->baudrate / 1000),
+               (unsigned long)(r->occupancyX10 / 10), (unsigned long)(r->occupancyX10 % 10),
+               (unsigned long)(r->imuReads > 0 ? r->imuLatencyTotalUs / r->imuReads : 0),
+               (unsigned long)r->imuLatencyMaxUs, (unsigned long)r->imuMissed,
+               (unsigned long)(r->displayUpdates > 0 ? r->displayBytes / r->displayUpdates : 0),
+               (unsigned long)(r->displayUpdates > 0 ? r->displayTotalUs / r->displayUpdates : 0));
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *recording = NULL;
+    uint32_t seconds = 2;
+    bool printDisplay = false;
+
+    int option;
+    while ((option = getopt(argc, argv, "i:d:p")) != -1) {
+        switch (option) {
+            case 'i': recording = optarg; break;
+            case 'd': seconds = (uint32_t)atoi(optarg); break;
+            case 'p': printDisplay = true; break;
+            default:
+                fprintf(stderr, "usage: %s [-i recording.bin] [-d seconds] [-p]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    ImuSample *samples = NULL;
+    size_t sampleCount = 0;
+    if (recording != NULL) {
+        samples = load_recording(recording, &sampleCount);
+        if (samples == NULL) {
+            return 2;
+        }
+        printf("IMU recording: %zu samples\n", sampleCount);
+    }
+
+    const uint32_t speeds[] = {100 * 1000, 400 * 1000, 1000 * 1000};
+    const size_t speedCount = sizeof(speeds) / sizeof(speeds[0]);
+    BenchResult results[sizeof(speeds) / sizeof(speeds[0])];
+    memset(results, 0, sizeof(results));
+
+    for (size_t i = 0; i < speedCount; i++) {
+        start_board(samples, sampleCount);
+        set_speed(speeds[i]);
+        results[i].baudrate = speeds[i];
+        i2c_benchmark(&speeds[i], 1, &results[i].driver);
+        run_workload(&results[i], seconds);
+        if (i == speedCount - 1) {
+            printf("\nLast run at %lu kHz:\n", (unsigned long)(speeds[i] / 1000));
+            i2c_sim_print_stats();
+        }
+    }
+    print_results(results, speedCount);
+    print_commands();
+
+    if (printDisplay) {
+        write_text("SOS");
+        sim_ssd1306_print(&oled);
+    }
+    free(samples);
+    return 0;
+}
@@ -0,0 +1,168 @@
+/*
+Writes the synthetic IMU recording of the imu_replay test (host/recordings/sos.bin).
+It is not a capture of the device: the gestures are half sine waves of rotation,
+but the samples look like the ones sensor_task streams with IMU_RECORD:
+
+- 200 Hz (IMU_SAMPLE_RATE_HZ of src/main.c) with jitter in the timestamps
+- default ranges of the ICM-42670: +-250 dps gyro (131 LSB/dps), +-4 g accel (8192 LSB/g)
+- a constant gyro bias and white noise on every axis
+- gravity on the accelerometer, turned by the rotation around X and Y
+
+The noise comes from a fixed seed, so the file is the same on every run. Run it
+again after changing the script below and commit the result. A real recording
+can replace the file as long as it writes the symbols the test expects.
+
+Usage: imu_record_gen sos.bin
+*/
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "imu_record.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+#define RATE_HZ             200
+#define PERIOD_US           (1000000 / RATE_HZ)
+#define JITTER_US           150     // the task wakes up a little late or early
+#define START_US            1000000
+#define GYRO_LSB_PER_DPS    131.0
+#define ACCEL_LSB_PER_G     8192.0
+#define GYRO_NOISE_LSB      10.0    // about 0.07 dps rms
+#define ACCEL_NOISE_LSB     8.0     // about 1 mg rms
+#define SEED                0x2545F491u
+
+static const double gyroBiasLsb[3] = {52.0, -38.0, 21.0};
+
+static FILE *output;
+static uint32_t random_state = SEED;
+static uint32_t sample_index = 0;
+static uint32_t pause_us = 0;       // pauses in the sampling so far
+static double tilt[2];              // rotation around X and Y in radians
+
+static uint32_t next_random(void) {
+    // xorshift32
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return random_state;
+}
+
+static double uniform(void) {
+    return (next_random() >> 8) / 16777216.0;
+}
+
+static double gaussian(void) {
+    // Box-Muller
+    double u = uniform() + 1e-12;
+    double v = uniform();
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+static int16_t to_raw(double value) {
+    value = round(value);
+    if (value > INT16_MAX) return INT16_MAX;
+    if (value < INT16_MIN) return INT16_MIN;
+    return (int16_t)value;
+}
+
+static void emit(const double dps[3], uint8_t flags) {
+    ImuSample sample = {0};
+    int32_t jitter = (int32_t)(next_random() % (2 * JITTER_US + 1)) - JITTER_US;
+    sample.timestampUs = START_US + sample_index * PERIOD_US + pause_us + (uint32_t)jitter;
+    sample.flags = flags;
+    sample_index++;
+
+    for (int axis = 0; axis < 3; axis++) {
+        double raw = dps[axis] * GYRO_LSB_PER_DPS + gyroBiasLsb[axis] + GYRO_NOISE_LSB * gaussian();
+        sample.gyro[axis] = to_raw(raw);
+    }
+    for (int axis = 0; axis < 2; axis++) {
+        tilt[axis] += dps[axis] * (M_PI / 180.0) / RATE_HZ;
+    }
+    double gravity[3] = {
+        sin(tilt[1]),
+        -sin(tilt[0]) * cos(tilt[1]),
+        cos(tilt[0]) * cos(tilt[1]),
+    };
+    for (int axis = 0; axis < 3; axis++) {
+        sample.accel[axis] = to_raw(gravity[axis] * ACCEL_LSB_PER_G + ACCEL_NOISE_LSB * gaussian());
+    }
+
+    uint8_t frame[IMU_RECORD_FRAME_SIZE];
+    imu_record_encode(&sample, frame);
+    fwrite(frame, 1, sizeof(frame), output);
+}
+
+static void still(int ms) {
+    static const double zero[3] = {0};
+    for (int i = 0; i < ms * RATE_HZ / 1000; i++) {
+        emit(zero, 0);
+    }
+}
+
+static void button(uint8_t flag) {
+    static const double zero[3] = {0};
+    emit(zero, flag);
+}
+
+// Rotation around one axis: halves of a sine wave with the peak rate dps
+static void motion(int axis, int ms, double dps, int halves) {
+    int count = ms * RATE_HZ / 1000;
+    for (int i = 0; i < count; i++) {
+        double rate[3] = {0};
+        rate[axis] = dps * sin(M_PI * halves * i / count);
+        emit(rate, 0);
+    }
+}
+
+static void dot(void)    { motion(0, 150, 150, 1); still(500); }
+static void dash(void)   { motion(1, 600, 120, 1); still(500); }
+static void space(void)  { motion(2, 250, 150, 1); still(500); }
+static void delete(void) { motion(2, 450, 150, 3); still(500); }
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s recording.bin\n", argv[0]);
+        return 2;
+    }
+    output = fopen(argv[1], "wb");
+    if (output == NULL) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    still(300);
+    // "..." and a space with gestures
+    dot(); dot(); dot(); space();
+    // "----" and the last dash deleted
+    dash(); dash(); dash(); dash(); delete();
+    // space button, then six dots with the character button: not a letter
+    button(IMU_RECORD_FLAG_BUTTON1); still(100);
+    for (int i = 0; i < 6; i++) button(IMU_RECORD_FLAG_BUTTON2);
+    button(IMU_RECORD_FLAG_BUTTON1);
+
+    // A flick cut short by a pause in the sampling, dropped like on the device
+    int count = 200 * RATE_HZ / 1000;
+    for (int i = 0; i < count; i++) {
+        double rate[3] = {150 * sin(M_PI * fmin(2.0 * i / count, 1.0) / 2), 0, 0};
+        emit(rate, 0);
+    }
+    pause_us += 300000;
+    still(500);
+
+    // "..." with the buttons and the third space that ends the message
+    for (int i = 0; i < 3; i++) button(IMU_RECORD_FLAG_BUTTON2);
+    button(IMU_RECORD_FLAG_BUTTON1); button(IMU_RECORD_FLAG_BUTTON1); button(IMU_RECORD_FLAG_BUTTON1);
+    // A dot of the next message
+    button(IMU_RECORD_FLAG_BUTTON2);
+    still(100);
+
+    if (fclose(output) != 0) {
+        perror(argv[1]);
+        return 1;
+    }
+    return 0;
+}
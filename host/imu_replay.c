@@ -0,0 +1,280 @@
+/*
+Replays raw IMU recordings through the same gesture recognizer, message pipeline
+(src/message.c) and morse decoder the device uses.
+
+Recording: set IMU_RECORD to true in src/main.c, flash the device and save the
+serial port to a file, e.g. `cat /dev/ttyACM0 > writing_sos.bin`.
+
+Usage: imu_replay [-r rate_hz] [-e expected] [-b rounds] recording.bin
+    -r  sample rate given to the recognizer (default: estimated from timestamps)
+    -e  expected symbols, e.g. "... --- ...". Exit status is 1 when the output differs.
+        Every message starts with MESSAGE_PREFIX on the device, it is left out here.
+    -b  benchmark: run the recognizer over the recording this many times and
+        print the throughput in samples per second
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gesture.h"
+#include "imu_record.h"
+#include "message.h"
+#include "morse.h"
+
+#define SYMBOLS_MAX_LENGTH 4096
+#define GYRO_LSB_PER_DPS 131.0f // +-250 dps range
+
+#define GAP_PERIODS 2 // the device restarts the recognizer when it falls a sample period behind
+
+typedef struct {
+    Message message;                    // being written, as in sensor_task
+    char symbols[SYMBOLS_MAX_LENGTH];   // sent messages, without MESSAGE_PREFIX and the '\n'
+    size_t length;
+    unsigned events[GESTURE_DELETE + 1];
+    unsigned invalidCharacters;
+    unsigned messages;                  // ended with MESSAGE_FULL (third space or no room)
+    unsigned gaps;                      // recognizer restarts at gaps in the timestamps
+} Replay;
+
+static ImuSample *load_recording(const char *path, size_t *count, ImuRecordParser *parser) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        perror(path);
+        return NULL;
+    }
+
+    size_t capacity = 1024;
+    ImuSample *samples = malloc(capacity * sizeof(*samples));
+    *count = 0;
+    imu_record_parser_init(parser);
+
+    int byte;
+    ImuSample sample;
+    while (samples != NULL && (byte = fgetc(file)) != EOF) {
+        if (!imu_record_parse(parser, (uint8_t)byte, &sample)) {
+            continue;
+        }
+        if (*count == capacity) {
+            capacity *= 2;
+            samples = realloc(samples, capacity * sizeof(*samples));
+            if (samples == NULL) break;
+        }
+        samples[(*count)++] = sample;
+    }
+    fclose(file);
+    return samples;
+}
+
+static uint16_t estimate_rate(const ImuSample *samples, size_t count) {
+    // Average over the gaps that look like normal sample periods. Longer gaps are
+    // pauses (feedback, low power mode) on the device.
+    uint64_t total = 0;
+    size_t gaps = 0;
+    for (size_t i = 1; i < count; i++) {
+        uint32_t delta = samples[i].timestampUs - samples[i - 1].timestampUs;
+        if (delta > 0 && delta < 50000) {
+            total += delta;
+            gaps++;
+        }
+    }
+    if (gaps == 0 || total == 0) {
+        return 200;
+    }
+    return (uint16_t)((gaps * 1000000ull + total / 2) / total);
+}
+
+static void collect(Replay *replay, const Message *message) {
+    // The symbols the user wrote: the prefix and the end of the message are left out
+    const char *text = message->text;
+    size_t prefixLength = strlen(MESSAGE_PREFIX);
+    if (strncmp(text, MESSAGE_PREFIX, prefixLength) == 0) {
+        text += prefixLength;
+    }
+    for (; *text != '\0' && *text != '\n' && replay->length < SYMBOLS_MAX_LENGTH - 1; text++) {
+        replay->symbols[replay->length++] = *text;
+    }
+    replay->symbols[replay->length] = '\0';
+}
+
+static void apply(Replay *replay, MessageStatus status) {
+    // The device sends a full message (send_message_task) and starts a new one
+    if (status == MESSAGE_FULL) {
+        collect(replay, &replay->message);
+        message_clear(&replay->message);
+        replay->messages++;
+    }
+}
+
+static void add_space(Replay *replay) {
+    MessageStatus status = message_add_space(&replay->message, true);
+    if (status == MESSAGE_INVALID_CHARACTER) {
+        replay->invalidCharacters++;
+    }
+    apply(replay, status);
+}
+
+static void handle_event(Replay *replay, GestureEvent event) {
+    // Same as handle_gesture() on the device
+    replay->events[event]++;
+    switch (event) {
+        case GESTURE_DOT:
+            apply(replay, message_append(&replay->message, MORSE_DOT));
+            break;
+        case GESTURE_DASH:
+            apply(replay, message_append(&replay->message, MORSE_DASH));
+            break;
+        case GESTURE_SPACE:
+            add_space(replay);
+            break;
+        case GESTURE_DELETE:
+            message_remove_last_symbol(&replay->message);
+            break;
+        case GESTURE_NONE:
+            break;
+    }
+}
+
+static void replay_recording(Replay *replay, const ImuSample *samples, size_t count, uint16_t rateHz) {
+    memset(replay, 0, sizeof(*replay));
+    GestureRecognizer recognizer;
+    gesture_init(&recognizer, rateHz);
+    uint32_t gapUs = GAP_PERIODS * (1000000u / rateHz);
+
+    // Same order as in sensor_task: gesture, character button, space button
+    for (size_t i = 0; i < count; i++) {
+        const ImuSample *sample = &samples[i];
+        if (i > 0 && sample->timestampUs - samples[i - 1].timestampUs > gapUs) {
+            gesture_reset(&recognizer);
+            replay->gaps++;
+        }
+        message_start(&replay->message);
+        handle_event(replay, gesture_feed(&recognizer, sample->gyro));
+        if (sample->flags & IMU_RECORD_FLAG_BUTTON2) {
+            char symbol = morse_char_by_position(sample->gyro[0] / GYRO_LSB_PER_DPS,
+                                                 sample->gyro[1] / GYRO_LSB_PER_DPS,
+                                                 sample->gyro[2] / GYRO_LSB_PER_DPS);
+            apply(replay, message_append(&replay->message, symbol));
+        }
+        if (sample->flags & IMU_RECORD_FLAG_BUTTON1) {
+            add_space(replay);
+        }
+    }
+    collect(replay, &replay->message);
+}
+
+static void print_decoded(const char *symbols) {
+    char code[MORSE_MAX_SYMBOLS + 2];
+    size_t codeLength = 0;
+    for (const char *c = symbols; ; c++) {
+        if (*c == MORSE_DOT || *c == MORSE_DASH) {
+            if (codeLength < sizeof(code) - 1) code[codeLength] = *c;
+            codeLength++;
+            continue;
+        }
+        if (codeLength > 0) {
+            code[codeLength < sizeof(code) - 1 ? codeLength : sizeof(code) - 1] = '\0';
+            const char *letter = morse_decode(code);
+            fputs(letter != NULL ? letter : "?", stdout);
+            codeLength = 0;
+        } else if (*c == MORSE_SPACE) {
+            putchar(' '); // two spaces in a row separate words
+        }
+        if (*c == '\0') break;
+    }
+    putchar('\n');
+}
+
+static size_t edit_distance(const char *a, const char *b) {
+    size_t lengthB = strlen(b);
+    size_t *row = malloc((lengthB + 1) * sizeof(*row));
+    for (size_t j = 0; j <= lengthB; j++) row[j] = j;
+    for (size_t i = 1; *a != '\0'; i++, a++) {
+        size_t diagonal = row[0];
+        row[0] = i;
+        for (size_t j = 1; j <= lengthB; j++) {
+            size_t above = row[j];
+            size_t cost = diagonal + (*a != b[j - 1]);
+            size_t best = above + 1 < row[j - 1] + 1 ? above + 1 : row[j - 1] + 1;
+            row[j] = cost < best ? cost : best;
+            diagonal = above;
+        }
+    }
+    size_t distance = row[lengthB];
+    free(row);
+    return distance;
+}
+
+static double seconds_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv) {
+    uint16_t rateHz = 0;
+    const char *expected = NULL;
+    long benchmarkRounds = 0;
+
+    int option;
+    while ((option = getopt(argc, argv, "r:e:b:")) != -1) {
+        switch (option) {
+            case 'r': rateHz = (uint16_t)atoi(optarg); break;
+            case 'e': expected = optarg; break;
+            case 'b': benchmarkRounds = atol(optarg); break;
+            default:
+                fprintf(stderr, "usage: %s [-r rate_hz] [-e expected] [-b rounds] recording.bin\n", argv[0]);
+                return 2;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-r rate_hz] [-e expected] [-b rounds] recording.bin\n", argv[0]);
+        return 2;
+    }
+
+    size_t count;
+    ImuRecordParser parser;
+    ImuSample *samples = load_recording(argv[optind], &count, &parser);
+    if (samples == NULL) {
+        return 2;
+    }
+    if (rateHz == 0) {
+        rateHz = estimate_rate(samples, count);
+    }
+    printf("samples: %zu (%u bad frames), rate: %u Hz\n", count, (unsigned)parser.badFrames, rateHz);
+
+    Replay replay;
+    replay_recording(&replay, samples, count, rateHz);
+    printf("events: dot %u, dash %u, space %u, delete %u, invalid characters %u\n",
+           replay.events[GESTURE_DOT], replay.events[GESTURE_DASH],
+           replay.events[GESTURE_SPACE], replay.events[GESTURE_DELETE], replay.invalidCharacters);
+    printf("messages sent: %u, recognizer restarts at gaps: %u\n", replay.messages, replay.gaps);
+    printf("symbols: \"%s\"\n", replay.symbols);
+    printf("decoded: ");
+    print_decoded(replay.symbols);
+
+    int status = 0;
+    if (expected != NULL) {
+        size_t distance = edit_distance(replay.symbols, expected);
+        size_t length = strlen(expected);
+        double accuracy = length > 0 ? 1.0 - (double)distance / length : (distance == 0);
+        printf("expected: \"%s\", edit distance %zu, accuracy %.1f %%\n",
+               expected, distance, accuracy < 0 ? 0.0 : accuracy * 100);
+        status = distance == 0 ? 0 : 1;
+    }
+
+    if (benchmarkRounds > 0 && count > 0) {
+        double start = seconds_now();
+        for (long round = 0; round < benchmarkRounds; round++) {
+            replay_recording(&replay, samples, count, rateHz);
+        }
+        double elapsed = seconds_now() - start;
+        double processed = (double)count * benchmarkRounds;
+        printf("benchmark: %.0f samples in %.3f s, %.0f samples/s (%.1f ns/sample)\n",
+               processed, elapsed, processed / elapsed, elapsed * 1e9 / processed);
+    }
+
+    free(samples);
+    return status;
+}
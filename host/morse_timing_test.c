@@ -0,0 +1,126 @@
+/*
+Checks the morse playback timing: morse_timing() and morse_keys() of src/morse.c,
+and the keyed notes played by the alarm-driven buzzer sequencer of sdk.c on the
+virtual clock of host/sim (board.c fires the hardware alarm when the clock
+passes its target).
+
+PARIS, the standard word, is 50 units: at 20 WPM it takes 3000 ms and the LED is
+on for the 22 units of the tones, 1320 ms. With Farnsworth spacing (15 WPM
+characters, 8 WPM text) the letter and word gaps are 792 ms and 1849 ms.
+
+Usage: morse_timing_test
+*/
+#include <stdio.h>
+#include <string.h>
+
+#include <tkjhat/sdk.h>
+
+#include "i2c_sim.h"
+#include "morse.h"
+
+#define PARIS           ".--. .- .-. .. ...  "
+#define PARIS_KEYS      14
+#define TONE_HZ         600 // PLAYBACK_TONE_HZ of src/main.c
+#define MAX_MS          20000
+
+typedef struct {
+    const char *name;
+    unsigned wpm;
+    unsigned farnsworthWpm;
+    uint16_t unitMs;
+    uint16_t letterGapMs;
+    uint16_t wordGapMs;
+    uint32_t totalMs;       // the word with the word gap after it
+    uint32_t ledOnMs;       // the tones
+} Case;
+
+static const Case cases[] = {
+    {"PARIS 20 WPM",   20, 0, 60, 180, 420,  3000, 1320},
+    {"PARIS 15/8 WPM", 15, 8, 80, 792, 1849, 7497, 1760},
+};
+
+static int failures = 0;
+
+static void expect(const char *name, const char *what, uint32_t value, uint32_t expected) {
+    if (value != expected) {
+        printf("%-16s %-14s %6lu, expected %lu  FAIL\n", name, what,
+               (unsigned long)value, (unsigned long)expected);
+        failures++;
+    }
+}
+
+static void test_keys(const Case *c, const MorseTiming *timing, const MorseKey *keys, size_t count) {
+    expect(c->name, "unit", timing->unit_ms, c->unitMs);
+    expect(c->name, "dash", timing->dash_ms, 3u * c->unitMs);
+    expect(c->name, "letter gap", timing->letter_gap_ms, c->letterGapMs);
+    expect(c->name, "word gap", timing->word_gap_ms, c->wordGapMs);
+    expect(c->name, "keys", (uint32_t)count, PARIS_KEYS);
+
+    uint32_t total = 0, tones = 0;
+    for (size_t i = 0; i < count; i++) {
+        total += keys[i].tone_ms + keys[i].gap_ms;
+        tones += keys[i].tone_ms;
+    }
+    expect(c->name, "keys total", total, c->totalMs);
+    expect(c->name, "keys tones", tones, c->ledOnMs);
+}
+
+// Plays the keys as play_keyed() of src/main.c does and follows the LED in 1 ms steps
+static void test_sequencer(const Case *c, const MorseKey *keys, size_t count) {
+    static buzzer_note_t notes[PARIS_KEYS];
+    for (size_t i = 0; i < count; i++) {
+        notes[i] = (buzzer_note_t) {TONE_HZ, keys[i].tone_ms, keys[i].gap_ms, BUZZER_LED_KEYED};
+    }
+    // Start on a whole millisecond, so the alarms fire exactly at the end of a step
+    sleep_us(1000 - time_us_64() % 1000);
+    uint64_t start = time_us_64();
+    if (buzzer_play_sequence(notes, count, 1) != 0) {
+        printf("%-16s buzzer_play_sequence failed  FAIL\n", c->name);
+        failures++;
+        return;
+    }
+
+    bool led = gpio_get(RED_LED_PIN);
+    uint64_t ledOnUs = 0, ledSince = start;
+    uint32_t flashes = led ? 1 : 0;
+    while (buzzer_is_playing() && time_us_64() - start < MAX_MS * 1000ull) {
+        sleep_ms(1);
+        bool now = gpio_get(RED_LED_PIN);
+        if (now != led) {
+            if (led) ledOnUs += time_us_64() - ledSince;
+            else flashes++;
+            ledSince = time_us_64();
+            led = now;
+        }
+    }
+    uint32_t elapsed = (uint32_t)((time_us_64() - start) / 1000);
+    expect(c->name, "played", elapsed, c->totalMs);
+    expect(c->name, "LED on", (uint32_t)(ledOnUs / 1000), c->ledOnMs);
+    expect(c->name, "LED flashes", flashes, PARIS_KEYS);
+    expect(c->name, "LED at end", led, false);
+    printf("%-16s %6lu ms, LED on %lu ms in %lu flashes\n", c->name, (unsigned long)elapsed,
+           (unsigned long)(ledOnUs / 1000), (unsigned long)flashes);
+}
+
+int main(void) {
+    i2c_sim_reset();
+    init_led();
+    init_buzzer();
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        const Case *c = &cases[i];
+        MorseTiming timing;
+        MorseKey keys[PARIS_KEYS + 1];
+        morse_timing(&timing, c->wpm, c->farnsworthWpm);
+        size_t count = morse_keys(PARIS, &timing, keys, sizeof(keys) / sizeof(keys[0]));
+        test_keys(c, &timing, keys, count);
+        if (count == PARIS_KEYS) {
+            test_sequencer(c, keys, count);
+        }
+    }
+    if (failures > 0) {
+        printf("\n%d check(s) failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
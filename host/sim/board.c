@@ -0,0 +1,256 @@
+/*
+Host side of the HAT outside the I2C bus: GPIO, PWM and the PDM microphone are
+accepted and ignored, there is no DMA engine and no interrupts, and the Pico SDK time functions run on the virtual clock
+of the simulator. Hardware alarms fire when the CPU sleeps or busy waits past
+their target. FreeRTOS tasks and queues cannot be created.
+*/
+#include <stddef.h>
+
+#include "pico/stdlib.h"
+#include "hardware/pwm.h"
+#include "hardware/clocks.h"
+#include "hardware/timer.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include <FreeRTOS.h>
+#include <task.h>
+#include <queue.h>
+#include <tkjhat/pdm_microphone.h>
+
+#include "i2c_sim.h"
+
+#define GPIO_COUNT 48
+#define ALARM_COUNT 4
+#define CLOCK_SYS_HZ 125000000
+
+static bool gpio_state[GPIO_COUNT];
+
+/* ---- time ---- */
+
+static struct {
+    bool claimed;
+    bool armed;
+    uint64_t target_us;
+    hardware_alarm_callback_t callback;
+} alarms[ALARM_COUNT];
+
+static void run_alarms(void) {
+    uint64_t now = time_us_64();
+    for (uint i = 0; i < ALARM_COUNT; i++) {
+        if (alarms[i].armed && alarms[i].target_us <= now) {
+            alarms[i].armed = false;
+            if (alarms[i].callback != NULL) alarms[i].callback(i);
+        }
+    }
+}
+
+uint64_t time_us_64(void) {
+    return i2c_sim_now_ns() / 1000;
+}
+
+uint32_t time_us_32(void) {
+    return (uint32_t)time_us_64();
+}
+
+void sleep_ms(uint32_t ms) {
+    i2c_sim_advance_ns((uint64_t)ms * 1000000);
+    run_alarms();
+}
+
+void sleep_us(uint64_t us) {
+    i2c_sim_advance_ns(us * 1000);
+    run_alarms();
+}
+
+void busy_wait_us(uint64_t us) {
+    i2c_sim_advance_ns(us * 1000);
+    run_alarms();
+}
+
+absolute_time_t get_absolute_time(void) {
+    return time_us_64();
+}
+
+absolute_time_t make_timeout_time_ms(uint32_t ms) {
+    return time_us_64() + (uint64_t)ms * 1000;
+}
+
+uint32_t clock_get_hz(enum clock_index clk_index) {
+    (void)clk_index;
+    return CLOCK_SYS_HZ;
+}
+
+int hardware_alarm_claim_unused(bool required) {
+    for (uint i = 0; i < ALARM_COUNT; i++) {
+        if (!alarms[i].claimed) {
+            alarms[i].claimed = true;
+            return (int)i;
+        }
+    }
+    return required ? PICO_ERROR_GENERIC : -1;
+}
+
+void hardware_alarm_unclaim(uint alarm_num) {
+    if (alarm_num < ALARM_COUNT) alarms[alarm_num].claimed = false;
+}
+
+void hardware_alarm_set_callback(uint alarm_num, hardware_alarm_callback_t callback) {
+    if (alarm_num < ALARM_COUNT) alarms[alarm_num].callback = callback;
+}
+
+// Returns true if the target is already in the past, the callback is then not called
+bool hardware_alarm_set_target(uint alarm_num, absolute_time_t t) {
+    if (alarm_num >= ALARM_COUNT || t <= time_us_64()) return true;
+    alarms[alarm_num].armed = true;
+    alarms[alarm_num].target_us = t;
+    return false;
+}
+
+void hardware_alarm_cancel(uint alarm_num) {
+    if (alarm_num < ALARM_COUNT) alarms[alarm_num].armed = false;
+}
+
+/* ---- GPIO and PWM ---- */
+
+void gpio_init(uint gpio) { (void)gpio; }
+void gpio_deinit(uint gpio) { (void)gpio; }
+void gpio_set_dir(uint gpio, bool out) { (void)gpio; (void)out; }
+void gpio_set_function(uint gpio, enum gpio_function fn) { (void)gpio; (void)fn; }
+void gpio_pull_up(uint gpio) { (void)gpio; }
+void gpio_disable_pulls(uint gpio) { (void)gpio; }
+
+void gpio_put(uint gpio, bool value) {
+    if (gpio < GPIO_COUNT) gpio_state[gpio] = value;
+}
+
+bool gpio_get(uint gpio) {
+    return gpio < GPIO_COUNT ? gpio_state[gpio] : false;
+}
+
+uint pwm_gpio_to_slice_num(uint gpio) { return (gpio >> 1) & 7; }
+void pwm_set_clkdiv(uint slice_num, float divider) { (void)slice_num; (void)divider; }
+void pwm_set_enabled(uint slice_num, bool enabled) { (void)slice_num; (void)enabled; }
+void pwm_set_gpio_level(uint gpio, uint16_t level) { (void)gpio; (void)level; }
+void pwm_set_clkdiv_int_frac(uint slice_num, uint8_t integer, uint8_t fract) {
+    (void)slice_num; (void)integer; (void)fract;
+}
+void pwm_set_wrap(uint slice_num, uint16_t wrap) { (void)slice_num; (void)wrap; }
+uint pwm_gpio_to_channel(uint gpio) { return gpio & 1; }
+
+static pwm_hw_t pwm_registers;
+pwm_hw_t *pwm_hw = &pwm_registers;
+
+/* ---- DMA and interrupts (not simulated, nothing can be claimed) ---- */
+
+int dma_claim_unused_channel(bool required) { return required ? PICO_ERROR_GENERIC : -1; }
+void dma_channel_unclaim(uint channel) { (void)channel; }
+int dma_claim_unused_timer(bool required) { return required ? PICO_ERROR_GENERIC : -1; }
+void dma_timer_unclaim(uint timer) { (void)timer; }
+void dma_timer_set_fraction(uint timer, uint16_t numerator, uint16_t denominator) {
+    (void)timer; (void)numerator; (void)denominator;
+}
+uint dma_get_timer_dreq(uint timer) { return timer; }
+
+dma_channel_config dma_channel_get_default_config(uint channel) {
+    (void)channel;
+    return (dma_channel_config) { 0 };
+}
+dma_channel_config dma_get_channel_config(uint channel) { return dma_channel_get_default_config(channel); }
+void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size) {
+    (void)c; (void)size;
+}
+void channel_config_set_read_increment(dma_channel_config *c, bool incr) { (void)c; (void)incr; }
+void channel_config_set_write_increment(dma_channel_config *c, bool incr) { (void)c; (void)incr; }
+void channel_config_set_dreq(dma_channel_config *c, uint dreq) { (void)c; (void)dreq; }
+void channel_config_set_chain_to(dma_channel_config *c, uint chain_to) { (void)c; (void)chain_to; }
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger) {
+    (void)channel; (void)config; (void)write_addr; (void)read_addr; (void)transfer_count; (void)trigger;
+}
+void dma_channel_set_config(uint channel, const dma_channel_config *config, bool trigger) {
+    (void)channel; (void)config; (void)trigger;
+}
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger) {
+    (void)channel; (void)read_addr; (void)trigger;
+}
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger) {
+    (void)channel; (void)trans_count; (void)trigger;
+}
+void dma_channel_start(uint channel) { (void)channel; }
+void dma_channel_abort(uint channel) { (void)channel; }
+void dma_channel_set_irq1_enabled(uint channel, bool enabled) { (void)channel; (void)enabled; }
+bool dma_channel_get_irq1_status(uint channel) { (void)channel; return false; }
+void dma_channel_acknowledge_irq1(uint channel) { (void)channel; }
+
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority) {
+    (void)num; (void)handler; (void)order_priority;
+}
+void irq_remove_handler(uint num, irq_handler_t handler) { (void)num; (void)handler; }
+void irq_set_enabled(uint num, bool enabled) { (void)num; (void)enabled; }
+
+/* ---- PDM microphone (not simulated) ---- */
+
+int pdm_microphone_init(const struct pdm_microphone_config *config) {
+    (void)config;
+    return -1;
+}
+
+void pdm_microphone_deinit() {}
+
+int pdm_microphone_start() {
+    return -1;
+}
+
+void pdm_microphone_stop() {}
+
+void pdm_microphone_set_samples_ready_handler(pdm_samples_ready_handler_t handler) {
+    (void)handler;
+}
+
+int pdm_microphone_read(int16_t *buffer, size_t samples) {
+    (void)buffer;
+    (void)samples;
+    return 0;
+}
+
+/* ---- FreeRTOS (no scheduler) ---- */
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char *name, uint32_t stack_depth, void *arg,
+                       UBaseType_t priority, TaskHandle_t *handle) {
+    (void)code; (void)name; (void)stack_depth; (void)arg; (void)priority; (void)handle;
+    return pdFAIL;
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(time_us_64() / 1000);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    sleep_ms(ticks);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    (void)length;
+    (void)item_size;
+    return NULL;
+}
+
+void vQueueDelete(QueueHandle_t queue) {
+    (void)queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks) {
+    (void)queue; (void)item; (void)ticks;
+    return pdFAIL;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks) {
+    (void)queue; (void)item;
+    vTaskDelay(ticks);
+    return pdFAIL;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+    (void)queue;
+    return 0;
+}
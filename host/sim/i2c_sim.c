@@ -0,0 +1,445 @@
+/*
+Simulated I2C bus, see i2c_sim.h. Implements tkjhat/i2c_bus.h (the transaction
+engine of the device) and the blocking Pico SDK functions on top of one bus
+model, so both paths of the drivers are timed the same way.
+*/
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/i2c.h"
+#include <tkjhat/i2c_bus.h>
+
+#include "i2c_sim.h"
+
+i2c_inst_t i2c_sim_instance;
+
+static const i2c_bus_profile_t default_profile = {
+    .client = I2C_BUS_CLIENT_OTHER,
+    .baudrate = I2C_BUS_DEFAULT_BAUDRATE,
+    .timeout_ms = I2C_BUS_TIMEOUT_MS,
+    .retries = 0,
+};
+
+static struct {
+    uint64_t now_ns;                // CPU clock
+    uint64_t bus_free_ns;           // end of the last STOP
+    uint64_t cursor_ns;             // bus time inside the running transfer
+    uint64_t begin_ns;              // START of the running transfer
+    bool open;                      // START sent, STOP not yet
+    i2c_sim_device_t *current;      // addressed device of the running transfer
+    uint32_t baudrate;
+    i2c_sim_device_t *devices;
+
+    struct {
+        const i2c_transaction_t *transaction;
+        uint64_t done_ns;
+    } pending[I2C_SIM_MAX_PENDING];
+    unsigned pending_next;
+
+    struct {
+        uint8_t address;
+        i2c_bus_profile_t profile;
+    } profiles[I2C_BUS_MAX_DEVICES];
+    uint8_t profile_count;
+
+    i2c_sim_stats_t stats;
+    uint64_t stats_start_ns;
+    i2c_bus_stats_t bus_stats;
+    i2c_bus_client_stats_t client_stats[I2C_BUS_CLIENT_COUNT];
+} sim = { .baudrate = I2C_BUS_DEFAULT_BAUDRATE };
+
+/* ---- time model ---- */
+
+static uint64_t bit_ns(uint32_t baudrate) {
+    return 1000000000ull / (baudrate > 0 ? baudrate : I2C_BUS_DEFAULT_BAUDRATE);
+}
+
+// Bus free time between a STOP and the next START (tBUF of the I2C specification)
+static uint64_t bus_free_time_ns(uint32_t baudrate) {
+    return baudrate > 400000 ? 500 : baudrate > 100000 ? 1300 : 4700;
+}
+
+uint64_t i2c_sim_transfer_ns(uint32_t baudrate, size_t tx_len, size_t rx_len) {
+    uint64_t bits = 1 + 1; // START, STOP
+    if (tx_len > 0) bits += 9 * (1 + tx_len);
+    if (rx_len > 0) bits += 9 * (1 + rx_len) + (tx_len > 0 ? 1 : 0);
+    return bits * bit_ns(baudrate);
+}
+
+uint64_t i2c_sim_now_ns(void) {
+    return sim.now_ns;
+}
+
+void i2c_sim_advance_ns(uint64_t ns) {
+    sim.now_ns += ns;
+}
+
+static uint64_t max_u64(uint64_t a, uint64_t b) {
+    return a > b ? a : b;
+}
+
+/* ---- bus ---- */
+
+static i2c_sim_device_t *find_device(uint8_t address) {
+    for (i2c_sim_device_t *device = sim.devices; device != NULL; device = device->next) {
+        if (device->address == address) return device;
+    }
+    return NULL;
+}
+
+static void set_baudrate(uint32_t baudrate) {
+    if (baudrate != sim.baudrate) {
+        sim.baudrate = baudrate;
+        sim.stats.baudrate_changes++;
+    }
+}
+
+static void bus_begin(uint64_t at_ns) {
+    sim.begin_ns = at_ns;
+    sim.cursor_ns = at_ns;
+    sim.open = true;
+}
+
+// START or repeated START and the address byte. Returns NULL when nobody acknowledges.
+static i2c_sim_device_t *bus_address(uint8_t address, bool read) {
+    sim.cursor_ns += 10 * bit_ns(sim.baudrate);
+    i2c_sim_device_t *device = find_device(address);
+    if (device != NULL) {
+        sim.current = device;
+        if (device->start != NULL) device->start(device, read);
+    }
+    return device;
+}
+
+static bool bus_write(i2c_sim_device_t *device, uint8_t byte) {
+    sim.cursor_ns += 9 * bit_ns(sim.baudrate);
+    sim.stats.bytes++;
+    device->stats.bytes_written++;
+    return device->write == NULL || device->write(device, byte);
+}
+
+static uint8_t bus_read(i2c_sim_device_t *device) {
+    sim.cursor_ns += 9 * bit_ns(sim.baudrate);
+    sim.stats.bytes++;
+    device->stats.bytes_read++;
+    return device->read != NULL ? device->read(device) : 0xFF;
+}
+
+static void bus_stop(bool nack) {
+    sim.cursor_ns += bit_ns(sim.baudrate);
+    uint64_t duration = sim.cursor_ns - sim.begin_ns;
+    i2c_sim_device_t *device = sim.current;
+    if (device != NULL) {
+        if (device->stop != NULL) device->stop(device);
+        device->stats.transactions++;
+        device->stats.bus_ns += duration;
+        if (nack) device->stats.nacks++;
+    }
+    sim.stats.transactions++;
+    sim.stats.busy_ns += duration;
+    if (nack) sim.stats.nacks++;
+    sim.bus_free_ns = sim.cursor_ns;
+    sim.current = NULL;
+    sim.open = false;
+}
+
+// Earliest START for a transfer the CPU wants to begin at at_ns
+static uint64_t bus_start_time(uint64_t at_ns) {
+    return max_u64(at_ns, sim.bus_free_ns + bus_free_time_ns(sim.baudrate));
+}
+
+/* ---- device profiles (same rules as the engine) ---- */
+
+static const i2c_bus_profile_t *profile_of(uint8_t address) {
+    for (int i = 0; i < sim.profile_count; i++) {
+        if (sim.profiles[i].address == address) return &sim.profiles[i].profile;
+    }
+    return &default_profile;
+}
+
+int i2c_bus_register_device(uint8_t address, const i2c_bus_profile_t *profile) {
+    i2c_bus_profile_t p = *profile;
+    if (p.baudrate == 0) p.baudrate = default_profile.baudrate;
+    if (p.timeout_ms == 0) p.timeout_ms = default_profile.timeout_ms;
+    int i = 0;
+    while (i < sim.profile_count && sim.profiles[i].address != address) {
+        i++;
+    }
+    if (i == I2C_BUS_MAX_DEVICES) {
+        return -1;
+    }
+    sim.profiles[i].address = address;
+    sim.profiles[i].profile = p;
+    if (i == sim.profile_count) sim.profile_count++;
+    return 0;
+}
+
+int i2c_bus_get_profile(uint8_t address, i2c_bus_profile_t *profile) {
+    const i2c_bus_profile_t *p = profile_of(address);
+    *profile = *p;
+    return p == &default_profile ? -1 : 0;
+}
+
+/* ---- transaction engine API ---- */
+
+static bool status_is_final(i2c_transaction_status_t status) {
+    return status == I2C_TRANSACTION_DONE || status == I2C_TRANSACTION_NACK
+        || status == I2C_TRANSACTION_TIMEOUT;
+}
+
+static int status_to_result(const i2c_transaction_t *t) {
+    switch (t->status) {
+        case I2C_TRANSACTION_DONE:    return (int)(t->header_len + t->tx_len + t->rx_len);
+        case I2C_TRANSACTION_TIMEOUT: return PICO_ERROR_TIMEOUT;
+        default:                      return PICO_ERROR_GENERIC;
+    }
+}
+
+// One attempt on the bus, starting at start_ns
+static i2c_transaction_status_t run_transaction(const i2c_transaction_t *t, uint64_t start_ns) {
+    bus_begin(start_ns);
+    i2c_sim_device_t *device = NULL;
+    bool ok = true;
+    if (t->header_len + t->tx_len > 0) {
+        device = bus_address(t->address, false);
+        ok = device != NULL;
+        if (t->encoded != NULL) {
+            for (size_t i = 0; ok && i < t->header_len + t->tx_len; i++) ok = bus_write(device, (uint8_t)t->encoded[i]);
+        } else {
+            for (size_t i = 0; ok && i < t->header_len; i++) ok = bus_write(device, t->header[i]);
+            for (size_t i = 0; ok && i < t->tx_len; i++) ok = bus_write(device, t->tx[i]);
+        }
+    }
+    if (ok && t->rx_len > 0) {
+        device = bus_address(t->address, true);
+        ok = device != NULL;
+        for (size_t i = 0; ok && i < t->rx_len; i++) t->rx[i] = bus_read(device);
+    }
+    bus_stop(!ok);
+    return ok ? I2C_TRANSACTION_DONE : I2C_TRANSACTION_NACK;
+}
+
+int i2c_bus_init(i2c_inst_t *i2c) {
+    (void)i2c;
+    return 0;
+}
+
+// Same words as on the device, the simulator only uses the data byte
+size_t i2c_bus_encode_write(uint16_t *words, const uint8_t *header, size_t header_len,
+                            const uint8_t *tx, size_t tx_len) {
+    size_t n = 0;
+    for (size_t i = 0; i < header_len; i++) {
+        words[n++] = header[i];
+    }
+    for (size_t i = 0; i < tx_len; i++) {
+        words[n++] = tx[i];
+    }
+    if (n > 0) words[n - 1] |= I2C_SIM_DATA_CMD_STOP;
+    return n;
+}
+
+int i2c_bus_submit(i2c_transaction_t *transaction) {
+    size_t length = transaction->header_len + transaction->tx_len + transaction->rx_len;
+    if (length == 0 || length > I2C_BUS_MAX_TRANSFER || transaction->header_len > sizeof(transaction->header)
+            || (transaction->encoded != NULL && transaction->rx_len > 0)) {
+        return -1;
+    }
+    const i2c_bus_profile_t *profile = profile_of(transaction->address);
+    transaction->client = profile->client;
+    transaction->timeout_ms = profile->timeout_ms;
+    transaction->attempts = 0;
+    transaction->abort_source = 0;
+    transaction->waiter = NULL;
+    transaction->next = NULL;
+    transaction->submitted_us = sim.now_ns / 1000;
+
+    set_baudrate(profile->baudrate);
+    uint64_t start_ns = bus_start_time(sim.now_ns + I2C_SIM_SETUP_NS);
+    i2c_bus_client_stats_t *client = &sim.client_stats[transaction->client];
+    uint32_t wait_us = (uint32_t)((start_ns - sim.now_ns) / 1000);
+    client->transactions++;
+    client->wait_us += wait_us;
+    if (wait_us > client->max_wait_us) client->max_wait_us = wait_us;
+
+    i2c_transaction_status_t status = run_transaction(transaction, start_ns);
+    while (status == I2C_TRANSACTION_NACK && transaction->attempts < profile->retries) {
+        transaction->attempts++;
+        sim.bus_stats.retries++;
+        status = run_transaction(transaction, bus_start_time(sim.bus_free_ns));
+    }
+    client->bus_us += (sim.bus_free_ns - start_ns) / 1000;
+    sim.bus_stats.busy_us += (sim.bus_free_ns - start_ns) / 1000;
+    sim.bus_stats.transactions++;
+    if (status == I2C_TRANSACTION_DONE) {
+        sim.bus_stats.bytes += length;
+    } else {
+        sim.bus_stats.errors++;
+    }
+
+    sim.pending[sim.pending_next].transaction = transaction;
+    sim.pending[sim.pending_next].done_ns = sim.bus_free_ns;
+    sim.pending_next = (sim.pending_next + 1) % I2C_SIM_MAX_PENDING;
+    transaction->status = status;
+    if (transaction->callback != NULL) {
+        transaction->callback(transaction);
+    }
+    return 0;
+}
+
+int i2c_bus_wait(i2c_transaction_t *transaction, uint32_t timeout_ms) {
+    (void)timeout_ms; // without clock stretching a transaction always ends
+    if (!status_is_final(transaction->status)) {
+        return PICO_ERROR_GENERIC;
+    }
+    uint64_t done_ns = sim.bus_free_ns;
+    for (unsigned i = 0; i < I2C_SIM_MAX_PENDING; i++) {
+        if (sim.pending[i].transaction == transaction) {
+            done_ns = sim.pending[i].done_ns;
+            sim.pending[i].transaction = NULL;
+            break;
+        }
+    }
+    sim.now_ns = max_u64(sim.now_ns, done_ns);
+    return status_to_result(transaction);
+}
+
+int i2c_bus_transfer(uint8_t address, const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len) {
+    i2c_transaction_t transaction = {
+        .address = address,
+        .tx = tx,
+        .tx_len = tx_len,
+        .rx = rx,
+        .rx_len = rx_len,
+    };
+    if (i2c_bus_submit(&transaction) != 0) {
+        return PICO_ERROR_GENERIC;
+    }
+    return i2c_bus_wait(&transaction, I2C_BUS_TIMEOUT_PROFILE);
+}
+
+int i2c_bus_acquire(uint8_t address) {
+    if (sim.open) return 0;
+    set_baudrate(profile_of(address)->baudrate);
+    sim.now_ns = max_u64(sim.now_ns, sim.bus_free_ns);
+    return 1;
+}
+
+void i2c_bus_release(void) {
+}
+
+void i2c_bus_get_stats(i2c_bus_stats_t *stats) {
+    *stats = sim.bus_stats;
+}
+
+void i2c_bus_get_client_stats(i2c_bus_client_t client, i2c_bus_client_stats_t *stats) {
+    if (client >= I2C_BUS_CLIENT_COUNT) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    *stats = sim.client_stats[client];
+}
+
+void i2c_bus_reset_stats(void) {
+    memset(&sim.bus_stats, 0, sizeof(sim.bus_stats));
+    memset(sim.client_stats, 0, sizeof(sim.client_stats));
+}
+
+/* ---- Pico SDK blocking functions ---- */
+
+uint i2c_init(i2c_inst_t *i2c, uint baudrate) {
+    return i2c_set_baudrate(i2c, baudrate);
+}
+
+uint i2c_set_baudrate(i2c_inst_t *i2c, uint baudrate) {
+    (void)i2c;
+    set_baudrate(baudrate);
+    return baudrate;
+}
+
+// The CPU waits for every byte, so the CPU clock follows the bus
+static int blocking_transfer(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, uint8_t *dst, size_t len, bool nostop) {
+    if (!sim.open) {
+        bus_begin(bus_start_time(sim.now_ns));
+    }
+    i2c_sim_device_t *device = bus_address(addr, dst != NULL);
+    bool ok = device != NULL;
+    for (size_t i = 0; ok && i < len; i++) {
+        if (dst != NULL) {
+            dst[i] = bus_read(device);
+        } else {
+            ok = bus_write(device, src[i]);
+        }
+    }
+    if (!ok || !nostop) {
+        bus_stop(!ok);
+    }
+    i2c->restart_on_next = ok && nostop;
+    sim.now_ns = max_u64(sim.now_ns, sim.cursor_ns);
+    return ok ? (int)len : PICO_ERROR_GENERIC;
+}
+
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop) {
+    return blocking_transfer(i2c, addr, src, NULL, len, nostop);
+}
+
+int i2c_read_blocking(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop) {
+    return blocking_transfer(i2c, addr, NULL, dst, len, nostop);
+}
+
+int i2c_write_blocking_until(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop, absolute_time_t until) {
+    (void)until;
+    return blocking_transfer(i2c, addr, src, NULL, len, nostop);
+}
+
+int i2c_read_blocking_until(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop, absolute_time_t until) {
+    (void)until;
+    return blocking_transfer(i2c, addr, NULL, dst, len, nostop);
+}
+
+/* ---- simulator control ---- */
+
+void i2c_sim_reset(void) {
+    memset(&sim, 0, sizeof(sim));
+    sim.baudrate = I2C_BUS_DEFAULT_BAUDRATE;
+    i2c_sim_instance.restart_on_next = false;
+}
+
+void i2c_sim_attach(i2c_sim_device_t *device) {
+    memset(&device->stats, 0, sizeof(device->stats));
+    device->next = sim.devices;
+    sim.devices = device;
+}
+
+void i2c_sim_reset_stats(void) {
+    memset(&sim.stats, 0, sizeof(sim.stats));
+    sim.stats_start_ns = max_u64(sim.now_ns, sim.bus_free_ns);
+    for (i2c_sim_device_t *device = sim.devices; device != NULL; device = device->next) {
+        memset(&device->stats, 0, sizeof(device->stats));
+    }
+    i2c_bus_reset_stats();
+}
+
+void i2c_sim_get_stats(i2c_sim_stats_t *stats) {
+    *stats = sim.stats;
+    stats->elapsed_ns = max_u64(sim.now_ns, sim.bus_free_ns) - sim.stats_start_ns;
+}
+
+void i2c_sim_print_stats(void) {
+    i2c_sim_stats_t stats;
+    i2c_sim_get_stats(&stats);
+    uint32_t occupancy_x10 = stats.elapsed_ns > 0 ? (uint32_t)(stats.busy_ns * 1000 / stats.elapsed_ns) : 0;
+    printf("bus: %.3f ms elapsed, %.3f ms busy (%lu.%lu %%), %lu transactions, %llu bytes, %lu NACKs, %lu speed changes\n",
+           stats.elapsed_ns / 1e6, stats.busy_ns / 1e6,
+           (unsigned long)(occupancy_x10 / 10), (unsigned long)(occupancy_x10 % 10),
+           (unsigned long)stats.transactions, (unsigned long long)stats.bytes,
+           (unsigned long)stats.nacks, (unsigned long)stats.baudrate_changes);
+    printf("  %-10s %8s %10s %10s %10s %6s\n", "device", "address", "transfers", "written", "read", "bus %");
+    for (i2c_sim_device_t *device = sim.devices; device != NULL; device = device->next) {
+        uint32_t share_x10 = stats.elapsed_ns > 0 ? (uint32_t)(device->stats.bus_ns * 1000 / stats.elapsed_ns) : 0;
+        printf("  %-10s     0x%02X %10lu %10llu %10llu %4lu.%lu\n", device->name, device->address,
+               (unsigned long)device->stats.transactions,
+               (unsigned long long)device->stats.bytes_written, (unsigned long long)device->stats.bytes_read,
+               (unsigned long)(share_x10 / 10), (unsigned long)(share_x10 % 10));
+    }
+}
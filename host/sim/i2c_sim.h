@@ -0,0 +1,91 @@
+#ifndef I2C_SIM_H
+#define I2C_SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+Host backend of the TKJHAT I2C layer. It implements tkjhat/i2c_bus.h and the Pico
+SDK i2c_* functions against simulated devices (sim_devices.h), so sdk.c and
+ssd1306.c run unchanged on Linux.
+
+Time model
+    All time is virtual. The CPU clock only moves when the code waits: sleep_ms(),
+    busy_wait_us(), a blocking transfer or i2c_bus_wait(). The bus is a second
+    timeline: a transaction starts when both the CPU has submitted it (plus
+    I2C_SIM_SETUP_NS for programming the controller) and the bus is free again
+    (previous STOP plus the bus free time tBUF of the speed grade). It then takes
+
+        START + address + bytes + (repeated START + address) + STOP
+
+    where every byte is 9 SCL periods (8 bits + ACK) and START/STOP one period
+    each. A submitted transaction runs in the background, so the CPU overlaps with
+    the bus exactly like with the DMA engine on the device.
+
+Limits
+    Transactions are put on the bus in the order they are submitted. The priority
+    classes of the real engine only matter when several tasks submit at once, which
+    the single threaded host does not do. Completion callbacks are called when the
+    transaction is submitted. Clock stretching is not modelled, and neither is the
+    CPU time of the code itself.
+*/
+
+#define I2C_SIM_SETUP_NS        2000    // controller and DMA setup per transaction
+#define I2C_SIM_MAX_PENDING     64      // submitted transactions tracked for i2c_bus_wait()
+#define I2C_SIM_DATA_CMD_STOP   0x200   // STOP bit of IC_DATA_CMD, see i2c_bus_encode_write()
+
+typedef struct {
+    uint32_t transactions;
+    uint32_t nacks;
+    uint64_t bytes_written;             // data bytes, address bytes not included
+    uint64_t bytes_read;
+    uint64_t bus_ns;                    // time on the bus
+} i2c_sim_device_stats_t;
+
+typedef struct i2c_sim_device i2c_sim_device_t;
+
+/*
+One simulated device. A model embeds this as its first member and fills the
+callbacks. start() is called after the address byte was acknowledged, with
+read = true for the read direction. write() returns false to NACK the byte.
+*/
+struct i2c_sim_device {
+    const char *name;
+    uint8_t address;
+    void (*start)(i2c_sim_device_t *device, bool read);
+    bool (*write)(i2c_sim_device_t *device, uint8_t byte);
+    uint8_t (*read)(i2c_sim_device_t *device);
+    void (*stop)(i2c_sim_device_t *device);
+
+    // Filled by the simulator
+    i2c_sim_device_stats_t stats;
+    i2c_sim_device_t *next;
+};
+
+typedef struct {
+    uint64_t elapsed_ns;                // virtual time since i2c_sim_reset_stats()
+    uint64_t busy_ns;                   // time the bus was not idle
+    uint32_t transactions;
+    uint32_t nacks;
+    uint64_t bytes;
+    uint32_t baudrate_changes;
+} i2c_sim_stats_t;
+
+// Clears the bus, the statistics and the list of devices and sets the clock to 0
+void i2c_sim_reset(void);
+void i2c_sim_attach(i2c_sim_device_t *device);
+
+// Virtual CPU clock (time_us_64() on the host)
+uint64_t i2c_sim_now_ns(void);
+void i2c_sim_advance_ns(uint64_t ns);
+
+// Bus time of one transaction at the given speed, e.g. for estimates
+uint64_t i2c_sim_transfer_ns(uint32_t baudrate, size_t tx_len, size_t rx_len);
+
+// Statistics of the simulator, the devices and the i2c_bus API start again from now
+void i2c_sim_reset_stats(void);
+void i2c_sim_get_stats(i2c_sim_stats_t *stats);
+void i2c_sim_print_stats(void);
+
+#endif
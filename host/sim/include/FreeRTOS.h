@@ -0,0 +1,28 @@
+/*
+Host replacement. There is no scheduler on the host: the drivers only need the
+types, and the few kernel functions they call are stubs in board.c that make
+task and queue creation fail, so everything takes its synchronous path.
+*/
+#ifndef HOST_SIM_FREERTOS_H
+#define HOST_SIM_FREERTOS_H
+#include <stdint.h>
+
+#define configTASK_NOTIFICATION_ARRAY_ENTRIES 2
+#define configTICK_RATE_HZ ((TickType_t)1000)
+
+typedef uint32_t TickType_t;
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+
+#define pdTRUE              1
+#define pdFALSE             0
+#define pdPASS              pdTRUE
+#define pdFAIL              pdFALSE
+#define portMAX_DELAY       ((TickType_t)0xffffffffu)
+#define pdMS_TO_TICKS(ms)   ((TickType_t)(ms))
+
+#define taskENTER_CRITICAL()
+#define taskEXIT_CRITICAL()
+#define taskENTER_CRITICAL_FROM_ISR()   0
+#define taskEXIT_CRITICAL_FROM_ISR(x)   (void)(x)
+#endif
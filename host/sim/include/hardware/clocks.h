@@ -0,0 +1,9 @@
+/* Host replacement, the clocks of an RP2040 at the default speed. */
+#ifndef HOST_SIM_HARDWARE_CLOCKS_H
+#define HOST_SIM_HARDWARE_CLOCKS_H
+#include "pico/stdlib.h"
+
+enum clock_index { clk_sys = 5 };
+
+uint32_t clock_get_hz(enum clock_index clk_index);
+#endif
@@ -0,0 +1,33 @@
+/* Host replacement, the simulator has no DMA engine: channels and timers cannot be claimed. */
+#ifndef HOST_SIM_HARDWARE_DMA_H
+#define HOST_SIM_HARDWARE_DMA_H
+#include "pico/stdlib.h"
+
+typedef struct { uint32_t ctrl; } dma_channel_config;
+enum dma_channel_transfer_size { DMA_SIZE_8 = 0, DMA_SIZE_16 = 1, DMA_SIZE_32 = 2 };
+
+int dma_claim_unused_channel(bool required);
+void dma_channel_unclaim(uint channel);
+int dma_claim_unused_timer(bool required);
+void dma_timer_unclaim(uint timer);
+void dma_timer_set_fraction(uint timer, uint16_t numerator, uint16_t denominator);
+uint dma_get_timer_dreq(uint timer);
+
+dma_channel_config dma_channel_get_default_config(uint channel);
+dma_channel_config dma_get_channel_config(uint channel);
+void channel_config_set_transfer_data_size(dma_channel_config *c, enum dma_channel_transfer_size size);
+void channel_config_set_read_increment(dma_channel_config *c, bool incr);
+void channel_config_set_write_increment(dma_channel_config *c, bool incr);
+void channel_config_set_dreq(dma_channel_config *c, uint dreq);
+void channel_config_set_chain_to(dma_channel_config *c, uint chain_to);
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger);
+void dma_channel_set_config(uint channel, const dma_channel_config *config, bool trigger);
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger);
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger);
+void dma_channel_start(uint channel);
+void dma_channel_abort(uint channel);
+void dma_channel_set_irq1_enabled(uint channel, bool enabled);
+bool dma_channel_get_irq1_status(uint channel);
+void dma_channel_acknowledge_irq1(uint channel);
+#endif
@@ -0,0 +1,5 @@
+/* Host replacement, see pico/stdlib.h. */
+#ifndef HOST_SIM_HARDWARE_GPIO_H
+#define HOST_SIM_HARDWARE_GPIO_H
+#include "pico/stdlib.h"
+#endif
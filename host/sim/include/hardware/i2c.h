@@ -0,0 +1,22 @@
+/*
+Host replacement of the Pico SDK I2C API. The transfers go to the simulated bus
+of host/sim/i2c_sim.c.
+*/
+#ifndef HOST_SIM_HARDWARE_I2C_H
+#define HOST_SIM_HARDWARE_I2C_H
+#include "pico/stdlib.h"
+
+typedef struct i2c_inst {
+    bool restart_on_next;
+} i2c_inst_t;
+
+extern i2c_inst_t i2c_sim_instance;
+#define i2c_default (&i2c_sim_instance)
+
+uint i2c_init(i2c_inst_t *i2c, uint baudrate);
+uint i2c_set_baudrate(i2c_inst_t *i2c, uint baudrate);
+int i2c_write_blocking(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop);
+int i2c_read_blocking(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop);
+int i2c_write_blocking_until(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, bool nostop, absolute_time_t until);
+int i2c_read_blocking_until(i2c_inst_t *i2c, uint8_t addr, uint8_t *dst, size_t len, bool nostop, absolute_time_t until);
+#endif
@@ -0,0 +1,8 @@
+/* Host replacement, only the types of the PDM microphone configuration. */
+#ifndef HOST_SIM_HARDWARE_PIO_H
+#define HOST_SIM_HARDWARE_PIO_H
+#include "pico/stdlib.h"
+
+typedef struct pio_sim *PIO;
+#define pio0 ((PIO)NULL)
+#endif
@@ -0,0 +1,27 @@
+/* Host replacement, PWM outputs are accepted and ignored. */
+#ifndef HOST_SIM_HARDWARE_PWM_H
+#define HOST_SIM_HARDWARE_PWM_H
+#include "pico/stdlib.h"
+
+uint pwm_gpio_to_slice_num(uint gpio);
+void pwm_set_clkdiv(uint slice_num, float divider);
+void pwm_set_enabled(uint slice_num, bool enabled);
+void pwm_set_gpio_level(uint gpio, uint16_t level);
+void pwm_set_clkdiv_int_frac(uint slice_num, uint8_t integer, uint8_t fract);
+void pwm_set_wrap(uint slice_num, uint16_t wrap);
+uint pwm_gpio_to_channel(uint gpio);
+
+#define PWM_CHAN_A 0
+#define PWM_CHAN_B 1
+
+// Registers, only as targets of DMA transfers
+typedef struct {
+    volatile uint32_t csr, div, ctr, cc, top;
+} pwm_slice_hw_t;
+
+typedef struct {
+    pwm_slice_hw_t slice[8];
+} pwm_hw_t;
+
+extern pwm_hw_t *pwm_hw;
+#endif
@@ -0,0 +1,13 @@
+/* Host replacement, alarm callbacks run when the CPU waits past the target (host/sim/board.c). */
+#ifndef HOST_SIM_HARDWARE_TIMER_H
+#define HOST_SIM_HARDWARE_TIMER_H
+#include "pico/stdlib.h"
+
+typedef void (*hardware_alarm_callback_t)(uint alarm_num);
+
+int hardware_alarm_claim_unused(bool required);
+void hardware_alarm_unclaim(uint alarm_num);
+void hardware_alarm_set_callback(uint alarm_num, hardware_alarm_callback_t callback);
+bool hardware_alarm_set_target(uint alarm_num, absolute_time_t t);
+void hardware_alarm_cancel(uint alarm_num);
+#endif
@@ -0,0 +1,4 @@
+/* Host replacement, binary info is not used on the host. */
+#ifndef HOST_SIM_PICO_BINARY_INFO_H
+#define HOST_SIM_PICO_BINARY_INFO_H
+#endif
@@ -0,0 +1,45 @@
+/*
+Host replacement of the Pico SDK headers the TKJHAT drivers use. Only what the
+drivers need is declared. Time runs on the virtual clock of the I2C simulator
+(host/sim/board.c), so sleeps cost no real time and runs are repeatable.
+*/
+#ifndef HOST_SIM_PICO_STDLIB_H
+#define HOST_SIM_PICO_STDLIB_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+typedef unsigned int uint;
+typedef uint64_t absolute_time_t;
+
+#define PICO_OK                 0
+#define PICO_ERROR_TIMEOUT      (-1)
+#define PICO_ERROR_GENERIC      (-2)
+
+#define GPIO_IN                 false
+#define GPIO_OUT                true
+
+enum gpio_function { GPIO_FUNC_SPI = 1, GPIO_FUNC_UART = 2, GPIO_FUNC_I2C = 3, GPIO_FUNC_PWM = 4, GPIO_FUNC_SIO = 5 };
+
+void gpio_init(uint gpio);
+void gpio_deinit(uint gpio);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_put(uint gpio, bool value);
+bool gpio_get(uint gpio);
+void gpio_set_function(uint gpio, enum gpio_function fn);
+void gpio_pull_up(uint gpio);
+void gpio_disable_pulls(uint gpio);
+
+uint64_t time_us_64(void);
+uint32_t time_us_32(void);
+void sleep_ms(uint32_t ms);
+void sleep_us(uint64_t us);
+void busy_wait_us(uint64_t us);
+absolute_time_t get_absolute_time(void);
+absolute_time_t make_timeout_time_ms(uint32_t ms);
+static inline absolute_time_t delayed_by_ms(absolute_time_t t, uint32_t ms) { return t + (uint64_t)ms * 1000; }
+static inline void tight_loop_contents(void) {}
+
+#endif
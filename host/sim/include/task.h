@@ -0,0 +1,13 @@
+/* Host replacement, see FreeRTOS.h. */
+#ifndef HOST_SIM_TASK_H
+#define HOST_SIM_TASK_H
+#include "FreeRTOS.h"
+
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+
+BaseType_t xTaskCreate(TaskFunction_t code, const char *name, uint32_t stack_depth, void *arg,
+                       UBaseType_t priority, TaskHandle_t *handle);
+TickType_t xTaskGetTickCount(void);
+void vTaskDelay(TickType_t ticks);
+#endif
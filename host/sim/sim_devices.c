@@ -0,0 +1,666 @@
+/*
+Register level device models for the I2C simulator, see sim_devices.h.
+Register addresses and reset values follow the datasheets linked in sdk.c.
+*/
+#include <stdio.h>
+#include <string.h>
+
+#include "sim_devices.h"
+
+/* =========================
+ *  ICM-42670-P
+ * ========================= */
+#define ICM_MCLK_RDY            0x00
+#define ICM_SIGNAL_PATH_RESET   0x02
+#define ICM_TEMP_DATA1          0x09
+#define ICM_GYRO_DATA_Z0        0x16
+#define ICM_PWR_MGMT0           0x1F
+#define ICM_GYRO_CONFIG0        0x20
+#define ICM_ACCEL_CONFIG0       0x21
+#define ICM_WOM_CONFIG          0x27
+#define ICM_FIFO_CONFIG1        0x28
+#define ICM_INT_STATUS_DRDY     0x39
+#define ICM_INT_STATUS2         0x3B
+#define ICM_FIFO_COUNTH         0x3D
+#define ICM_FIFO_COUNTL         0x3E
+#define ICM_FIFO_DATA           0x3F
+#define ICM_WHO_AM_I            0x75
+#define ICM_MADDR_W             0x7A
+#define ICM_M_W                 0x7B
+#define ICM_MADDR_R             0x7D
+#define ICM_M_R                 0x7E
+#define ICM_MREG1_WOM_X_THR     0x4B
+
+#define ICM_SOFT_RESET          0x10
+#define ICM_FIFO_FLUSH          0x04
+#define ICM_FIFO_PACKET_SIZE    16
+#define ICM_FIFO_HEADER_ACCEL_GYRO 0x68
+#define ICM_STILL_ACCEL_Z       8192    // 1 g at the +-4 g range
+
+static sim_icm42670_t *icm_of(i2c_sim_device_t *device) {
+    return (sim_icm42670_t *)device;
+}
+
+static void icm_reset(sim_icm42670_t *icm) {
+    memset(icm->regs, 0, sizeof(icm->regs));
+    memset(icm->mreg1, 0, sizeof(icm->mreg1));
+    icm->regs[ICM_MCLK_RDY] = 0x08;
+    icm->regs[ICM_GYRO_CONFIG0] = 0x06;
+    icm->regs[ICM_ACCEL_CONFIG0] = 0x06;
+    icm->regs[ICM_FIFO_CONFIG1] = 0x01; // FIFO bypassed
+    icm->regs[ICM_WHO_AM_I] = 0x67;
+    icm->fifo_head = 0;
+    icm->fifo_count = 0;
+}
+
+// Sample period of an ODR code of ACCEL_CONFIG0 / GYRO_CONFIG0
+static uint64_t icm_period_ns(uint8_t odr) {
+    static const uint32_t rate_x10[16] = {
+        [5] = 16000, [6] = 8000, [7] = 4000, [8] = 2000, [9] = 1000,
+        [10] = 500, [11] = 250, [12] = 125, [13] = 62, [14] = 31, [15] = 16,
+    };
+    uint32_t rate = rate_x10[odr & 0x0F];
+    return rate > 0 ? 10000000000ull / rate : 10000000ull;
+}
+
+static void put_be16(uint8_t *p, int16_t value) {
+    p[0] = (uint8_t)((uint16_t)value >> 8);
+    p[1] = (uint8_t)value;
+}
+
+static void icm_fifo_push(sim_icm42670_t *icm, const uint8_t *bytes, size_t length) {
+    if (icm->fifo_count + length > SIM_ICM42670_FIFO_SIZE) {
+        icm->fifo_overflows++;
+        return; // stream mode drops new packets when full
+    }
+    for (size_t i = 0; i < length; i++) {
+        icm->fifo[(icm->fifo_head + icm->fifo_count++) % SIM_ICM42670_FIFO_SIZE] = bytes[i];
+    }
+}
+
+static void icm_new_sample(sim_icm42670_t *icm, uint64_t at_ns) {
+    ImuSample sample = { .accel = {0, 0, ICM_STILL_ACCEL_Z} };
+    if (icm->samples != NULL && icm->sample_count > 0) {
+        sample = icm->samples[icm->sample_index];
+        icm->sample_index = (icm->sample_index + 1) % icm->sample_count;
+    }
+
+    // Wake-on-motion against the previous sample. Thresholds are 1/256 g.
+    uint8_t *data = &icm->regs[ICM_TEMP_DATA1];
+    if (icm->regs[ICM_WOM_CONFIG] & 0x01) {
+        static const int32_t lsb_per_g[4] = {2048, 4096, 8192, 16384};
+        int32_t per_g = lsb_per_g[(icm->regs[ICM_ACCEL_CONFIG0] >> 5) & 0x03];
+        for (int axis = 0; axis < 3; axis++) {
+            int16_t previous = (int16_t)((data[2 + 2 * axis] << 8) | data[3 + 2 * axis]);
+            int32_t delta = sample.accel[axis] - previous;
+            int32_t threshold = icm->mreg1[ICM_MREG1_WOM_X_THR + axis] * per_g / 256;
+            if (delta > threshold || -delta > threshold) {
+                icm->regs[ICM_INT_STATUS2] |= (uint8_t)(1u << axis);
+            }
+        }
+    }
+
+    put_be16(&data[0], 0); // 25 °C
+    for (int axis = 0; axis < 3; axis++) {
+        put_be16(&data[2 + 2 * axis], sample.accel[axis]);
+        put_be16(&data[8 + 2 * axis], sample.gyro[axis]);
+    }
+    icm->regs[ICM_INT_STATUS_DRDY] |= 0x01;
+
+    if (!(icm->regs[ICM_FIFO_CONFIG1] & 0x01)) {
+        uint8_t packet[ICM_FIFO_PACKET_SIZE];
+        packet[0] = ICM_FIFO_HEADER_ACCEL_GYRO;
+        memcpy(&packet[1], &data[2], 12);
+        packet[13] = 0; // temperature, (value / 2) + 25 °C
+        put_be16(&packet[14], (int16_t)(at_ns / 1000));
+        icm_fifo_push(icm, packet, sizeof(packet));
+    }
+}
+
+static bool icm_sensors_on(const sim_icm42670_t *icm) {
+    uint8_t power = icm->regs[ICM_PWR_MGMT0];
+    return (power & 0x03) >= 2 || ((power >> 2) & 0x03) >= 2;
+}
+
+static uint64_t icm_sample_period_ns(const sim_icm42670_t *icm) {
+    bool accel_on = (icm->regs[ICM_PWR_MGMT0] & 0x03) >= 2;
+    return icm_period_ns(icm->regs[accel_on ? ICM_ACCEL_CONFIG0 : ICM_GYRO_CONFIG0]);
+}
+
+// Produces the samples up to the current time
+static void icm_update(sim_icm42670_t *icm) {
+    uint64_t now = i2c_sim_now_ns();
+    if (!icm_sensors_on(icm)) {
+        icm->next_sample_ns = now;
+        return;
+    }
+    uint64_t period = icm_sample_period_ns(icm);
+    // After a long sleep only the last FIFO full of samples matters
+    uint64_t backlog = period * (SIM_ICM42670_FIFO_SIZE / ICM_FIFO_PACKET_SIZE + 1);
+    if (now > icm->next_sample_ns + backlog) {
+        icm->next_sample_ns = now - backlog;
+    }
+    while (icm->next_sample_ns <= now) {
+        icm_new_sample(icm, icm->next_sample_ns);
+        icm->next_sample_ns += period;
+    }
+}
+
+static void icm_write_register(sim_icm42670_t *icm, uint8_t reg, uint8_t value) {
+    switch (reg) {
+        case ICM_SIGNAL_PATH_RESET:
+            if (value & ICM_SOFT_RESET) {
+                icm_reset(icm);
+            } else if (value & ICM_FIFO_FLUSH) {
+                icm->fifo_head = 0;
+                icm->fifo_count = 0;
+            }
+            break;
+        case ICM_M_W:
+            icm->mreg1[icm->regs[ICM_MADDR_W] & 0x7F] = value;
+            break;
+        case ICM_PWR_MGMT0: {
+            bool was_on = icm_sensors_on(icm);
+            icm->regs[reg] = value;
+            if (!was_on && icm_sensors_on(icm)) {
+                icm->next_sample_ns = i2c_sim_now_ns() + icm_sample_period_ns(icm);
+            }
+            break;
+        }
+        case ICM_MCLK_RDY:
+        case ICM_WHO_AM_I:
+        case ICM_INT_STATUS_DRDY:
+        case ICM_INT_STATUS2:
+        case ICM_FIFO_COUNTH:
+        case ICM_FIFO_COUNTL:
+        case ICM_FIFO_DATA:
+            break; // read only
+        default:
+            if (reg < ICM_TEMP_DATA1 || reg > ICM_GYRO_DATA_Z0) {
+                icm->regs[reg] = value;
+            }
+            break;
+    }
+}
+
+static void icm_start(i2c_sim_device_t *device, bool read) {
+    sim_icm42670_t *icm = icm_of(device);
+    icm_update(icm);
+    if (!read) icm->pointer_set = false;
+}
+
+static bool icm_write(i2c_sim_device_t *device, uint8_t byte) {
+    sim_icm42670_t *icm = icm_of(device);
+    if (!icm->pointer_set) {
+        icm->pointer = byte & 0x7F;
+        icm->pointer_set = true;
+        return true;
+    }
+    icm_write_register(icm, icm->pointer, byte);
+    icm->pointer = (icm->pointer + 1) & 0x7F;
+    return true;
+}
+
+static uint8_t icm_read(i2c_sim_device_t *device) {
+    sim_icm42670_t *icm = icm_of(device);
+    uint8_t reg = icm->pointer;
+    uint8_t value = icm->regs[reg];
+    switch (reg) {
+        case ICM_FIFO_COUNTH:
+            value = (uint8_t)(icm->fifo_count >> 8);
+            break;
+        case ICM_FIFO_COUNTL:
+            value = (uint8_t)icm->fifo_count;
+            break;
+        case ICM_FIFO_DATA:
+            // FIFO_DATA does not auto-increment, a burst read empties the FIFO
+            value = 0xFF;
+            if (icm->fifo_count > 0) {
+                value = icm->fifo[icm->fifo_head];
+                icm->fifo_head = (icm->fifo_head + 1) % SIM_ICM42670_FIFO_SIZE;
+                icm->fifo_count--;
+            }
+            return value;
+        case ICM_INT_STATUS_DRDY:
+        case ICM_INT_STATUS2:
+            icm->regs[reg] = 0; // cleared on read
+            break;
+        case ICM_M_R:
+            value = icm->mreg1[icm->regs[ICM_MADDR_R] & 0x7F];
+            break;
+    }
+    icm->pointer = (icm->pointer + 1) & 0x7F;
+    return value;
+}
+
+void sim_icm42670_init(sim_icm42670_t *icm, uint8_t address) {
+    memset(icm, 0, sizeof(*icm));
+    icm->device.name = "ICM-42670";
+    icm->device.address = address;
+    icm->device.start = icm_start;
+    icm->device.write = icm_write;
+    icm->device.read = icm_read;
+    icm_reset(icm);
+}
+
+void sim_icm42670_set_samples(sim_icm42670_t *icm, const ImuSample *samples, size_t count) {
+    icm->samples = samples;
+    icm->sample_count = count;
+    icm->sample_index = 0;
+}
+
+/* =========================
+ *  SSD1306
+ * ========================= */
+static sim_ssd1306_t *oled_of(i2c_sim_device_t *device) {
+    return (sim_ssd1306_t *)device;
+}
+
+// Length of a command including its arguments
+static uint8_t ssd1306_command_length(uint8_t command) {
+    switch (command) {
+        case 0x21: case 0x22:                       // column / page address
+            return 3;
+        case 0x26: case 0x27:                       // horizontal scroll
+            return 7;
+        case 0x29: case 0x2A:                       // vertical and horizontal scroll
+            return 6;
+        case 0x20: case 0x81: case 0x8D: case 0xA3: case 0xA8:
+        case 0xD3: case 0xD5: case 0xD9: case 0xDA: case 0xDB:
+            return 2;
+        default:
+            return 1;
+    }
+}
+
+static void ssd1306_execute(sim_ssd1306_t *oled) {
+    const uint8_t *c = oled->command;
+    switch (c[0]) {
+        case 0x20: oled->addressing_mode = c[1] & 0x03; break;
+        case 0x21:
+            oled->column_start = oled->column = c[1] & 0x7F;
+            oled->column_end = c[2] & 0x7F;
+            break;
+        case 0x22:
+            oled->page_start = oled->page = c[1] & 0x07;
+            oled->page_end = c[2] & 0x07;
+            break;
+        case 0x81: oled->contrast = c[1]; break;
+        case 0xA6: oled->inverted = false; break;
+        case 0xA7: oled->inverted = true; break;
+        case 0xAE: oled->display_on = false; break;
+        case 0xAF: oled->display_on = true; break;
+        default:
+            if (c[0] >= 0xB0 && c[0] <= 0xB7) {
+                oled->page = c[0] & 0x07;              // page addressing mode
+            } else if (c[0] <= 0x0F) {
+                oled->column = (oled->column & 0xF0) | c[0];
+            } else if (c[0] <= 0x1F) {
+                oled->column = (uint8_t)(((c[0] & 0x07) << 4) | (oled->column & 0x0F));
+            }
+            break;
+    }
+}
+
+static void ssd1306_data(sim_ssd1306_t *oled, uint8_t byte) {
+    oled->ram[oled->page][oled->column & 0x7F] = byte;
+    switch (oled->addressing_mode) {
+        case 0: // horizontal
+            if (oled->column++ >= oled->column_end) {
+                oled->column = oled->column_start;
+                oled->page = oled->page >= oled->page_end ? oled->page_start : oled->page + 1;
+            }
+            break;
+        case 1: // vertical
+            if (oled->page++ >= oled->page_end) {
+                oled->page = oled->page_start;
+                oled->column = oled->column >= oled->column_end ? oled->column_start : oled->column + 1;
+            }
+            break;
+        default: // page
+            oled->column = (oled->column + 1) & 0x7F;
+            break;
+    }
+}
+
+static void ssd1306_start(i2c_sim_device_t *device, bool read) {
+    sim_ssd1306_t *oled = oled_of(device);
+    if (!read) oled->control_expected = true;
+}
+
+static bool ssd1306_write(i2c_sim_device_t *device, uint8_t byte) {
+    sim_ssd1306_t *oled = oled_of(device);
+    if (oled->control_expected) {
+        oled->single = (byte & 0x80) != 0;
+        oled->data_mode = (byte & 0x40) != 0;
+        oled->control_expected = false;
+        return true;
+    }
+    if (oled->data_mode) {
+        ssd1306_data(oled, byte);
+        oled->data_bytes++;
+    } else {
+        // A command can be split over several transfers, as ssd1306_write() does
+        oled->command[oled->command_length++] = byte;
+        if (oled->command_length >= ssd1306_command_length(oled->command[0])) {
+            ssd1306_execute(oled);
+            oled->command_length = 0;
+        }
+        oled->command_bytes++;
+    }
+    if (oled->single) oled->control_expected = true;
+    return true;
+}
+
+static uint8_t ssd1306_read(i2c_sim_device_t *device) {
+    return oled_of(device)->display_on ? 0x00 : 0x40; // status byte, bit 6: display off
+}
+
+void sim_ssd1306_init(sim_ssd1306_t *oled, uint8_t address) {
+    memset(oled, 0, sizeof(*oled));
+    oled->device.name = "SSD1306";
+    oled->device.address = address;
+    oled->device.start = ssd1306_start;
+    oled->device.write = ssd1306_write;
+    oled->device.read = ssd1306_read;
+    oled->contrast = 0x7F;
+    oled->addressing_mode = 2;
+    oled->column_end = SIM_SSD1306_WIDTH - 1;
+    oled->page_end = SIM_SSD1306_PAGES - 1;
+}
+
+bool sim_ssd1306_pixel(const sim_ssd1306_t *oled, int x, int y) {
+    if (x < 0 || x >= SIM_SSD1306_WIDTH || y < 0 || y >= SIM_SSD1306_PAGES * 8) return false;
+    return (oled->ram[y / 8][x] >> (y % 8)) & 1;
+}
+
+void sim_ssd1306_print(const sim_ssd1306_t *oled) {
+    printf("+");
+    for (int x = 0; x < SIM_SSD1306_WIDTH; x++) putchar('-');
+    printf("+\n");
+    for (int y = 0; y < SIM_SSD1306_PAGES * 8; y += 2) {
+        putchar('|');
+        for (int x = 0; x < SIM_SSD1306_WIDTH; x++) {
+            bool top = sim_ssd1306_pixel(oled, x, y) != oled->inverted;
+            bool bottom = sim_ssd1306_pixel(oled, x, y + 1) != oled->inverted;
+            putchar(top && bottom ? '#' : top ? '\'' : bottom ? '.' : ' ');
+        }
+        printf("|\n");
+    }
+    printf("+");
+    for (int x = 0; x < SIM_SSD1306_WIDTH; x++) putchar('-');
+    printf("+\n");
+}
+
+// What the panel shows at (x, y): the RAM bit, inverted by the invert command, dark when off
+static bool ssd1306_lit(const sim_ssd1306_t *oled, int x, int y) {
+    return oled->display_on && sim_ssd1306_pixel(oled, x, y) != oled->inverted;
+}
+
+bool sim_ssd1306_write_pgm(const sim_ssd1306_t *oled, const char *path, int scale) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+    int width = SIM_SSD1306_WIDTH * scale, height = SIM_SSD1306_PAGES * 8 * scale;
+    fprintf(file, "P5\n%d %d\n255\n", width, height);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            fputc(ssd1306_lit(oled, x / scale, y / scale) ? 255 : 0, file);
+        }
+    }
+    return fclose(file) == 0;
+}
+
+bool sim_ssd1306_write_pbm(const sim_ssd1306_t *oled, const char *path) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+    fprintf(file, "P1\n%d %d\n", SIM_SSD1306_WIDTH, SIM_SSD1306_PAGES * 8);
+    for (int y = 0; y < SIM_SSD1306_PAGES * 8; y++) {
+        for (int x = 0; x < SIM_SSD1306_WIDTH; x++) {
+            fputc(ssd1306_lit(oled, x, y) ? '1' : '0', file);
+        }
+        fputc('\n', file);
+    }
+    return fclose(file) == 0;
+}
+
+bool sim_ssd1306_compare_pbm(const sim_ssd1306_t *oled, const char *path, sim_ssd1306_diff_t *diff) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return false;
+    }
+    int width, height;
+    bool ok = fscanf(file, "P1 %d %d", &width, &height) == 2
+            && width == SIM_SSD1306_WIDTH && height == SIM_SSD1306_PAGES * 8;
+
+    *diff = (sim_ssd1306_diff_t){0, width, height, -1, -1};
+    for (int i = 0; ok && i < width * height; i++) {
+        int c;
+        while ((c = fgetc(file)) == ' ' || c == '\n' || c == '\r' || c == '\t') {}
+        if (c != '0' && c != '1') {
+            ok = false;
+            break;
+        }
+        int x = i % width, y = i / width;
+        if ((c == '1') != ssd1306_lit(oled, x, y)) {
+            diff->pixels++;
+            if (x < diff->x0) diff->x0 = x;
+            if (y < diff->y0) diff->y0 = y;
+            if (x > diff->x1) diff->x1 = x;
+            if (y > diff->y1) diff->y1 = y;
+        }
+    }
+    fclose(file);
+    return ok;
+}
+
+/* =========================
+ *  VEML6030
+ * ========================= */
+#define VEML_ALS_CONF           0x00
+#define VEML_ALS                0x04
+
+static sim_veml6030_t *veml_of(i2c_sim_device_t *device) {
+    return (sim_veml6030_t *)device;
+}
+
+// ALS counts for the configured gain and integration time (application note, page 5)
+static uint16_t veml_counts(const sim_veml6030_t *veml) {
+    static const float gains[4] = {1.0f, 2.0f, 0.125f, 0.25f};
+    uint16_t config = veml->regs[VEML_ALS_CONF];
+    if (config & 0x0001) {
+        return veml->regs[VEML_ALS]; // shut down, the last result stays
+    }
+    float gain = gains[(config >> 11) & 0x03];
+    float it_ms;
+    switch ((config >> 6) & 0x0F) {
+        case 0x0C: it_ms = 25; break;
+        case 0x08: it_ms = 50; break;
+        case 0x01: it_ms = 200; break;
+        case 0x02: it_ms = 400; break;
+        case 0x03: it_ms = 800; break;
+        default:   it_ms = 100; break;
+    }
+    float resolution = 0.0036f * (2.0f / gain) * (800.0f / it_ms);
+    float counts = veml->lux / resolution;
+    return counts > 65535.0f ? 65535 : (uint16_t)counts;
+}
+
+static void veml_start(i2c_sim_device_t *device, bool read) {
+    sim_veml6030_t *veml = veml_of(device);
+    if (read) {
+        veml->msb_next = false;
+        if (veml->pointer == VEML_ALS) veml->regs[VEML_ALS] = veml_counts(veml);
+    } else {
+        veml->written = 0;
+    }
+}
+
+static bool veml_write(i2c_sim_device_t *device, uint8_t byte) {
+    sim_veml6030_t *veml = veml_of(device);
+    switch (veml->written++) {
+        case 0:
+            if (byte >= 8) return false; // no such command code
+            veml->pointer = byte;
+            break;
+        case 1:
+            veml->regs[veml->pointer] = byte; // LSB first
+            break;
+        case 2:
+            veml->regs[veml->pointer] |= (uint16_t)byte << 8;
+            break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+static uint8_t veml_read(i2c_sim_device_t *device) {
+    sim_veml6030_t *veml = veml_of(device);
+    uint16_t value = veml->regs[veml->pointer];
+    uint8_t byte = veml->msb_next ? (uint8_t)(value >> 8) : (uint8_t)value;
+    veml->msb_next = !veml->msb_next;
+    return byte;
+}
+
+void sim_veml6030_init(sim_veml6030_t *veml, uint8_t address) {
+    memset(veml, 0, sizeof(*veml));
+    veml->device.name = "VEML6030";
+    veml->device.address = address;
+    veml->device.start = veml_start;
+    veml->device.write = veml_write;
+    veml->device.read = veml_read;
+    veml->regs[VEML_ALS_CONF] = 0x0001; // shut down after power on
+    veml->lux = 300.0f;
+}
+
+void sim_veml6030_set_lux(sim_veml6030_t *veml, float lux) {
+    veml->lux = lux;
+}
+
+/* =========================
+ *  HDC2021
+ * ========================= */
+#define HDC_TEMP_LOW            0x00
+#define HDC_DRDY_STATUS         0x04
+#define HDC_CONFIG              0x0E
+#define HDC_MEASUREMENT_CONFIG  0x0F
+
+#define HDC_CONVERSION_NS       1270000ull  // 14-bit temperature + 14-bit humidity
+
+static sim_hdc2021_t *hdc_of(i2c_sim_device_t *device) {
+    return (sim_hdc2021_t *)device;
+}
+
+static void hdc_reset(sim_hdc2021_t *hdc) {
+    memset(hdc->regs, 0, sizeof(hdc->regs));
+    hdc->regs[0xFC] = 0x49; // manufacturer ID 0x5449
+    hdc->regs[0xFD] = 0x54;
+    hdc->regs[0xFE] = 0xD0; // device ID 0x07D0
+    hdc->regs[0xFF] = 0x07;
+    hdc->conversion_done_ns = 0;
+    hdc->next_auto_ns = 0;
+}
+
+// Auto measurement mode period of CONFIG bits 6:4, 0 when disabled
+static uint64_t hdc_auto_period_ns(const sim_hdc2021_t *hdc) {
+    static const uint64_t period_ms[8] = {0, 120000, 60000, 10000, 5000, 1000, 500, 200};
+    return period_ms[(hdc->regs[HDC_CONFIG] >> 4) & 0x07] * 1000000ull;
+}
+
+static void hdc_latch(sim_hdc2021_t *hdc) {
+    float t = (hdc->temperature + 40.0f) * 65536.0f / 165.0f;
+    float h = hdc->humidity * 65536.0f / 100.0f;
+    uint16_t temperature = t < 0 ? 0 : t > 65535.0f ? 65535 : (uint16_t)t;
+    uint16_t humidity = h < 0 ? 0 : h > 65535.0f ? 65535 : (uint16_t)h;
+    hdc->regs[HDC_TEMP_LOW + 0] = (uint8_t)temperature;
+    hdc->regs[HDC_TEMP_LOW + 1] = (uint8_t)(temperature >> 8);
+    hdc->regs[HDC_TEMP_LOW + 2] = (uint8_t)humidity;
+    hdc->regs[HDC_TEMP_LOW + 3] = (uint8_t)(humidity >> 8);
+    hdc->regs[HDC_DRDY_STATUS] |= 0x80;
+}
+
+static void hdc_update(sim_hdc2021_t *hdc) {
+    uint64_t now = i2c_sim_now_ns();
+    if (hdc->conversion_done_ns != 0 && now >= hdc->conversion_done_ns) {
+        hdc_latch(hdc);
+        hdc->conversion_done_ns = 0;
+    }
+    uint64_t period = hdc_auto_period_ns(hdc);
+    if (period > 0 && now >= hdc->next_auto_ns) {
+        hdc_latch(hdc);
+        hdc->next_auto_ns = now + period - (now - hdc->next_auto_ns) % period;
+    }
+}
+
+static void hdc_write_register(sim_hdc2021_t *hdc, uint8_t reg, uint8_t value) {
+    if (reg <= HDC_DRDY_STATUS || reg >= 0xFC) {
+        return; // results, status and IDs are read only
+    }
+    if (reg == HDC_CONFIG) {
+        if (value & 0x80) {
+            hdc_reset(hdc); // SOFT_RES clears itself
+            return;
+        }
+        bool was_auto = hdc_auto_period_ns(hdc) > 0;
+        hdc->regs[reg] = value;
+        if (!was_auto && hdc_auto_period_ns(hdc) > 0) {
+            hdc->next_auto_ns = i2c_sim_now_ns() + HDC_CONVERSION_NS;
+        }
+        return;
+    }
+    if (reg == HDC_MEASUREMENT_CONFIG && (value & 0x01)) {
+        hdc->conversion_done_ns = i2c_sim_now_ns() + HDC_CONVERSION_NS;
+        value &= (uint8_t)~0x01; // MEAS_TRIG clears itself
+    }
+    hdc->regs[reg] = value;
+}
+
+static void hdc_start(i2c_sim_device_t *device, bool read) {
+    sim_hdc2021_t *hdc = hdc_of(device);
+    hdc_update(hdc);
+    if (!read) hdc->pointer_set = false;
+}
+
+static bool hdc_write(i2c_sim_device_t *device, uint8_t byte) {
+    sim_hdc2021_t *hdc = hdc_of(device);
+    if (!hdc->pointer_set) {
+        hdc->pointer = byte;
+        hdc->pointer_set = true;
+        return true;
+    }
+    hdc_write_register(hdc, hdc->pointer++, byte);
+    return true;
+}
+
+static uint8_t hdc_read(i2c_sim_device_t *device) {
+    sim_hdc2021_t *hdc = hdc_of(device);
+    uint8_t value = hdc->regs[hdc->pointer];
+    if (hdc->pointer == HDC_DRDY_STATUS) {
+        hdc->regs[HDC_DRDY_STATUS] = 0; // cleared on read
+    }
+    hdc->pointer++;
+    return value;
+}
+
+void sim_hdc2021_init(sim_hdc2021_t *hdc, uint8_t address) {
+    memset(hdc, 0, sizeof(*hdc));
+    hdc->device.name = "HDC2021";
+    hdc->device.address = address;
+    hdc->device.start = hdc_start;
+    hdc->device.write = hdc_write;
+    hdc->device.read = hdc_read;
+    hdc_reset(hdc);
+    hdc->temperature = 22.5f;
+    hdc->humidity = 40.0f;
+}
+
+void sim_hdc2021_set(sim_hdc2021_t *hdc, float temperature, float humidity) {
+    hdc->temperature = temperature;
+    hdc->humidity = humidity;
+}
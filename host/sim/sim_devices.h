@@ -0,0 +1,125 @@
+#ifndef SIM_DEVICES_H
+#define SIM_DEVICES_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "i2c_sim.h"
+#include "imu_record.h"
+
+/*
+Register level models of the I2C devices on the HAT. Each model is initialized
+with its address and attached with i2c_sim_attach(&model.device). Sensor values
+follow the virtual clock: they are updated when the device is accessed.
+*/
+
+/*
+ICM-42670-P: bank 0 register map with auto-increment, soft reset, MCLK_RDY,
+WHO_AM_I, big-endian data registers, DATA_RDY status, the FIFO (16-byte packets
+with accel, gyro, temperature and timestamp) and indirect MREG1 writes. Samples
+advance at the accelerometer ODR while the accelerometer is on. They come from
+a recording (imu_record.h) or, without one, from a device lying still.
+*/
+#define SIM_ICM42670_FIFO_SIZE      2048
+
+typedef struct {
+    i2c_sim_device_t device;
+    uint8_t regs[128];
+    uint8_t mreg1[128];
+    uint8_t pointer;
+    bool pointer_set;               // first written byte of a transfer is the register
+
+    const ImuSample *samples;       // NULL: still device
+    size_t sample_count;
+    size_t sample_index;
+    uint64_t next_sample_ns;        // ODR timeline
+
+    uint8_t fifo[SIM_ICM42670_FIFO_SIZE];
+    size_t fifo_head;
+    size_t fifo_count;
+    uint32_t fifo_overflows;
+} sim_icm42670_t;
+
+void sim_icm42670_init(sim_icm42670_t *icm, uint8_t address);
+// The recording is replayed in a loop. samples must stay valid.
+void sim_icm42670_set_samples(sim_icm42670_t *icm, const ImuSample *samples, size_t count);
+
+/*
+SSD1306: control byte parsing (command stream, data stream, Co bit), addressing
+mode, column and page windows and the 128x64 display RAM.
+*/
+#define SIM_SSD1306_WIDTH           128
+#define SIM_SSD1306_PAGES           8
+
+typedef struct {
+    i2c_sim_device_t device;
+    uint8_t ram[SIM_SSD1306_PAGES][SIM_SSD1306_WIDTH];
+    bool display_on;
+    bool inverted;
+    uint8_t contrast;
+    uint8_t addressing_mode;        // 0 horizontal, 1 vertical, 2 page
+    uint8_t column_start, column_end, page_start, page_end;
+    uint8_t column, page;
+
+    // control byte state of the running transfer
+    bool control_expected;
+    bool data_mode;
+    bool single;                    // Co bit: one byte, then a new control byte
+    uint8_t command[8];
+    uint8_t command_length;
+
+    uint32_t data_bytes;
+    uint32_t command_bytes;
+} sim_ssd1306_t;
+
+void sim_ssd1306_init(sim_ssd1306_t *oled, uint8_t address);
+bool sim_ssd1306_pixel(const sim_ssd1306_t *oled, int x, int y);
+// Prints the display RAM as text, one character per two rows of pixels
+void sim_ssd1306_print(const sim_ssd1306_t *oled);
+// Writes what the panel shows as a binary PGM, every pixel scale x scale (display off: black)
+bool sim_ssd1306_write_pgm(const sim_ssd1306_t *oled, const char *path, int scale);
+// Writes what the panel shows as a plain PBM (P1), one text row per pixel row, 1 = lit
+bool sim_ssd1306_write_pbm(const sim_ssd1306_t *oled, const char *path);
+
+typedef struct {
+    int pixels;                     // pixels that differ, 0 when the images are the same
+    int x0, y0, x1, y1;             // bounding box of the differences
+} sim_ssd1306_diff_t;
+
+// Compares what the panel shows to a PBM written by sim_ssd1306_write_pbm(). Returns false if
+// the file cannot be read or is not a PBM of the panel size.
+bool sim_ssd1306_compare_pbm(const sim_ssd1306_t *oled, const char *path, sim_ssd1306_diff_t *diff);
+
+/* VEML6030: 16-bit registers (command code, LSB, MSB), ALS counts from a lux value. */
+typedef struct {
+    i2c_sim_device_t device;
+    uint16_t regs[8];
+    uint8_t pointer;
+    uint8_t written;                // bytes written in the running transfer
+    bool msb_next;                  // next read returns the MSB
+    float lux;
+} sim_veml6030_t;
+
+void sim_veml6030_init(sim_veml6030_t *veml, uint8_t address);
+void sim_veml6030_set_lux(sim_veml6030_t *veml, float lux);
+
+/*
+HDC2021: register map with auto-increment, soft reset, manual trigger and
+auto measurement mode, conversion time and DRDY, device ID registers.
+*/
+typedef struct {
+    i2c_sim_device_t device;
+    uint8_t regs[256];
+    uint8_t pointer;
+    bool pointer_set;
+    uint64_t conversion_done_ns;    // 0: no conversion running
+    uint64_t next_auto_ns;
+    float temperature;
+    float humidity;
+} sim_hdc2021_t;
+
+void sim_hdc2021_init(sim_hdc2021_t *hdc, uint8_t address);
+void sim_hdc2021_set(sim_hdc2021_t *hdc, float temperature, float humidity);
+
+#endif
@@ -0,0 +1,180 @@
+/*
+Converts the pixel art of libs/TKJHAT/src/sprites.txt to the sprite atlas of the
+device: one array of 1-bpp bitmaps in the layout of the SSD1306 frame buffer (page
+by page, one byte per column, bit 0 on top), so draw_sprite() copies each page of
+a sprite with one memcpy. Writes the header with the sprite ids and the source
+with the atlas. Run it again after changing the art and commit the results.
+
+Usage: sprite_gen sprites.txt sprites.h sprites.c
+*/
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_SPRITES     32
+#define MAX_WIDTH       128
+#define MAX_HEIGHT      64
+#define MAX_NAME        32
+#define MAX_LINE        256
+
+typedef struct {
+    char name[MAX_NAME];
+    char description[MAX_LINE];
+    int width;
+    int height;
+    bool pixels[MAX_HEIGHT][MAX_WIDTH];
+} Sprite;
+
+static Sprite sprites[MAX_SPRITES];
+static int spriteCount = 0;
+
+static void trim(char *line) {
+    size_t length = strlen(line);
+    while (length > 0 && isspace((unsigned char)line[length - 1])) {
+        line[--length] = '\0';
+    }
+}
+
+static bool parse(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+    char line[MAX_LINE];
+    int lineNumber = 0;
+    Sprite *sprite = NULL;
+    bool ok = true;
+
+    while (ok && fgets(line, sizeof(line), file) != NULL) {
+        lineNumber++;
+        trim(line);
+        if (line[0] == '\0') continue;
+        if (line[0] == '#') {
+            if (sprite != NULL && sprite->description[0] == '\0' && sprite->height == 0) {
+                const char *text = line + 1;
+                while (*text == ' ') text++;
+                snprintf(sprite->description, sizeof(sprite->description), "%s", text);
+            }
+            continue;
+        }
+        if (strncmp(line, "sprite ", 7) == 0) {
+            if (spriteCount == MAX_SPRITES) {
+                fprintf(stderr, "%s:%d: more than %d sprites\n", path, lineNumber, MAX_SPRITES);
+                ok = false;
+                break;
+            }
+            sprite = &sprites[spriteCount++];
+            snprintf(sprite->name, sizeof(sprite->name), "%s", line + 7);
+            continue;
+        }
+        if (sprite == NULL) {
+            fprintf(stderr, "%s:%d: pixels before the first sprite\n", path, lineNumber);
+            ok = false;
+            break;
+        }
+
+        int width = (int)strlen(line);
+        if (sprite->height == 0) {
+            sprite->width = width;
+        }
+        if (width != sprite->width || width > MAX_WIDTH || sprite->height == MAX_HEIGHT) {
+            fprintf(stderr, "%s:%d: row does not fit sprite %s\n", path, lineNumber, sprite->name);
+            ok = false;
+            break;
+        }
+        for (int x = 0; x < width; x++) {
+            if (line[x] != 'X' && line[x] != '.') {
+                fprintf(stderr, "%s:%d: unknown pixel '%c'\n", path, lineNumber, line[x]);
+                ok = false;
+                break;
+            }
+            sprite->pixels[sprite->height][x] = line[x] == 'X';
+        }
+        sprite->height++;
+    }
+    fclose(file);
+
+    for (int i = 0; ok && i < spriteCount; i++) {
+        if (sprites[i].height == 0 || sprites[i].height % 8 != 0) {
+            fprintf(stderr, "%s: height of sprite %s is not a multiple of 8\n", path, sprites[i].name);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+static bool write_header(const char *path, const char *source) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+    fprintf(file, "// Generated by host/sprite_gen from %s, do not edit.\n\n", source);
+    fprintf(file, "#ifndef _inc_sprites\n#define _inc_sprites\n\n#include <stdint.h>\n\n");
+    fprintf(file, "/**\n*\t@brief sprites of the atlas\n*/\ntypedef enum {\n");
+    for (int i = 0; i < spriteCount; i++) {
+        fprintf(file, "    SPRITE_%s,\t/**< %dx%d %s */\n", sprites[i].name, sprites[i].width, sprites[i].height,
+                sprites[i].description);
+    }
+    fprintf(file, "    SPRITE_COUNT\n} sprite_id_t;\n\n");
+    fprintf(file, "/**\n*\t@brief one bitmap of the atlas, page by page like the frame buffer of ssd1306.h\n*/\n");
+    fprintf(file, "typedef struct {\n");
+    fprintf(file, "    uint16_t offset;\t/**< first byte in sprite_atlas */\n");
+    fprintf(file, "    uint8_t width;\t/**< columns, one byte per column and page */\n");
+    fprintf(file, "    uint8_t pages;\t/**< rows / 8 */\n");
+    fprintf(file, "} sprite_t;\n\n");
+    fprintf(file, "extern const uint8_t sprite_atlas[];\n");
+    fprintf(file, "extern const sprite_t sprites[SPRITE_COUNT];\n\n#endif\n");
+    return fclose(file) == 0;
+}
+
+static bool write_source(const char *path, const char *source) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        perror(path);
+        return false;
+    }
+    fprintf(file, "// Generated by host/sprite_gen from %s, do not edit.\n\n", source);
+    fprintf(file, "#include <tkjhat/sprites.h>\n\n");
+    fprintf(file, "const uint8_t sprite_atlas[] = {\n");
+    int offsets[MAX_SPRITES];
+    int offset = 0;
+    for (int i = 0; i < spriteCount; i++) {
+        const Sprite *sprite = &sprites[i];
+        offsets[i] = offset;
+        fprintf(file, "    // %s\n", sprite->name);
+        for (int page = 0; page < sprite->height / 8; page++) {
+            for (int x = 0; x < sprite->width; x++) {
+                uint8_t byte = 0;
+                for (int bit = 0; bit < 8; bit++) {
+                    if (sprite->pixels[page * 8 + bit][x]) byte |= (uint8_t)(1u << bit);
+                }
+                fprintf(file, "%s0x%02X,", x % 16 == 0 ? "    " : " ", byte);
+                if (x % 16 == 15 || x == sprite->width - 1) fprintf(file, "\n");
+            }
+        }
+        offset += sprite->width * sprite->height / 8;
+    }
+    fprintf(file, "};\n\nconst sprite_t sprites[SPRITE_COUNT] = {\n");
+    for (int i = 0; i < spriteCount; i++) {
+        fprintf(file, "    [SPRITE_%s] = {%d, %d, %d},\n", sprites[i].name, offsets[i], sprites[i].width,
+                sprites[i].height / 8);
+    }
+    fprintf(file, "};\n");
+    return fclose(file) == 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc != 4) {
+        fprintf(stderr, "usage: %s sprites.txt sprites.h sprites.c\n", argv[0]);
+        return 2;
+    }
+    if (!parse(argv[1])) return 1;
+    if (!write_header(argv[2], argv[1]) || !write_source(argv[3], argv[1])) return 1;
+    printf("%d sprites\n", spriteCount);
+    return 0;
+}
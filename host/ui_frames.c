@@ -0,0 +1,225 @@
+/*
+Draws the screens of the application (src/screens.c) with sdk.c and ssd1306.c on
+the simulated SSD1306 and checks each one against a reference image and a budget.
+The reference images are plain PBM files in host/frames, one text row per pixel
+row, so a change of a screen shows up in the diff. The budgets are the bytes sent
+to the display and the drawing calls of the frame when the references were made.
+
+Usage: ui_frames [-r directory] [-o directory] [-u]
+    -r  directory of the reference images (default: host/frames)
+    -o  also write every frame as a PGM image (4x scale) and as a PBM into the directory
+    -u  write the frames of this run as the new reference images and print a new
+        budget table for this file instead of checking
+
+A frame that differs from its reference image, or that sends more bytes or makes
+more drawing calls than its budget, is reported and the exit status is 1.
+After an intended change of a screen, run with -u, look at the diff of the
+images and replace the table below.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <tkjhat/sdk.h>
+
+#include "i2c_sim.h"
+#include "sim_devices.h"
+#include "morse.h"
+#include "screens.h"
+
+#ifndef UI_FRAMES_REFERENCE_DIR
+#define UI_FRAMES_REFERENCE_DIR "frames"
+#endif
+#define PGM_SCALE   4
+#define TICKER_SPEED 20 // PLAYBACK_TICKER_SPEED of src/main.c
+
+typedef struct {
+    const char *name;
+    void (*draw)(void);
+} Frame;
+
+typedef struct {
+    const char *name;
+    uint32_t bytes;         // budget: bytes sent to the display
+    uint32_t draws;         // budget: calls of the SSD1306 drawing functions
+} Budget;
+
+static const Budget budgets[] = {
+    {"write",            1039, 7},
+    {"symbol",           159, 2},
+    {"receiving",        261, 10},
+    {"ticker_start",     372, 2},
+    {"ticker_1s",        154, 1},
+    {"ticker_3s",        154, 1},
+    {"checkmark",        115, 2},
+    {"playback_step",    158, 11},
+    {"message_page",     899, 146},
+};
+
+static const char sos[] = "... --- ...";
+
+static sim_ssd1306_t oled;
+
+// sensor_task() in src/main.c
+static void draw_write(void) {
+    screen_write();
+}
+
+// add_symbol() after a dot
+static void draw_symbol(void) {
+    screen_symbol(MORSE_DOT);
+}
+
+// send_message_task() after the message was sent, over the previous screen
+static void draw_receiving(void) {
+    screen_receiving();
+}
+
+// play_message_ticker(): the start and the ticker 1 s and 3 s later
+static void draw_ticker_start(void) {
+    screen_ticker_start(sos, TICKER_SPEED);
+    display_ticker_position();
+}
+
+static void draw_ticker_1s(void) {
+    sleep_ms(1000);
+    display_ticker_position();
+}
+
+static void draw_ticker_3s(void) {
+    sleep_ms(2000);
+    display_ticker_position();
+}
+
+// message_displayed(), the ticker has run to the end
+static void draw_checkmark(void) {
+    display_ticker_stop();
+    screen_checkmark();
+}
+
+// The first step of the stepped playback
+static void draw_playback_step(void) {
+    screen_playback_step(sos, (int)strlen(sos), 0);
+}
+
+// play_message_pages(): the first screen of a long message
+static void draw_message_page(void) {
+    static text_layout_t layout;
+    screen_message_layout(&layout, "... --- ... .-.. --- -. --. -- . ... ... .- --. . .-- .. - .... -- .- -. -.-- "
+                                   ".-- --- .-. -.. ... .- -. -.. .- ... . -.-. --- -. -.. ... -.-. .-. . . -.\n");
+    screen_message_page(&layout, 0);
+}
+
+static const Frame frames[] = {
+    {"write",           draw_write},
+    {"symbol",          draw_symbol},
+    {"receiving",       draw_receiving},
+    {"ticker_start",    draw_ticker_start},
+    {"ticker_1s",       draw_ticker_1s},
+    {"ticker_3s",       draw_ticker_3s},
+    {"checkmark",       draw_checkmark},
+    {"playback_step",   draw_playback_step},
+    {"message_page",    draw_message_page},
+};
+
+static const Budget *find_budget(const char *name) {
+    for (size_t i = 0; i < sizeof(budgets) / sizeof(budgets[0]); i++) {
+        if (strcmp(budgets[i].name, name) == 0) return &budgets[i];
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv) {
+    const char *references = UI_FRAMES_REFERENCE_DIR;
+    const char *directory = NULL;
+    bool update = false;
+
+    int option;
+    while ((option = getopt(argc, argv, "r:o:u")) != -1) {
+        switch (option) {
+            case 'r': references = optarg; break;
+            case 'o': directory = optarg; break;
+            case 'u': update = true; break;
+            default:
+                fprintf(stderr, "usage: %s [-r directory] [-o directory] [-u]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    i2c_sim_reset();
+    sim_ssd1306_init(&oled, SSD1306_I2C_ADDRESS);
+    i2c_sim_attach(&oled.device);
+    init_i2c_default();
+    init_display();
+
+    int failures = 0;
+    if (update) {
+        printf("static const Budget budgets[] = {\n");
+    } else {
+        printf("%-16s %12s %12s  %s\n", "frame", "bytes", "draws", "result");
+    }
+    for (size_t i = 0; i < sizeof(frames) / sizeof(frames[0]); i++) {
+        const Frame *frame = &frames[i];
+        display_service_stats_t before, after;
+        display_service_get_stats(&before);
+        frame->draw();
+        display_service_get_stats(&after);
+        uint32_t bytes = after.bytes - before.bytes;
+        uint32_t draws = after.draws - before.draws;
+
+        char path[512];
+        if (directory != NULL) {
+            snprintf(path, sizeof(path), "%s/%s.pgm", directory, frame->name);
+            if (!sim_ssd1306_write_pgm(&oled, path, PGM_SCALE)) {
+                return 2;
+            }
+            snprintf(path, sizeof(path), "%s/%s.pbm", directory, frame->name);
+            if (!sim_ssd1306_write_pbm(&oled, path)) {
+                return 2;
+            }
+        }
+        snprintf(path, sizeof(path), "%s/%s.pbm", references, frame->name);
+        if (update) {
+            if (!sim_ssd1306_write_pbm(&oled, path)) {
+                return 2;
+            }
+            printf("    {\"%s\",%*s %lu, %lu},\n", frame->name, (int)(16 - strlen(frame->name)), "",
+                   (unsigned long)bytes, (unsigned long)draws);
+            continue;
+        }
+
+        const Budget *budget = find_budget(frame->name);
+        sim_ssd1306_diff_t diff = {0};
+        char result[96] = "ok";
+        if (!sim_ssd1306_compare_pbm(&oled, path, &diff)) {
+            snprintf(result, sizeof(result), "FAIL (no reference image)");
+        } else if (diff.pixels > 0) {
+            snprintf(result, sizeof(result), "FAIL (%d pixels differ in x %d..%d, y %d..%d)",
+                     diff.pixels, diff.x0, diff.x1, diff.y0, diff.y1);
+        } else if (budget == NULL) {
+            snprintf(result, sizeof(result), "FAIL (no budget)");
+        } else if (bytes > budget->bytes) {
+            snprintf(result, sizeof(result), "FAIL (over byte budget)");
+        } else if (draws > budget->draws) {
+            snprintf(result, sizeof(result), "FAIL (over draw budget)");
+        }
+        bool failed = strcmp(result, "ok") != 0;
+        if (failed) failures++;
+        printf("%-16s %5lu/%-6lu %5lu/%-6lu  %s\n", frame->name,
+               (unsigned long)bytes, (unsigned long)(budget ? budget->bytes : 0),
+               (unsigned long)draws, (unsigned long)(budget ? budget->draws : 0), result);
+        if (failed && diff.pixels > 0) {
+            sim_ssd1306_print(&oled);
+        }
+    }
+    if (update) {
+        printf("};\n");
+        return 0;
+    }
+    if (failures > 0) {
+        printf("\n%d frame(s) failed\n", failures);
+        return 1;
+    }
+    return 0;
+}
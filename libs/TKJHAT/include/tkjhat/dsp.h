@@ -0,0 +1,157 @@
+/**
+ * @file tkjhat/dsp.h
+ * @brief Fixed-point signal processing kernels for sensor and audio streams.
+ *
+ * @details
+ * Block kernels over 16-bit samples (Q15 unless said otherwise). On cores with the
+ * Arm DSP extension (Cortex-M33 on the Pico 2) the kernels use the ACLE intrinsics
+ * (SMLAD/SMLALD, SMUAD, QADD16, SSAT). Elsewhere (Cortex-M0+ on the Pico, host
+ * builds) plain C versions with the same results are used. host/dsp_test.c checks
+ * both against the same references.
+ *
+ * The kernels do not depend on the Pico SDK, so they can be compiled for the host
+ * (see host/). Results are saturated to the int16 range.
+ */
+#ifndef TKJHAT_DSP_H
+#define TKJHAT_DSP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * @defgroup DSP Signal processing kernels
+ * @{
+ */
+
+/** @brief FIR filter state. Create with ::dsp_fir_q15_init(). */
+typedef struct {
+    const int16_t *coeffs;  ///< Q15 taps, h[0] applies to the newest sample
+    int16_t *state;         ///< delay line, 2 * taps samples
+    uint16_t taps;
+    uint16_t index;
+} dsp_fir_q15_t;
+
+/** @brief Second order IIR section (direct form I) with Q14 coefficients. */
+typedef struct {
+    int16_t b0, b1, b2;     ///< feed-forward coefficients
+    int16_t a1, a2;         ///< feedback coefficients, a0 is 1
+    int16_t x1, x2, y1, y2; ///< previous inputs and outputs
+} dsp_biquad_q14_t;
+
+/** @brief Moving average state. Create with ::dsp_moving_average_init(). */
+typedef struct {
+    int16_t *window;
+    uint16_t length;
+    uint16_t index;
+    int32_t sum;
+} dsp_moving_average_t;
+
+/**
+ * @brief Dot product of two blocks.
+ * @return Sum of a[i] * b[i] without scaling.
+ */
+int64_t dsp_dot_q15(const int16_t *a, const int16_t *b, size_t n);
+
+/**
+ * @brief Initialize a FIR filter.
+ *
+ * @param fir    Filter to initialize.
+ * @param coeffs Q15 coefficients, @p taps values. Not copied, must stay valid.
+ * @param state  Buffer of 2 * @p taps samples for the delay line.
+ * @param taps   Number of coefficients.
+ */
+void dsp_fir_q15_init(dsp_fir_q15_t *fir, const int16_t *coeffs, int16_t *state, uint16_t taps);
+
+/** @brief Filter @p n samples. @p in and @p out may be the same buffer. */
+void dsp_fir_q15(dsp_fir_q15_t *fir, const int16_t *in, int16_t *out, size_t n);
+
+/**
+ * @brief Initialize a biquad with given Q14 coefficients (1.0 = 16384).
+ *
+ * Computes y = b0*x + b1*x1 + b2*x2 - a1*y1 - a2*y2.
+ */
+void dsp_biquad_q14_init(dsp_biquad_q14_t *bq, int16_t b0, int16_t b1, int16_t b2, int16_t a1, int16_t a2);
+
+/**
+ * @brief Initialize a biquad as a 2nd order Butterworth low-pass.
+ *
+ * Uses floating point once, so call it at init time and not per sample.
+ *
+ * @param cutoff_hz      Cutoff frequency, limited to a quarter of the sample rate.
+ * @param sample_rate_hz Sample rate of the stream.
+ */
+void dsp_biquad_lowpass_q14(dsp_biquad_q14_t *bq, uint32_t cutoff_hz, uint32_t sample_rate_hz);
+
+/** @brief Filter @p n samples. @p in and @p out may be the same buffer. */
+void dsp_biquad_q14(dsp_biquad_q14_t *bq, const int16_t *in, int16_t *out, size_t n);
+
+/**
+ * @brief Initialize a moving average.
+ *
+ * @param window Buffer of @p length samples.
+ * @param length Number of samples averaged. Powers of two avoid a division.
+ */
+void dsp_moving_average_init(dsp_moving_average_t *ma, int16_t *window, uint16_t length);
+
+/** @brief Average @p n samples. @p in and @p out may be the same buffer. */
+void dsp_moving_average(dsp_moving_average_t *ma, const int16_t *in, int16_t *out, size_t n);
+
+/**
+ * @brief Euclidean length of 3-axis vectors.
+ *
+ * @param xyz Interleaved samples x0, y0, z0, x1, y1, z1...
+ * @param out Magnitudes, one per vector.
+ * @param n   Number of vectors.
+ */
+void dsp_magnitude3_q15(const int16_t *xyz, uint16_t *out, size_t n);
+
+/** @brief Saturating sum of two blocks. */
+void dsp_add_q15(const int16_t *a, const int16_t *b, int16_t *out, size_t n);
+
+/** @brief Root mean square of a block. */
+uint16_t dsp_rms_q15(const int16_t *x, size_t n);
+
+/** @brief Integer square root, rounded down. */
+uint32_t dsp_isqrt32(uint32_t x);
+
+/** @brief Result of one kernel in ::dsp_benchmark(). */
+typedef struct {
+    const char *name;
+    uint32_t samples;   ///< samples processed
+    uint32_t elapsed;   ///< counter ticks used
+} dsp_benchmark_result_t;
+
+/** @brief Number of results ::dsp_benchmark() produces. */
+#define DSP_BENCHMARK_COUNT 7
+
+/**
+ * @brief Run every kernel over a test block and measure the time.
+ *
+ * @param results Array of ::DSP_BENCHMARK_COUNT results.
+ * @param counter Free-running counter, e.g. ::dsp_cycle_counter() on the device.
+ */
+void dsp_benchmark(dsp_benchmark_result_t *results, uint32_t (*counter)(void));
+
+/**
+ * @brief Print benchmark results as ticks per sample.
+ *
+ * @param unit Name of the counter unit, e.g. "cycles".
+ */
+void dsp_benchmark_print(const dsp_benchmark_result_t *results, const char *unit);
+
+#ifndef TKJHAT_HOST
+/**
+ * @brief CPU cycles counted by SysTick.
+ *
+ * Starts SysTick at clk_sys over its full 24-bit range if it is not running and
+ * adds up its wraps, so calls must be less than 2^24 cycles (134 ms at 125 MHz)
+ * apart. Use it before vTaskStartScheduler(): FreeRTOS reprograms SysTick for its
+ * tick, after that calls must be less than one tick apart.
+ */
+uint32_t dsp_cycle_counter(void);
+#endif
+
+/** @} */ // end of group DSP
+
+#endif /* TKJHAT_DSP_H */
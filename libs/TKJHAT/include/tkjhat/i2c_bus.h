@@ -0,0 +1,267 @@
+/**
+ * @file tkjhat/i2c_bus.h
+ * @brief Asynchronous I²C transaction engine for @c i2c_default.
+ *
+ * @details
+ * Drivers describe a transfer with an ::i2c_transaction_t (write, read, or write
+ * followed by a repeated start and a read) and submit it to a queue. The engine
+ * feeds the I²C controller with DMA and finishes every transaction from the I²C
+ * interrupt, so the CPU is free while bytes are on the wire and the next queued
+ * transaction starts right after the previous STOP.
+ *
+ * A submitting task can block in ::i2c_bus_wait() (the task sleeps on a task
+ * notification) or continue and get a callback when the transaction is done.
+ * ::i2c_bus_transfer() does both for the common blocking case.
+ *
+ * Before the scheduler is started, or if no DMA channels are available, transfers
+ * fall back to the blocking Pico SDK functions with the same results.
+ *
+ * ### Arbitration
+ * Every device address is registered to a client class with
+ * ::i2c_bus_register_device(). Each class has its own queue and when the bus becomes
+ * free the oldest transaction of the most important class starts. The IMU goes
+ * first, the display last. Large display frames are sent as one transaction per
+ * page, so an IMU read waits at most for one page (~3 ms at 400 kHz) and not for a
+ * whole frame. The time every transaction waits in the queue is collected per class.
+ *
+ * ### Device profiles
+ * The registration also carries the bus profile of the device: SCL frequency,
+ * timeout and how many times a NACKed transaction is retried. The engine switches
+ * the clock between transactions when the next device needs a different speed,
+ * so Fast-mode Plus devices run at 1 MHz next to devices limited to 400 kHz.
+ */
+#ifndef TKJHAT_I2C_BUS_H
+#define TKJHAT_I2C_BUS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include <hardware/i2c.h>
+#include <FreeRTOS.h>
+#include <task.h>
+
+/**
+ * @defgroup I2CBus I²C transaction engine
+ * @{
+ */
+
+/** @brief Largest transfer (write + read bytes). One SSD1306 frame with the control byte fits. */
+#define I2C_BUS_MAX_TRANSFER        1040
+/** @brief Default timeout of ::i2c_bus_transfer(). A 1 KB frame takes ~25 ms at 400 kHz. */
+#define I2C_BUS_TIMEOUT_MS          100
+/** @brief Timeout argument of ::i2c_bus_wait() meaning "use the timeout of the device profile". */
+#define I2C_BUS_TIMEOUT_PROFILE     0
+
+/** @brief SCL frequency of unregistered devices (Fast-mode). */
+#define I2C_BUS_DEFAULT_BAUDRATE    (400 * 1000)
+/** @brief Fast-mode Plus, the fastest mode of the RP2040/RP2350 controller. */
+#define I2C_BUS_FAST_MODE_PLUS_BAUDRATE (1000 * 1000)
+
+/** @brief Task notification index used to wake up waiting tasks. */
+#ifndef I2C_BUS_NOTIFY_INDEX
+#define I2C_BUS_NOTIFY_INDEX        (configTASK_NOTIFICATION_ARRAY_ENTRIES - 1)
+#endif
+
+/** @brief Client classes in priority order, most important first. */
+typedef enum {
+    I2C_BUS_CLIENT_IMU,         ///< latency critical sensor sampling
+    I2C_BUS_CLIENT_SENSORS,     ///< environmental sensors
+    I2C_BUS_CLIENT_OTHER,       ///< unregistered addresses
+    I2C_BUS_CLIENT_DISPLAY,     ///< bulk frame transfers
+    I2C_BUS_CLIENT_COUNT
+} i2c_bus_client_t;
+
+/** @brief Number of addresses ::i2c_bus_register_device() can hold. */
+#define I2C_BUS_MAX_DEVICES         8
+
+/** @brief Bus settings of one device. Zero fields use the defaults. */
+typedef struct {
+    i2c_bus_client_t client;
+    uint32_t baudrate;                      ///< SCL frequency in Hz, 0 = ::I2C_BUS_DEFAULT_BAUDRATE
+    uint32_t timeout_ms;                    ///< 0 = ::I2C_BUS_TIMEOUT_MS
+    uint8_t retries;                        ///< extra attempts after a NACK
+} i2c_bus_profile_t;
+
+typedef enum {
+    I2C_TRANSACTION_IDLE,       ///< not submitted yet
+    I2C_TRANSACTION_QUEUED,
+    I2C_TRANSACTION_ACTIVE,
+    I2C_TRANSACTION_DONE,       ///< all bytes transferred
+    I2C_TRANSACTION_NACK,       ///< aborted by the controller, e.g. address not acknowledged
+    I2C_TRANSACTION_TIMEOUT,    ///< cancelled by ::i2c_bus_wait()
+} i2c_transaction_status_t;
+
+typedef struct i2c_transaction i2c_transaction_t;
+
+/**
+ * @brief Completion callback.
+ *
+ * Called from the I²C interrupt. Keep it short and use only FromISR FreeRTOS functions.
+ * The status of the transaction is already final. ::i2c_bus_wait() on the same
+ * descriptor returns only after the callback has returned, so a waiter may free
+ * the descriptor then.
+ */
+typedef void (*i2c_transaction_callback_t)(i2c_transaction_t *transaction);
+
+/**
+ * @brief One I²C transfer.
+ *
+ * Fill the first fields and submit. The descriptor and the buffers must stay valid
+ * until the transaction has finished.
+ */
+struct i2c_transaction {
+    uint8_t address;                        ///< 7-bit device address
+    uint8_t header[2];                      ///< written before @c tx, e.g. register address or control byte
+    uint8_t header_len;
+    const uint8_t *tx;                      ///< bytes to write, may be NULL when @c tx_len is 0
+    size_t tx_len;
+    uint8_t *rx;                            ///< read after the write (repeated start), may be NULL
+    size_t rx_len;
+    const uint16_t *encoded;                ///< optional, @c header and @c tx converted by ::i2c_bus_encode_write()
+    i2c_transaction_callback_t callback;    ///< optional
+    void *user;                             ///< free for the callback
+
+    /* Filled by the engine */
+    volatile i2c_transaction_status_t status;
+    i2c_bus_client_t client;                ///< class of the address
+    uint32_t timeout_ms;                    ///< from the device profile
+    uint8_t attempts;                       ///< retries done after a NACK
+    uint64_t submitted_us;
+    uint32_t abort_source;                  ///< IC_TX_ABRT_SOURCE when the status is NACK
+    TaskHandle_t waiter;
+    volatile bool completing;               ///< the callback is running, the descriptor is still in use
+    i2c_transaction_t *next;
+};
+
+/** @brief Queueing statistics of one client class. */
+typedef struct {
+    uint32_t transactions;
+    uint64_t wait_us;                       ///< total time spent in the queue
+    uint32_t max_wait_us;                   ///< longest time spent in the queue
+    uint64_t bus_us;                        ///< total time on the bus
+} i2c_bus_client_stats_t;
+
+/** @brief Counters of the engine since ::i2c_bus_init(). */
+typedef struct {
+    uint32_t transactions;
+    uint32_t errors;                        ///< NACK and timeouts
+    uint32_t retries;                       ///< NACKed transactions sent again
+    uint32_t bytes;
+    uint64_t busy_us;                       ///< time the bus was running transactions
+} i2c_bus_stats_t;
+
+/**
+ * @brief Start the engine on an initialized I²C instance.
+ *
+ * Called by ::init_i2c(). Claims two DMA channels and installs the I²C interrupt handler.
+ *
+ * @return 0 on success, negative if no DMA channels were free (blocking fallback is used).
+ */
+int i2c_bus_init(i2c_inst_t *i2c);
+
+/**
+ * @brief Queue a transaction and return immediately.
+ *
+ * The transaction goes to the queue of its client class (see ::i2c_bus_register_device()).
+ *
+ * @return 0 if queued, negative if the transaction is too long or empty.
+ */
+int i2c_bus_submit(i2c_transaction_t *transaction);
+
+/**
+ * @brief Block the calling task until a submitted transaction has finished.
+ *
+ * If the timeout expires the transaction is cancelled (removed from the queue or
+ * aborted on the bus) and its status is ::I2C_TRANSACTION_TIMEOUT. The timeout
+ * covers the retries as well. Pass ::I2C_BUS_TIMEOUT_PROFILE to use the timeout
+ * of the device profile.
+ *
+ * @return Bytes transferred, @c PICO_ERROR_GENERIC on NACK, @c PICO_ERROR_TIMEOUT on timeout.
+ */
+int i2c_bus_wait(i2c_transaction_t *transaction, uint32_t timeout_ms);
+
+/**
+ * @brief Convert a write to the command words of the controller.
+ *
+ * The engine normally converts @c header and @c tx when the transaction starts,
+ * inside the I²C interrupt. A driver sending large writes can do it in task
+ * context instead and set ::i2c_transaction_t::encoded to @p words: the DMA then
+ * feeds the controller straight from @p words and the interrupt only starts the
+ * channel. @c header and @c tx are not read, but @c header_len and @c tx_len
+ * must still give the number of bytes. Only for writes (@c rx_len 0).
+ *
+ * @param words      Output, @p header_len + @p tx_len words. Must stay valid until the transaction has finished.
+ * @param header     Bytes written first, may be NULL when @p header_len is 0.
+ * @param header_len Number of header bytes.
+ * @param tx         Bytes written after the header.
+ * @param tx_len     Number of bytes in @p tx.
+ * @return Number of words written.
+ */
+size_t i2c_bus_encode_write(uint16_t *words, const uint8_t *header, size_t header_len,
+                            const uint8_t *tx, size_t tx_len);
+
+/**
+ * @brief Write and/or read, blocking the calling task until done.
+ *
+ * With both @p tx_len and @p rx_len the bytes are written, followed by a repeated
+ * start and the read. Works also before the scheduler is started. The device
+ * profile gives the speed, timeout and retries.
+ *
+ * @return Bytes written and read (@p tx_len + @p rx_len), @c PICO_ERROR_GENERIC on NACK,
+ *         @c PICO_ERROR_TIMEOUT on timeout.
+ */
+int i2c_bus_transfer(uint8_t address, const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len);
+
+/**
+ * @brief Take the bus for direct use of the Pico SDK blocking functions.
+ *
+ * Waits until the engine is idle, at most ::I2C_BUS_TIMEOUT_MS, and keeps it
+ * stopped until ::i2c_bus_release().
+ * The bus runs at the speed of the profile of @p address.
+ * Used by ::i2c_write() / ::i2c_read() for transfers without a STOP.
+ *
+ * @return 1 if this call took the bus, 0 if the calling task already had it
+ *         (e.g. a read after a write without STOP) or the engine is not
+ *         initialized, @c PICO_ERROR_TIMEOUT if another task did not give it
+ *         back in time. A helper that takes the bus for itself releases it only
+ *         when it was taken by its own call.
+ */
+int i2c_bus_acquire(uint8_t address);
+
+/** @brief Give the bus back to the engine. */
+void i2c_bus_release(void);
+
+/**
+ * @brief Register the client class and bus profile of a device address.
+ *
+ * Registering an address again replaces its profile, the new speed is used from
+ * the next transaction on. Unregistered addresses use ::I2C_BUS_CLIENT_OTHER at
+ * ::I2C_BUS_DEFAULT_BAUDRATE without retries.
+ *
+ * @note Check the pull-ups before using Fast-mode Plus, the rise time must stay
+ *       below 120 ns.
+ *
+ * @return 0 on success, negative if the table is full.
+ */
+int i2c_bus_register_device(uint8_t address, const i2c_bus_profile_t *profile);
+
+/**
+ * @brief Copy the profile of a device address.
+ *
+ * @return 0 if the address is registered, negative if @p profile got the defaults.
+ */
+int i2c_bus_get_profile(uint8_t address, i2c_bus_profile_t *profile);
+
+/** @brief Copy the engine counters. */
+void i2c_bus_get_stats(i2c_bus_stats_t *stats);
+
+/** @brief Copy the queueing statistics of one client class. */
+void i2c_bus_get_client_stats(i2c_bus_client_t client, i2c_bus_client_stats_t *stats);
+
+/** @brief Clear the engine and client counters. */
+void i2c_bus_reset_stats(void);
+
+/** @} */ // end of group I2CBus
+
+#endif /* TKJHAT_I2C_BUS_H */
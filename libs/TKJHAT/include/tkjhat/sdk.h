@@ -111,6 +111,7 @@ SOFTWARE.
 
 #include "pdm_microphone.h"   // pdm_samples_ready_handler_t
 #include "pins.h"
+#include "sprites.h"          // sprite_id_t
 
 
 
@@ -141,6 +142,29 @@ SOFTWARE.
  * ========================= */
 
  #define SSD1306_I2C_ADDRESS                    0x3C
+// SCL frequency of the display. The controller is specified for 400 kHz. Modules
+// that run reliably faster can opt in to Fast-mode Plus with
+// -DSSD1306_I2C_BAUDRATE=I2C_BUS_FAST_MODE_PLUS_BAUDRATE.
+#ifndef SSD1306_I2C_BAUDRATE
+#define SSD1306_I2C_BAUDRATE                    I2C_BUS_DEFAULT_BAUDRATE
+#endif
+// Time write_text() and write_text_xy() keep the text on screen before the next
+// drawing command is drawn
+#ifndef DISPLAY_TEXT_DWELL_MS
+#define DISPLAY_TEXT_DWELL_MS                   800
+#endif
+#define DISPLAY_TEXT_MAX_LENGTH                 21      // characters of one text command, one line at scale 1
+#define TEXT_LAYOUT_MAX_LENGTH                  256     // characters of the text of a text_layout_t
+#define TEXT_LAYOUT_MAX_LINES                   64
+#define DISPLAY_SERVICE_QUEUE_LENGTH            16
+#define BUZZER_SEQUENCE_QUEUE_LENGTH            4       // sequences waiting behind the one playing
+#define BUZZER_SYNTH_RATE_HZ                    16000   // samples per second of the sine wave
+#define BUZZER_SYNTH_BLOCK                      32      // samples per DMA block, 2 ms at 16 kHz
+#define BUZZER_SYNTH_CARRIER_WRAP               255     // 8-bit samples, 488 kHz carrier at 125 MHz
+#define DISPLAY_SERVICE_STACK_SIZE              1024
+#define DISPLAY_FRAME_SUBMIT_TIMEOUT_MS         1000    // a command of an open frame waits this long for room in the queue
+#define DISPLAY_FRAME_TIMEOUT_MS                1000    // an open frame without commands for this long is shown as it is
+#define DISPLAY_SERVICE_MAX_FPS_DEFAULT         30
 
  /* =========================
  *  MEMS MICROPHONE
@@ -148,12 +172,20 @@ SOFTWARE.
 
 # define MEMS_SAMPLING_FREQUENCY                8000
 # define MEMS_BUFFER_SIZE                       256
+#ifndef MEMS_LOWPASS_DEFAULT_HZ
+# define MEMS_LOWPASS_DEFAULT_HZ                0       // low-pass of get_microphone_samples() after init, 0 = off
+#endif
 
 /* =========================
  *  ICM42670
  * ========================= */
 #define ICM42670_I2C_ADDRESS                    0x69
 #define ICM42670_I2C_ADDRESS_ALT                0x69
+// Fast-mode Plus (I2C_BUS_FAST_MODE_PLUS_BAUDRATE) is opt-in like SSD1306_I2C_BAUDRATE:
+// it needs strong enough pull-ups on the bus
+#ifndef ICM42670_I2C_BAUDRATE
+#define ICM42670_I2C_BAUDRATE                   I2C_BUS_DEFAULT_BAUDRATE
+#endif
 #define ICM42670_REG_WHO_AM_I                   0x75
 #define ICM42670_WHO_AM_I_RESPONSE              0x67
 #define ICM42670_INT_CONFIG                     0x06
@@ -208,6 +240,27 @@ SOFTWARE.
 #define ICM42670_GYRO_MODE_LN                   0x0C
 #define ICM42670_SENSOR_DATA_START_REG          0x09
 
+// Wake-on-motion (WOM) and interrupt routing
+#define ICM42670_WOM_CONFIG_REG                 0x27
+#define ICM42670_INT_SOURCE1_REG                0x2C
+#define ICM42670_INT_STATUS2_REG                0x3B
+#define ICM42670_WOM_EN                         0x01
+#define ICM42670_WOM_MODE_PREVIOUS              0x02    // compare with previous sample
+#define ICM42670_INT_SOURCE1_WOM_XYZ            0x07
+#define ICM42670_WOM_THRESHOLD_DEFAULT_MG       50
+#define ICM42670_WOM_ODR_HZ                     50
+
+// Indirect access to the MREG1 register bank
+#define ICM42670_BLK_SEL_W_REG                  0x79
+#define ICM42670_MADDR_W_REG                    0x7A
+#define ICM42670_M_W_REG                        0x7B
+#define ICM42670_MREG1_ACCEL_WOM_X_THR          0x4B
+#define ICM42670_MREG1_ACCEL_WOM_Y_THR          0x4C
+#define ICM42670_MREG1_ACCEL_WOM_Z_THR          0x4D
+
+#define ICM42670_POWER_IDLE_TIMEOUT_DEFAULT_MS  10000
+#define ICM42670_POWER_RETRY_MS                 5000    // wait after a failed demotion before the next try
+
 /* =========================
  *  Public function prototypes
  * ========================= */
@@ -384,41 +437,163 @@ void stop_rgb_led(void);
  *  BUZZER
  * ========================= */
 
+/**
+ * @brief What a note of a buzzer sequence does with the red LED when it starts.
+ */
+typedef enum {
+    BUZZER_LED_KEEP = 0,        ///< leave the LED as it is
+    BUZZER_LED_ON,              ///< turn the LED on
+    BUZZER_LED_OFF,             ///< turn the LED off
+    BUZZER_LED_KEYED,           ///< LED on while the tone sounds, off in the gap after it
+} buzzer_led_t;
+
+/**
+ * @brief One note of a buzzer sequence.
+ */
+typedef struct {
+    uint16_t frequency;         ///< tone in Hz, 0 for a rest
+    uint16_t duration_ms;       ///< length of the tone
+    uint16_t gap_ms;            ///< silence after the tone
+    uint8_t led;                ///< ::buzzer_led_t at the start of the note
+} buzzer_note_t;
+
+/**
+ * @brief Priority of the tones of ::buzzer_start_tone(), above every sequence.
+ */
+#define BUZZER_PRIORITY_TONE    255
+
+/**
+ * @brief How the buzzer makes its tones, see ::buzzer_set_waveform().
+ */
+typedef enum {
+    BUZZER_WAVE_SQUARE = 0,     ///< PWM at the tone frequency, no CPU time
+    BUZZER_WAVE_SINE,           ///< sine synthesized into an ultrasonic PWM carrier with DMA
+} buzzer_waveform_t;
+
+/**
+ * @brief Counters of the sine synthesis since ::buzzer_set_waveform().
+ */
+typedef struct {
+    uint32_t blocks;            ///< sample blocks computed
+    uint32_t busy_us;           ///< time spent computing them (in the DMA interrupt)
+    uint32_t elapsed_us;        ///< time since the synthesis started
+} buzzer_synth_stats_t;
+
 /**
  * @brief Initialize the buzzer (GPIO 17).
  *
- * Configures the buzzer pin as a digital output.  
- * After this call, the buzzer can be controlled with
- * ::buzzer_play_tone() or ::buzzer_turn_off().
+ * Connects the buzzer pin to its PWM slice and claims a hardware alarm
+ * that ends the tones. After this call, the buzzer can be controlled with
+ * ::buzzer_play_tone(), ::buzzer_start_tone() or ::buzzer_turn_off().
  */
 void init_buzzer(void);
 
+/**
+ * @brief Start a tone on the buzzer and return.
+ *
+ * The PWM slice of the buzzer generates the square wave and a hardware
+ * alarm silences it after @p duration_ms, so the tone costs a few register
+ * writes and no CPU time while it plays. A new tone replaces the one playing
+ * and preempts a sequence of ::buzzer_play_sequence(), queued sequences play
+ * after the tone.
+ *
+ * @param frequency     Tone frequency in Hz (8 Hz - 65535 Hz, with sine waves
+ *                      below ::BUZZER_SYNTH_RATE_HZ / 2).
+ * @param duration_ms   Duration of the tone in milliseconds (up to 65535).
+ * @return 0, or @c PICO_ERROR_GENERIC if the frequency or duration is
+ *         out of range or no hardware alarm was free at ::init_buzzer().
+ */
+int buzzer_start_tone(uint32_t frequency, uint32_t duration_ms);
+
+/**
+ * @brief Play a sequence of notes in the background.
+ *
+ * The hardware alarm of the buzzer moves from note to gap to note in its
+ * interrupt, so the call returns at once and the sequence costs no CPU time
+ * while it plays. Every note and gap starts where the one before it
+ * was due to end, so the rhythm does not drift with the interrupt latency or
+ * with task scheduling. If nothing plays or @p priority is higher than the priority
+ * of the sequence playing, the sequence starts right away and the one playing
+ * is dropped. Otherwise it is queued and starts when the ones before it end.
+ * Tones of ::buzzer_start_tone() preempt every sequence.
+ *
+ * @code
+ * static const buzzer_note_t jingle[] = {
+ *     {200, 100, 0, BUZZER_LED_ON}, {400, 100, 0, BUZZER_LED_KEEP}, {700, 200, 0, BUZZER_LED_OFF},
+ * };
+ * buzzer_play_sequence(jingle, 3, 1);
+ * @endcode
+ *
+ * @param notes    Notes, must stay valid until the sequence has ended (e.g. static const).
+ * @param count    Number of notes.
+ * @param priority 0-254, higher preempts lower.
+ * @return 0, or @c PICO_ERROR_GENERIC if the queue is full or no hardware alarm
+ *         was free at ::init_buzzer().
+ */
+int buzzer_play_sequence(const buzzer_note_t *notes, size_t count, uint8_t priority);
+
+/**
+ * @brief Whether a tone or a sequence is playing.
+ */
+bool buzzer_is_playing(void);
+
 /**
  * @brief Play a tone on the buzzer.
  *
- * Generates a square wave at the requested frequency for the
- * specified duration by toggling the buzzer pin.
+ * Starts the tone like ::buzzer_start_tone() and returns when it has ended.
  *
  * @param frequency     Tone frequency in Hz.
  * @param duration_ms   Duration of the tone in milliseconds.
  *
- * @note This implementation is blocking: the CPU is kept busy
- *       toggling the pin for the entire duration.
+ * @note The caller sleeps for the duration of the tone (@c sleep_ms(), which
+ *       blocks only the calling task under FreeRTOS), the CPU is not busy.
  */
 void buzzer_play_tone(uint32_t frequency, uint32_t duration_ms);
 
 /**
  * @brief Turn the buzzer off.
  *
- * Drives the buzzer pin low, silencing any ongoing tone.
+ * Sets the PWM level of the buzzer pin to 0, silencing any ongoing tone,
+ * and cancels the sequence playing and the queued ones.
  */
 void buzzer_turn_off(void);
 
+/**
+ * @brief Choose between square waves and synthesized sine waves.
+ *
+ * With ::BUZZER_WAVE_SINE the PWM slice of the buzzer runs at an ultrasonic
+ * carrier (wrap ::BUZZER_SYNTH_CARRIER_WRAP, clk_sys / 256) that the buzzer
+ * cannot follow, and two chained DMA channels paced by a DMA timer write a new
+ * duty cycle ::BUZZER_SYNTH_RATE_HZ times a second. The samples come from a
+ * phase accumulator and a sine table, computed ::BUZZER_SYNTH_BLOCK at a time
+ * in the DMA interrupt. Every tone fades in over @p attack_ms and out over
+ * @p release_ms, so tones and sequences start and end without clicks. Tones,
+ * sequences and the alarm timing stay the same; a release runs into the gap
+ * after the note.
+ *
+ * The synthesis costs well under 1 % of one core at 16 kHz, see
+ * ::buzzer_get_synth_stats(). Anything playing is stopped.
+ *
+ * @param waveform   ::BUZZER_WAVE_SQUARE or ::BUZZER_WAVE_SINE.
+ * @param attack_ms  Fade-in time of a tone, 0 for none.
+ * @param release_ms Fade-out time of a tone, 0 for none.
+ * @return 0, or @c PICO_ERROR_GENERIC if no DMA channels or DMA timer were free
+ *         (the buzzer then stays on square waves).
+ */
+int buzzer_set_waveform(buzzer_waveform_t waveform, uint16_t attack_ms, uint16_t release_ms);
+
+/**
+ * @brief Read the counters of the sine synthesis.
+ *
+ * @c busy_us / @c elapsed_us is the share of the core it uses.
+ */
+void buzzer_get_synth_stats(buzzer_synth_stats_t *stats);
+
 /**
  * @brief Deinitialize the buzzer.
  *
- * Releases the buzzer pin (GPIO 17) so it can be reused for
- * other purposes.
+ * Stops the sine synthesis and the PWM slice, releases the hardware alarm and the buzzer pin
+ * (GPIO 17) so they can be reused for other purposes.
  */
 void deinit_buzzer(void);
 
@@ -482,6 +657,9 @@ void pdm_microphone_set_callback(pdm_samples_ready_handler_t handler);
  * @brief Retrieve PCM samples from the microphone buffer.
  *
  * Copies up to @p samples 16-bit values into the provided buffer.
+ * The samples are returned as the PDM conversion gives them. A 2nd order
+ * low-pass of the DSP kernels can be turned on with ::set_microphone_lowpass()
+ * to remove the high-frequency noise the conversion leaves above the audio band.
  *
  * @param buffer  Destination buffer for PCM samples.
  * @param samples Number of samples to read.
@@ -491,6 +669,29 @@ void pdm_microphone_set_callback(pdm_samples_ready_handler_t handler);
  */
 int get_microphone_samples(int16_t *buffer, size_t samples);
 
+/**
+ * @brief Set the low-pass filter of ::get_microphone_samples().
+ *
+ * The filter is off unless the caller turns it on: ::init_pdm_microphone() sets it
+ * to ::MEMS_LOWPASS_DEFAULT_HZ, which is 0 unless defined at build time. Call this
+ * after ::init_pdm_microphone(), e.g. with 2000 for speech.
+ *
+ * @param cutoff_hz Cutoff frequency, limited to a quarter of ::MEMS_SAMPLING_FREQUENCY.
+ *                  0 turns the filter off.
+ */
+void set_microphone_lowpass(uint32_t cutoff_hz);
+
+/**
+ * @brief Compute the sound level of a block of PCM samples.
+ *
+ * Root mean square of the samples, computed with the DSP kernels (see tkjhat/dsp.h).
+ *
+ * @param buffer  PCM samples, e.g. from ::get_microphone_samples().
+ * @param samples Number of samples in @p buffer.
+ * @return RMS level in the same units as the samples (0..32767).
+ */
+uint16_t get_microphone_level(const int16_t *buffer, size_t samples);
+
 
 
 /**
@@ -499,6 +700,12 @@ int get_microphone_samples(int16_t *buffer, size_t samples);
  * Configures @c i2c_default for Fast-mode (400 kHz), sets @p sda_pin and
  * @p scl_pin to I²C function, and enables pull-ups on both lines.
  *
+ * Starts the I²C transaction engine and registers the bus profiles of the HAT
+ * devices: the ICM-42670 at @ref ICM42670_I2C_BAUDRATE, the SSD1306 at
+ * @ref SSD1306_I2C_BAUDRATE (both 400 kHz unless Fast-mode Plus is defined at
+ * build time), VEML6030 and HDC2021 at 400 kHz with retries. The speed is
+ * switched between transactions.
+ *
  * @param sda_pin GPIO to use for SDA (e.g., @ref DEFAULT_I2C_SDA_PIN).
  * @param scl_pin GPIO to use for SCL (e.g., @ref DEFAULT_I2C_SCL_PIN).
  */
@@ -546,6 +753,9 @@ void init_i2c_default(void);
  *               condition (repeated start).
  *
  * @return @c true if all bytes were written, @c false otherwise.
+ *
+ * @note With @p nostop the calling task keeps the bus until its next transfer
+ *       that ends with a STOP. Prefer ::i2c_write_read() for register reads.
  */
 bool i2c_write(uint8_t addr, const uint8_t *src, size_t len, bool nostop);
 
@@ -579,6 +789,103 @@ bool i2c_write(uint8_t addr, const uint8_t *src, size_t len, bool nostop);
  */
 bool i2c_read(uint8_t addr, uint8_t *dst, size_t len, bool nostop);
 
+/**
+ * @brief Write to and then read from an I²C device in one transaction.
+ *
+ * Writes @p src_len bytes, sends a repeated start and reads @p dst_len bytes.
+ * The calling task sleeps while the transfer runs (see tkjhat/i2c_bus.h).
+ *
+ * @code
+ * // Example: read 2 bytes of temperature from HDC2021
+ * uint8_t reg = HDC2021_TEMP_LOW;
+ * uint8_t data[2];
+ * bool ok = i2c_write_read(HDC2021_I2C_ADDRESS, &reg, 1, data, 2);
+ * @endcode
+ *
+ * @param addr    7-bit I²C device address.
+ * @param src     Bytes to write, typically the register address.
+ * @param src_len Number of bytes to write.
+ * @param dst     Destination buffer.
+ * @param dst_len Number of bytes to read.
+ *
+ * @return @c true if all bytes were transferred, @c false otherwise.
+ */
+bool i2c_write_read(uint8_t addr, const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_len);
+
+/** @brief Result of one bus speed in ::i2c_benchmark(). */
+typedef struct {
+    uint32_t baudrate;          ///< SCL frequency in Hz
+    uint32_t frame_us;          ///< one full SSD1306 frame (::ssd1306_show)
+    uint32_t frame_cpu_us;      ///< CPU time of the frame: preparing it in ::ssd1306_show_start, the rest is DMA
+    uint32_t update_us;         ///< one UI update: display cleared and a short text drawn
+    uint32_t update_bytes;      ///< bytes sent to the display per UI update
+    uint32_t imu_burst_us;      ///< one ICM-42670 sensor data burst (14 bytes)
+    uint32_t errors;            ///< failed transactions during the run
+} i2c_benchmark_result_t;
+
+/**
+ * @brief Measure the display frame time and the IMU burst time at several bus speeds.
+ *
+ * For every speed the ICM-42670 and SSD1306 profiles are switched to it, the current
+ * display buffer is sent a few times, a few UI updates are drawn (only the changed
+ * parts are sent) and the IMU data registers are read in a loop. The original
+ * profiles and the display contents are restored at the end.
+ *
+ * @code
+ * const uint32_t speeds[] = {100000, 400000, 1000000};
+ * i2c_benchmark_result_t results[3];
+ * if (i2c_benchmark(speeds, 3, results) == 0) i2c_benchmark_print(results, 3);
+ * @endcode
+ *
+ * @pre ::init_display() and ::init_ICM42670() have been called, the display
+ *      service is not running.
+ *
+ * @param baudrates SCL frequencies to test in Hz.
+ * @param count     Number of entries in @p baudrates and @p results.
+ * @param results   Filled with one result per speed.
+ * @return 0 on success, negative if the display is not available or out of memory.
+ */
+int i2c_benchmark(const uint32_t *baudrates, size_t count, i2c_benchmark_result_t *results);
+
+/** @brief Print the results of ::i2c_benchmark() as a table. */
+void i2c_benchmark_print(const i2c_benchmark_result_t *results, size_t count);
+
+/** @brief Result of one line type in ::draw_benchmark(). */
+typedef struct {
+    const char *name;
+    uint32_t pixels;            ///< pixels drawn
+    uint32_t elapsed;           ///< counter ticks used
+} draw_benchmark_result_t;
+
+/** @brief Number of results ::draw_benchmark() produces. */
+#define DRAW_BENCHMARK_COUNT 5
+
+/**
+ * @brief Measure the line drawing speed of the display buffer.
+ *
+ * Draws horizontal, vertical, shallow, steep and reversed (right to left) lines
+ * into the framebuffer with ::ssd1306_draw_line. Nothing is sent to the display,
+ * the buffer contents are restored at the end.
+ *
+ * @code
+ * draw_benchmark_result_t results[DRAW_BENCHMARK_COUNT];
+ * if (draw_benchmark(results, time_us_32) == 0) draw_benchmark_print(results, 1000000);
+ * @endcode
+ *
+ * @pre ::init_display() has been called, the display service is not running.
+ *
+ * @param results Array of ::DRAW_BENCHMARK_COUNT results.
+ * @param counter Free running counter, e.g. time_us_32 or a cycle counter.
+ * @return 0 on success, negative if the display is not available or out of memory.
+ */
+int draw_benchmark(draw_benchmark_result_t *results, uint32_t (*counter)(void));
+
+/**
+ * @brief Print the results of ::draw_benchmark() as pixels per second.
+ * @param ticks_per_second Frequency of the counter given to ::draw_benchmark().
+ */
+void draw_benchmark_print(const draw_benchmark_result_t *results, uint32_t ticks_per_second);
+
 
 /* =========================
  *  DISPLAY SSD1306
@@ -592,6 +899,13 @@ bool i2c_read(uint8_t addr, uint8_t *dst, size_t len, bool nostop);
  *
  * Uses the bundled pico-ssd1306 library to draw text and simple shapes.
  *
+ * Without the display service every call draws and updates the panel before it
+ * returns, and the text functions wait ::DISPLAY_TEXT_DWELL_MS after drawing.
+ * After ::display_service_start() the calls only queue a command and return
+ * immediately: the display task owns the frame buffer, draws the commands in
+ * order, updates the panel at a limited frame rate and keeps texts on screen for
+ * the dwell time on its own.
+ *
  * @see https://github.com/daschr/pico-ssd1306
  * @see SSD1306 datasheet: https://cdn-shop.adafruit.com/datasheets/SSD1306.pdf
  * @{
@@ -609,15 +923,109 @@ bool i2c_read(uint8_t addr, uint8_t *dst, size_t len, bool nostop);
  */
 void init_display(void);
 
+/** @brief Counters of the display API, with or without the display service. */
+typedef struct {
+    uint32_t commands;          ///< drawing commands done
+    uint32_t frames;            ///< panel updates
+    uint32_t dropped;           ///< commands lost because the queue was full
+    uint32_t frame_timeouts;    ///< open frames shown after ::DISPLAY_FRAME_TIMEOUT_MS without their end
+    uint32_t dwell_skipped;     ///< dwell times cut short because commands were piling up
+    uint32_t draws;             ///< calls of the SSD1306 drawing functions (a text counts its characters)
+    uint32_t bytes;             ///< bytes sent to the display
+} display_service_stats_t;
+
+/**
+ * @brief Start the display task, the drawing functions do not block after this.
+ *
+ * Commands that arrive within one frame period are drawn into the same frame. A
+ * text is shown for ::DISPLAY_TEXT_DWELL_MS before the following commands are
+ * drawn, unless half of the queue is full; then the display catches up. When the
+ * queue is full new commands are dropped and counted. Frame begins and ends, and
+ * the commands between them, wait up to ::DISPLAY_FRAME_SUBMIT_TIMEOUT_MS for room
+ * instead, so a frame is not left open by a lost end.
+ *
+ * @pre ::init_display() has been called. The task starts running with the scheduler.
+ *
+ * @param priority FreeRTOS priority of the display task.
+ * @param max_fps  Frame rate limit, 0 = ::DISPLAY_SERVICE_MAX_FPS_DEFAULT.
+ * @return 0 on success (also if already running), -1 if the display is not
+ *         initialized, -2 if the queue or the task could not be created.
+ */
+int display_service_start(uint32_t priority, uint32_t max_fps);
+
+/** @brief Copy the counters of the display API, also valid without the display service. */
+void display_service_get_stats(display_service_stats_t *stats);
+
+/**
+ * @brief Start a frame: the following drawing calls are shown together.
+ *
+ * Until the matching ::display_frame_end() the calls only draw into the display
+ * buffer and the panel keeps the previous frame; then the whole frame is sent
+ * at once. Texts
+ * drawn in the frame stay on screen for their dwell time after it is shown.
+ * Frames nest, frames of several tasks end when the last one is closed. A frame
+ * that gets no commands for ::DISPLAY_FRAME_TIMEOUT_MS is shown as it is, so a
+ * lost or forgotten end does not freeze the display.
+ *
+ * @code
+ * display_frame_begin();
+ * clear_display();
+ * draw_line(30, 30, 50, 45);
+ * draw_line(50, 45, 80, 10);
+ * display_frame_end();
+ * @endcode
+ */
+void display_frame_begin(void);
+
+/** @brief End a frame started with ::display_frame_begin() and show it. */
+void display_frame_end(void);
+
+/**
+ * @brief Scroll a text from right to left over the display.
+ *
+ * The text is rendered once into an off-screen strip. The display task copies the
+ * visible window into the frame buffer once per frame, so the text moves smoothly
+ * at the frame rate and only the changed bytes of the text rows are sent. The text
+ * starts at the left edge and scrolls until it has left the display. Other
+ * drawing in the text rows is overwritten, ::clear_display() stops the ticker.
+ * Without the display service the ticker moves when ::display_ticker_position()
+ * is called.
+ *
+ * @code
+ * display_ticker_start(message, 24, 2, 40);
+ * while (display_ticker_position() >= 0) vTaskDelay(pdMS_TO_TICKS(20));
+ * @endcode
+ *
+ * @param text  Null-terminated C string, any length.
+ * @param y     Top row, rounded down to a multiple of 8.
+ * @param scale Font scale 1 to 4, the text is 8 * @p scale rows high.
+ * @param speed Pixels per second.
+ * @return 0 on success, -1 if the display is not initialized or an argument is
+ *         invalid, -2 if out of memory or the queue is full.
+ */
+int display_ticker_start(const char *text, int16_t y, uint8_t scale, uint16_t speed);
+
+/** @brief Stop the ticker, the text stays where it is. */
+void display_ticker_stop(void);
+
+/**
+ * @brief Index of the character at the left edge of the display.
+ * @return 0 right after ::display_ticker_start(), -1 when the ticker has
+ *         finished or was stopped.
+ */
+int32_t display_ticker_position(void);
+
 /**
  * @brief Write a text string centered-ish on the display.
  *
  * Draws @p text at a predefined position with a larger font scale (2),
  * then updates the panel.
  *
- * @param text Null-terminated C string. Ignored if @c NULL.
+ * @param text Null-terminated C string. Ignored if @c NULL. Cut to
+ *             ::DISPLAY_TEXT_MAX_LENGTH characters.
  *
- * @note This helper calls @c ssd1306_show() internally.
+ * @note Without the display service this calls @c ssd1306_show() and waits
+ *       ::DISPLAY_TEXT_DWELL_MS.
  * @see write_text_xy()
  */
 void write_text(const char *text);
@@ -632,9 +1040,11 @@ void write_text(const char *text);
  *
  * @param x0  Start X in pixels (values < 0 are clamped to 0).
  * @param y0  Start Y in pixels (values < 0 are clamped to 0).
- * @param text Null-terminated C string. Ignored if @c NULL.
+ * @param text Null-terminated C string. Ignored if @c NULL. Cut to
+ *             ::DISPLAY_TEXT_MAX_LENGTH characters.
  *
- * @note Calls @c ssd1306_show() internally.
+ * @note Without the display service this calls @c ssd1306_show() and waits
+ *       ::DISPLAY_TEXT_DWELL_MS.
  */
 void write_text_xy(int16_t x0, int16_t y0, const char *text);
 
@@ -651,6 +1061,70 @@ void write_text_xy(int16_t x0, int16_t y0, const char *text);
  */
 void set_text_cursor (int16_t x0, int16_t y0);
 
+/**
+ * @brief One line of a ::text_layout_t.
+ */
+typedef struct {
+    uint16_t start;             ///< index of the first character in the text
+    uint8_t length;             ///< characters on the line, the space or newline at the break not included
+} text_line_t;
+
+/**
+ * @brief Text wrapped to the lines and screens of the display.
+ *
+ * Keeps a copy of the text and the lines it was broken into. When the text is
+ * laid out again, only the lines from the first change on are measured again,
+ * so growing a message one character at a time stays cheap.
+ */
+typedef struct {
+    char text[TEXT_LAYOUT_MAX_LENGTH + 1];      ///< copy of the laid out text
+    uint16_t length;                            ///< characters in text
+    uint8_t scale;                              ///< font scale
+    uint8_t columns;                            ///< characters per line
+    uint8_t rows;                               ///< lines per screen
+    uint16_t line_count;                        ///< lines in lines
+    text_line_t lines[TEXT_LAYOUT_MAX_LINES];   ///< the lines, longer text is cut
+} text_layout_t;
+
+/**
+ * @brief Start an empty layout for the whole display.
+ *
+ * @param layout Layout to initialize.
+ * @param scale  Font scale 1-3, scale 1 gives 8 lines of 21 characters.
+ */
+void text_layout_init(text_layout_t *layout, uint8_t scale);
+
+/**
+ * @brief Lay out @p text, reusing the lines of the previous text up to the first change.
+ *
+ * Lines break at spaces, words longer than a line are broken at the line end and
+ * a newline starts a new line. Text beyond ::TEXT_LAYOUT_MAX_LENGTH characters or
+ * ::TEXT_LAYOUT_MAX_LINES lines is left out.
+ *
+ * @param layout Layout from text_layout_init().
+ * @param text   Null-terminated C string.
+ * @return Number of screens (pages of @c rows lines) the text needs.
+ */
+uint16_t text_layout_update(text_layout_t *layout, const char *text);
+
+/**
+ * @brief Number of screens of the laid out text.
+ */
+uint16_t text_layout_pages(const text_layout_t *layout);
+
+/**
+ * @brief Show one screen of a laid out text.
+ *
+ * Clears the display and draws the lines of the screen in one frame.
+ *
+ * @param layout Layout from text_layout_update().
+ * @param page   Screen, 0 .. text_layout_pages() - 1.
+ * @return Index of the first character of the screen in the text, or -1 if @p page does not exist.
+ *
+ * @note Without the display service the text stays on screen for ::DISPLAY_TEXT_DWELL_MS.
+ */
+int write_text_page(const text_layout_t *layout, uint16_t page);
+
 /**
  * @brief Draw a circle centered at (x0, y0).
  *
@@ -681,6 +1155,22 @@ void draw_circle(int16_t x0, int16_t y0, int16_t r, bool fill);
  */
 void draw_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1);
 
+/**
+ * @brief Draw a sprite of the atlas (tkjhat/sprites.h) with its top-left corner at (x, y).
+ *
+ * Sprites are stored in the layout of the frame buffer, so every page of the sprite
+ * is one copy. @p y is rounded down to a multiple of 8 and the whole box of the
+ * sprite is overwritten, dark pixels included. A sprite beyond the right or bottom
+ * edge is cut off.
+ *
+ * @param id Sprite, e.g. ::SPRITE_CHECKMARK.
+ * @param x  Top-left X.
+ * @param y  Top-left Y, a multiple of 8.
+ *
+ * @note Calls @c ssd1306_show() internally.
+ */
+void draw_sprite(sprite_id_t id, int16_t x, int16_t y);
+
 /**
  * @brief Draw a rectangle at (x, y) with width @p w and height @p h.
  *
@@ -902,7 +1392,11 @@ float hdc2021_read_humidity(void);
  *
  * ### Modes
  * - This SDK supports **Low-Noise (LN) mode** (higher precision, higher power).
- * - Other modes (LP/ULP/hybrid) are not yet implemented in this SDK.
+ * - Accelerometer-only **Low-Power (LP)** mode with wake-on-motion, see
+ *   ::ICM42670_enable_wake_on_motion().
+ * - A small power state manager (::ICM42670_power_manager_init()) switches
+ *   between LN accel+gyro while the device is used and LP accel with
+ *   wake-on-motion while it is idle.
  *
  * @see Datasheet: https://invensense.tdk.com/wp-content/uploads/2021/07/DS-000451-ICM-42670-P-v1.0.pdf
  * @{
@@ -989,6 +1483,150 @@ int ICM42670_read_sensor_data(float *ax, float *ay, float *az,
                               float *gx, float *gy, float *gz,
                               float *t);
 
+/**
+ * @brief Read raw accelerometer, gyroscope, and temperature data.
+ *
+ * Same burst read as ::ICM42670_read_sensor_data(), but the values are
+ * returned as signed 16-bit sensor counts without float conversion. Useful
+ * for high-rate sampling loops and integer-only processing.
+ *
+ * Scale factors for the SDK defaults:
+ * - Acceleration: 8192 LSB/g (±4 g)
+ * - Angular rate: 131 LSB/dps (±250 dps)
+ * - Temperature:  °C = t / 128 + 25
+ *
+ * @param accel Array of 3 values to store accel X, Y, Z (raw counts).
+ * @param gyro  Array of 3 values to store gyro X, Y, Z (raw counts).
+ * @param t     Pointer to store temperature (raw counts).
+ *
+ * @return 0 on success, negative value on error.
+ */
+int ICM42670_read_sensor_data_raw(int16_t accel[3], int16_t gyro[3], int16_t *t);
+
+/**
+ * @brief Low-power mode: accelerometer in LP mode, gyroscope off.
+ *
+ * @return 0 on success, negative value on error.
+ */
+int ICM42670_enable_ultra_low_power_mode(void);
+
+/**
+ * @brief Put both accelerometer and gyroscope in low-power mode.
+ *
+ * @return 0 on success, negative value on error.
+ *
+ * @note The gyroscope is noticeably noisier in this mode.
+ */
+int ICM42670_enable_accel_gyro_lp_mode(void);
+
+/**
+ * @brief Enable wake-on-motion (WOM) with the accelerometer in LP mode.
+ *
+ * Turns the gyroscope off, runs the accelerometer in LP mode at
+ * @ref ICM42670_WOM_ODR_HZ and raises INT1 (GPIO @ref ICM42670_INT, active-low pulse)
+ * when the acceleration of any axis changes more than @p threshold_mg
+ * between two samples. INT1 is left at its reset configuration (open-drain), so
+ * the GPIO needs a pull-up.
+ *
+ * @param threshold_mg Motion threshold in milli-g (4–1000, 1 LSB = 3.9 mg).
+ *
+ * @return 0 on success, negative value on error.
+ *
+ * @note The accelerometer ODR is changed. Call ::ICM42670_disable_wake_on_motion()
+ *       and ::ICM42670_startAccel() to go back to normal sampling.
+ */
+int ICM42670_enable_wake_on_motion(uint16_t threshold_mg);
+
+/**
+ * @brief Disable wake-on-motion and the WOM interrupt on INT1.
+ *
+ * @return 0 on success, negative value on error.
+ */
+int ICM42670_disable_wake_on_motion(void);
+
+/**
+ * @brief Read and clear the wake-on-motion interrupt status.
+ *
+ * @param status Pointer to store INT_STATUS2 (bit 0..2 = WOM X, Y, Z).
+ *
+ * @return 0 on success, negative value on error.
+ */
+int ICM42670_read_wom_status(uint8_t *status);
+
+/**
+ * @brief Power states handled by the IMU power state manager.
+ */
+typedef enum {
+    ICM42670_POWER_ACTIVE = 0,  /**< Accel + gyro in LN mode, full sampling. */
+    ICM42670_POWER_IDLE,        /**< Accel in LP mode with wake-on-motion, gyro off. */
+    ICM42670_POWER_STATE_COUNT
+} ICM42670_power_state_t;
+
+/**
+ * @brief Measured residency of the IMU power state manager.
+ */
+typedef struct {
+    ICM42670_power_state_t state;                           /**< Current state. */
+    uint64_t residency_us[ICM42670_POWER_STATE_COUNT];      /**< Time spent in each state, current state included. */
+    uint32_t promotions;                                    /**< IDLE -> ACTIVE transitions. */
+    uint32_t demotions;                                     /**< ACTIVE -> IDLE transitions. */
+    uint32_t failed_demotions;                              /**< Demotions undone because a register write failed. */
+} ICM42670_power_stats_t;
+
+/**
+ * @brief Start the IMU power state manager.
+ *
+ * The IMU starts in ::ICM42670_POWER_ACTIVE. When ::ICM42670_power_wake()
+ * has not been called for @p idle_timeout_ms, ::ICM42670_power_update()
+ * demotes it to ::ICM42670_POWER_IDLE (accel LP + wake-on-motion).
+ *
+ * @param idle_timeout_ms Inactivity time before demotion
+ *                        (e.g. @ref ICM42670_POWER_IDLE_TIMEOUT_DEFAULT_MS).
+ *
+ * @pre The IMU has been started, e.g. with ::ICM42670_start_with_default_values().
+ *
+ * @return 0 on success, negative value on error.
+ */
+int ICM42670_power_manager_init(uint32_t idle_timeout_ms);
+
+/**
+ * @brief Report activity to the power state manager.
+ *
+ * Call on a motion interrupt, button press or any other user activity.
+ * Promotes the IMU to ::ICM42670_POWER_ACTIVE if it was idle and restarts
+ * the inactivity timeout.
+ *
+ * @return 0 on success, negative value on error.
+ *
+ * @note Uses I²C. Call from task context, not from an interrupt handler.
+ */
+int ICM42670_power_wake(void);
+
+/**
+ * @brief Demote the IMU when the inactivity timeout has elapsed.
+ *
+ * Cheap when nothing has to be done, call it periodically (e.g. from the
+ * sampling loop). If setting up wake-on-motion fails, the IMU is put back
+ * into LN mode with its previous accelerometer configuration and the next
+ * try waits ::ICM42670_POWER_RETRY_MS. If even that fails, the state becomes
+ * ::ICM42670_POWER_IDLE so that ::ICM42670_power_wake() restores LN mode.
+ *
+ * @return 0 on success, negative value on error.
+ */
+int ICM42670_power_update(void);
+
+/**
+ * @brief Get the current power state.
+ */
+ICM42670_power_state_t ICM42670_power_get_state(void);
+
+/**
+ * @brief Get residency counters of the power state manager.
+ *
+ * @param stats Pointer to store the counters.
+ */
+void ICM42670_power_get_stats(ICM42670_power_stats_t *stats);
+
 /** @} */ // end of group ICM42670
 
 
@@ -0,0 +1,32 @@
+// Generated by host/sprite_gen from libs/TKJHAT/src/sprites.txt, do not edit.
+
+#ifndef _inc_sprites
+#define _inc_sprites
+
+#include <stdint.h>
+
+/**
+*	@brief sprites of the atlas
+*/
+typedef enum {
+    SPRITE_CHECKMARK,	/**< 32x32 message shown */
+    SPRITE_DOT,	/**< 16x16 morse dot */
+    SPRITE_DASH,	/**< 32x16 morse dash */
+    SPRITE_PENCIL,	/**< 16x16 writing a message */
+    SPRITE_ENVELOPE,	/**< 16x16 receiving a message */
+    SPRITE_COUNT
+} sprite_id_t;
+
+/**
+*	@brief one bitmap of the atlas, page by page like the frame buffer of ssd1306.h
+*/
+typedef struct {
+    uint16_t offset;	/**< first byte in sprite_atlas */
+    uint8_t width;	/**< columns, one byte per column and page */
+    uint8_t pages;	/**< rows / 8 */
+} sprite_t;
+
+extern const uint8_t sprite_atlas[];
+extern const sprite_t sprites[SPRITE_COUNT];
+
+#endif
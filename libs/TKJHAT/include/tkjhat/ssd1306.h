@@ -56,6 +56,40 @@ typedef enum {
     SET_CHARGE_PUMP = 0x8D
 } ssd1306_command_t;
 
+/**
+*	@brief most pages the controller has (64 rows)
+*/
+#define SSD1306_MAX_PAGES 8
+
+/**
+*	@brief most command bytes in one command list
+*/
+#define SSD1306_CMDLIST_SIZE 32
+
+/**
+*	@brief command bytes sent together in one I2C transaction
+*
+*	One control byte (Co=0, D/C#=0) starts a command stream, every byte after it is
+*	a command or a command argument. Build with ssd1306_cmdlist_begin and
+*	ssd1306_cmdlist_add, send with ssd1306_cmdlist_send.
+*/
+typedef struct {
+    uint8_t data[1+SSD1306_CMDLIST_SIZE];	/**< control byte and the commands */
+    uint8_t len;		/**< command bytes in data */
+    bool overflow;		/**< commands did not fit, the list is not sent */
+} ssd1306_cmdlist_t;
+
+/**
+*	@brief transfer and drawing counters
+*/
+typedef struct {
+    uint32_t shows;		/**< calls of ssd1306_show */
+    uint32_t windows;	/**< column/page windows sent */
+    uint32_t commands;	/**< command transactions (command lists and window addresses) */
+    uint32_t bytes;		/**< bytes written (control, command and data bytes, no address bytes) */
+    uint32_t draws;		/**< calls of the drawing functions, a string counts its characters */
+} ssd1306_stats_t;
+
 /**
 *	@brief holds the configuration
 */
@@ -68,6 +102,13 @@ typedef struct {
     bool external_vcc; 	/**< whether display uses external vcc */ 
     uint8_t *buffer;	/**< display buffer */
     size_t bufsize;		/**< buffer size */
+    uint8_t *shown;		/**< copy of the display RAM (NULL if allocation failed) */
+    bool shown_valid;	/**< false: display RAM unknown, send all dirty columns */
+    uint8_t dirty_x0[SSD1306_MAX_PAGES];	/**< first changed column of each page */
+    uint8_t dirty_x1[SSD1306_MAX_PAGES];	/**< last changed column of each page, page is clean if < dirty_x0 */
+    ssd1306_stats_t stats;	/**< transfer and drawing counters */
+    void *transfer;		/**< state of ssd1306_show_start on i2c_default (NULL: blocking writes) */
+    void *glyphs;		/**< cache of glyphs expanded for scale 2 and 3 (NULL if allocation failed) */
 } ssd1306_t;
 
 /**
@@ -93,6 +134,37 @@ bool ssd1306_init(ssd1306_t *p, uint16_t width, uint16_t height, uint8_t address
 */
 void ssd1306_deinit(ssd1306_t *p);
 
+/**
+*	@brief start an empty command list
+*
+*	@param[in] l : command list
+*
+*/
+void ssd1306_cmdlist_begin(ssd1306_cmdlist_t *l);
+
+/**
+	@brief append commands (with their arguments) to a command list
+
+	@param[in] l : command list
+	@param[in] cmds : command bytes
+	@param[in] len : number of bytes
+
+	@return bool.
+	@retval false if the bytes did not fit, the list is then marked as overflowed
+*/
+bool ssd1306_cmdlist_add(ssd1306_cmdlist_t *l, const uint8_t *cmds, size_t len);
+
+/**
+	@brief send a command list to the display in one transaction
+
+	@param[in] p : instance of display
+	@param[in] l : command list
+
+	@return int.
+	@retval number of bytes written, or a negative PICO_ERROR_ code (PICO_ERROR_GENERIC for an overflowed list)
+*/
+int ssd1306_cmdlist_send(ssd1306_t *p, const ssd1306_cmdlist_t *l);
+
 /**
 *	@brief turn off display
 *
@@ -130,11 +202,53 @@ void ssd1306_invert(ssd1306_t *p, uint8_t inv);
 /**
 	@brief display buffer, should be called on change
 
+	Only the changed parts are sent: every page keeps the range of columns the
+	drawing functions touched, and the range is compared with what the display
+	already shows. The changed bytes go out as column/page address windows.
+
 	@param[in] p : instance of display
 
 */
 void ssd1306_show(ssd1306_t *p);
 
+/**
+	@brief start sending the changed parts of the buffer and return
+
+	Everything drawn before the call is sent together and nothing drawn after it,
+	so a frame is never sent half drawn.
+
+	On i2c_default the changed bytes are prepared for the DMA before this returns,
+	so the buffer can be drawn again right away. The CPU is free while the frame is
+	on the bus and the I2C interrupt wakes up the task in ssd1306_show_wait.
+	Other i2c instances are written blocking. If many windows changed, this waits
+	for the first ones before it can queue the rest.
+
+	@param[in] p : instance of display
+
+*/
+void ssd1306_show_start(ssd1306_t *p);
+
+/**
+	@brief wait until the frames started with ssd1306_show_start are on the display
+
+	@param[in] p : instance of display
+
+	@return int.
+	@retval 0 on success
+	@retval PICO_ERROR_GENERIC if a transfer failed (the next show sends the whole buffer)
+*/
+int ssd1306_show_wait(ssd1306_t *p);
+
+/**
+	@brief send the whole buffer on the next ssd1306_show
+
+	Use when the display RAM may differ from the buffer, e.g. after the display was reset.
+
+	@param[in] p : instance of display
+
+*/
+void ssd1306_invalidate(ssd1306_t *p);
+
 /**
 	@brief clear display buffer
 
@@ -172,6 +286,18 @@ void ssd1306_draw_pixel(ssd1306_t *p, uint32_t x, uint32_t y);
 */
 void ssd1306_draw_line(ssd1306_t *p, int32_t x1, int32_t y1, int32_t x2, int32_t y2);
 
+/**
+	@brief set or clear all pixels of a rectangle, clipped to the display
+
+	@param[in] p : instance of display
+	@param[in] x1 : x position of one corner (may be outside of the display)
+	@param[in] y1 : y position of one corner
+	@param[in] x2 : x position of the opposite corner (inclusive)
+	@param[in] y2 : y position of the opposite corner (inclusive)
+	@param[in] on : true sets the pixels, false clears them
+*/
+void ssd1306_fill_rect(ssd1306_t *p, int32_t x1, int32_t y1, int32_t x2, int32_t y2, bool on);
+
 /**
 	@brief clear square at given position with given size
 
@@ -271,4 +397,39 @@ void ssd1306_draw_string_with_font(ssd1306_t *p, uint32_t x, uint32_t y, uint32_
 */
 void ssd1306_draw_string(ssd1306_t *p, uint32_t x, uint32_t y, uint32_t scale, const char *s);
 
+/**
+	@brief width of a string in the builtin font
+
+	@param[in] scale : font scale
+	@param[in] s : text
+
+	@return width in pixels, spacing after the last character included
+*/
+uint32_t ssd1306_string_width(uint32_t scale, const char *s);
+
+/**
+	@brief render string with builtin font into a page organized bitmap, e.g. an off-screen strip
+
+	@param[in] dst : bitmap of pages rows of width bytes, same layout as the display buffer (must be cleared)
+	@param[in] width : width of the bitmap
+	@param[in] pages : pages of the bitmap
+	@param[in] x : x starting position of text in the bitmap
+	@param[in] scale : scale font to n times of original size (1 to 4)
+	@param[in] s : text to render, cut at the end of the bitmap
+*/
+void ssd1306_render_string(uint8_t *dst, uint32_t width, uint32_t pages, uint32_t x, uint32_t scale, const char *s);
+
+/**
+	@brief copy columns of a page organized bitmap to the buffer
+
+	@param[in] p : instance of display
+	@param[in] x : first column on the display
+	@param[in] page : first page on the display
+	@param[in] src : first byte to copy, pages rows of src_width bytes
+	@param[in] src_width : width of the source bitmap
+	@param[in] width : columns to copy
+	@param[in] pages : pages to copy
+*/
+void ssd1306_blit_pages(ssd1306_t *p, uint32_t x, uint32_t page, const uint8_t *src, uint32_t src_width, uint32_t width, uint32_t pages);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,321 @@
+/*
+Fixed-point signal processing kernels, see tkjhat/dsp.h.
+
+Every kernel has a C version. With the Arm DSP extension (__ARM_FEATURE_DSP, the
+Cortex-M33 of the RP2350) the inner loops take two samples per instruction:
+SMLAD/SMLALD multiply-accumulate int16 pairs, SMUAD sums two products, QADD16
+adds two pairs with saturation and SSAT clamps the results.
+*/
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include <tkjhat/dsp.h>
+
+#if defined(__ARM_FEATURE_DSP) && __ARM_FEATURE_DSP
+#include <arm_acle.h>
+#define DSP_USE_ACLE 1
+#else
+#define DSP_USE_ACLE 0
+#endif
+
+#ifndef TKJHAT_HOST
+#include "pico/stdlib.h"
+#include "hardware/structs/systick.h"
+#endif
+
+static inline int16_t saturate_q15(int32_t x) {
+#if DSP_USE_ACLE
+    return (int16_t)__ssat(x, 16);
+#else
+    return x > INT16_MAX ? INT16_MAX : x < INT16_MIN ? INT16_MIN : (int16_t)x;
+#endif
+}
+
+#if DSP_USE_ACLE
+// Two int16 as one word. memcpy keeps it legal for unaligned pointers, compiles to one LDR.
+static inline int16x2_t read_q15x2(const int16_t *p) {
+    int16x2_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void write_q15x2(int16_t *p, int16x2_t v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline int16x2_t pack_q15x2(int16_t low, int16_t high) {
+    return (int16x2_t)(((uint32_t)(uint16_t)high << 16) | (uint16_t)low);
+}
+#endif
+
+/* ---- dot product ---- */
+
+int64_t dsp_dot_q15(const int16_t *a, const int16_t *b, size_t n) {
+    int64_t sum = 0;
+    size_t i = 0;
+#if DSP_USE_ACLE
+    for (; i + 4 <= n; i += 4) {
+        sum = __smlald(read_q15x2(&a[i]), read_q15x2(&b[i]), sum);
+        sum = __smlald(read_q15x2(&a[i + 2]), read_q15x2(&b[i + 2]), sum);
+    }
+#endif
+    for (; i < n; i++) {
+        sum += (int32_t)a[i] * b[i];
+    }
+    return sum;
+}
+
+/* ---- FIR ---- */
+// The delay line is stored twice in a row, so the newest taps samples are always
+// contiguous and every output is one dot product.
+
+void dsp_fir_q15_init(dsp_fir_q15_t *fir, const int16_t *coeffs, int16_t *state, uint16_t taps) {
+    fir->coeffs = coeffs;
+    fir->state = state;
+    fir->taps = taps;
+    fir->index = 0;
+    memset(state, 0, 2 * taps * sizeof(*state));
+}
+
+void dsp_fir_q15(dsp_fir_q15_t *fir, const int16_t *in, int16_t *out, size_t n) {
+    uint16_t taps = fir->taps;
+    for (size_t i = 0; i < n; i++) {
+        fir->index = fir->index == 0 ? taps - 1 : fir->index - 1;
+        fir->state[fir->index] = in[i];
+        fir->state[fir->index + taps] = in[i];
+        int64_t acc = dsp_dot_q15(fir->coeffs, &fir->state[fir->index], taps);
+        out[i] = saturate_q15((int32_t)((acc + (1 << 14)) >> 15));
+    }
+}
+
+/* ---- biquad ---- */
+
+void dsp_biquad_q14_init(dsp_biquad_q14_t *bq, int16_t b0, int16_t b1, int16_t b2, int16_t a1, int16_t a2) {
+    memset(bq, 0, sizeof(*bq));
+    bq->b0 = b0;
+    bq->b1 = b1;
+    bq->b2 = b2;
+    bq->a1 = a1;
+    bq->a2 = a2;
+}
+
+static int16_t to_q14(float x) {
+    float scaled = roundf(x * 16384.0f);
+    return scaled > INT16_MAX ? INT16_MAX : scaled < INT16_MIN ? INT16_MIN : (int16_t)scaled;
+}
+
+void dsp_biquad_lowpass_q14(dsp_biquad_q14_t *bq, uint32_t cutoff_hz, uint32_t sample_rate_hz) {
+    // Audio EQ cookbook low-pass with Q = 1/sqrt(2)
+    if (cutoff_hz > sample_rate_hz / 4) cutoff_hz = sample_rate_hz / 4;
+    if (cutoff_hz == 0) cutoff_hz = 1;
+    float w0 = 2.0f * 3.14159265f * cutoff_hz / sample_rate_hz;
+    float alpha = sinf(w0) / (2.0f * 0.70710678f);
+    float cosw0 = cosf(w0);
+    float a0 = 1.0f + alpha;
+    float b0 = (1.0f - cosw0) / 2.0f / a0;
+    dsp_biquad_q14_init(bq, to_q14(b0), to_q14(2.0f * b0), to_q14(b0),
+                        to_q14(-2.0f * cosw0 / a0), to_q14((1.0f - alpha) / a0));
+}
+
+void dsp_biquad_q14(dsp_biquad_q14_t *bq, const int16_t *in, int16_t *out, size_t n) {
+#if DSP_USE_ACLE
+    int16x2_t b12 = pack_q15x2(bq->b1, bq->b2);
+    int16x2_t a12 = pack_q15x2(bq->a1, bq->a2);
+    int16x2_t x12 = pack_q15x2(bq->x1, bq->x2);
+    int16x2_t y12 = pack_q15x2(bq->y1, bq->y2);
+    for (size_t i = 0; i < n; i++) {
+        int16_t x = in[i];
+        int64_t acc = (int32_t)bq->b0 * x;
+        acc = __smlald(b12, x12, acc);
+        // Subtracted as a 64-bit sum: negating a1 = -2.0 (-32768) would not fit in int16
+        acc -= __smlald(a12, y12, 0);
+        int16_t y = saturate_q15((int32_t)((acc + (1 << 13)) >> 14));
+        // Shift the history: new sample to the low half, old x1 to the high half
+        x12 = pack_q15x2(x, (int16_t)x12);
+        y12 = pack_q15x2(y, (int16_t)y12);
+        out[i] = y;
+    }
+    bq->x1 = (int16_t)x12;
+    bq->x2 = (int16_t)(x12 >> 16);
+    bq->y1 = (int16_t)y12;
+    bq->y2 = (int16_t)(y12 >> 16);
+#else
+    for (size_t i = 0; i < n; i++) {
+        int16_t x = in[i];
+        // Every product fits in 32 bits, their sum only in 64 like the SMLALD version
+        int64_t acc = (int32_t)bq->b0 * x;
+        acc += (int32_t)bq->b1 * bq->x1;
+        acc += (int32_t)bq->b2 * bq->x2;
+        acc -= (int32_t)bq->a1 * bq->y1;
+        acc -= (int32_t)bq->a2 * bq->y2;
+        int16_t y = saturate_q15((int32_t)((acc + (1 << 13)) >> 14));
+        bq->x2 = bq->x1;
+        bq->x1 = x;
+        bq->y2 = bq->y1;
+        bq->y1 = y;
+        out[i] = y;
+    }
+#endif
+}
+
+/* ---- moving average ---- */
+
+void dsp_moving_average_init(dsp_moving_average_t *ma, int16_t *window, uint16_t length) {
+    ma->window = window;
+    ma->length = length;
+    ma->index = 0;
+    ma->sum = 0;
+    memset(window, 0, length * sizeof(*window));
+}
+
+void dsp_moving_average(dsp_moving_average_t *ma, const int16_t *in, int16_t *out, size_t n) {
+    bool power_of_two = (ma->length & (ma->length - 1)) == 0;
+    int shift = 0;
+    while (power_of_two && (1u << shift) < ma->length) shift++;
+
+    for (size_t i = 0; i < n; i++) {
+        ma->sum += in[i] - ma->window[ma->index];
+        ma->window[ma->index] = in[i];
+        if (++ma->index == ma->length) ma->index = 0;
+        out[i] = (int16_t)(power_of_two ? ma->sum >> shift : ma->sum / ma->length);
+    }
+}
+
+/* ---- vectors ---- */
+
+uint32_t dsp_isqrt32(uint32_t x) {
+    uint32_t result = 0;
+    uint32_t bit = 1u << 30;
+    while (bit > x) bit >>= 2;
+    while (bit != 0) {
+        if (x >= result + bit) {
+            x -= result + bit;
+            result = (result >> 1) + bit;
+        } else {
+            result >>= 1;
+        }
+        bit >>= 2;
+    }
+    return result;
+}
+
+void dsp_magnitude3_q15(const int16_t *xyz, uint16_t *out, size_t n) {
+    for (size_t i = 0; i < n; i++, xyz += 3) {
+        // 3 * 32768^2 still fits in 32 bits unsigned
+#if DSP_USE_ACLE
+        int16x2_t xy = read_q15x2(xyz);
+        uint32_t sum = (uint32_t)__smuad(xy, xy) + (uint32_t)((int32_t)xyz[2] * xyz[2]);
+#else
+        uint32_t sum = (uint32_t)((int32_t)xyz[0] * xyz[0]) + (uint32_t)((int32_t)xyz[1] * xyz[1])
+                     + (uint32_t)((int32_t)xyz[2] * xyz[2]);
+#endif
+        uint32_t magnitude = dsp_isqrt32(sum);
+        out[i] = magnitude > UINT16_MAX ? UINT16_MAX : (uint16_t)magnitude;
+    }
+}
+
+void dsp_add_q15(const int16_t *a, const int16_t *b, int16_t *out, size_t n) {
+    size_t i = 0;
+#if DSP_USE_ACLE
+    for (; i + 2 <= n; i += 2) {
+        write_q15x2(&out[i], __qadd16(read_q15x2(&a[i]), read_q15x2(&b[i])));
+    }
+#endif
+    for (; i < n; i++) {
+        out[i] = saturate_q15((int32_t)a[i] + b[i]);
+    }
+}
+
+uint16_t dsp_rms_q15(const int16_t *x, size_t n) {
+    if (n == 0) return 0;
+    uint64_t mean = (uint64_t)dsp_dot_q15(x, x, n) / n;
+    return (uint16_t)dsp_isqrt32(mean > UINT32_MAX ? UINT32_MAX : (uint32_t)mean);
+}
+
+/* ---- benchmark ---- */
+
+#define BENCH_BLOCK     256
+#define BENCH_ROUNDS    16
+#define BENCH_FIR_TAPS  16
+
+#ifndef TKJHAT_HOST
+#define SYSTICK_CSR_ENABLE_PROCESSOR_CLOCK  0x5u    // ENABLE | CLKSOURCE (clk_sys)
+#define SYSTICK_RELOAD_MAX                  0x00FFFFFFu
+
+// SysTick counts clk_sys cycles down from its reload value. Before the scheduler it
+// is free and runs over its whole 24-bit range, the FreeRTOS port takes it over for
+// its tick when the scheduler starts. The wraps are added up between the calls.
+uint32_t dsp_cycle_counter(void) {
+    static uint32_t cycles;
+    static uint32_t last;
+    if ((systick_hw->csr & 1u) == 0) {
+        systick_hw->rvr = SYSTICK_RELOAD_MAX;
+        systick_hw->cvr = 0;
+        systick_hw->csr = SYSTICK_CSR_ENABLE_PROCESSOR_CLOCK;
+        last = systick_hw->cvr;
+    }
+    uint32_t period = (systick_hw->rvr & SYSTICK_RELOAD_MAX) + 1;
+    uint32_t now = systick_hw->cvr;
+    cycles += last >= now ? last - now : last + period - now;
+    last = now;
+    return cycles;
+}
+#endif
+
+void dsp_benchmark(dsp_benchmark_result_t *results, uint32_t (*counter)(void)) {
+    static int16_t input[BENCH_BLOCK * 3];
+    static int16_t output[BENCH_BLOCK * 3];
+    static int16_t fir_state[2 * BENCH_FIR_TAPS];
+    static int16_t fir_coeffs[BENCH_FIR_TAPS];
+    static int16_t average_window[16];
+    volatile int64_t sink = 0; // keeps the dot product from being optimized away
+
+    // Deterministic pseudo random test signal
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < BENCH_BLOCK * 3; i++) {
+        seed = seed * 1664525u + 1013904223u;
+        input[i] = (int16_t)(seed >> 16);
+    }
+    for (int i = 0; i < BENCH_FIR_TAPS; i++) {
+        fir_coeffs[i] = 32768 / BENCH_FIR_TAPS;
+    }
+
+    dsp_fir_q15_t fir;
+    dsp_biquad_q14_t biquad;
+    dsp_moving_average_t average;
+    dsp_fir_q15_init(&fir, fir_coeffs, fir_state, BENCH_FIR_TAPS);
+    dsp_biquad_lowpass_q14(&biquad, 1000, 16000);
+    dsp_moving_average_init(&average, average_window, 16);
+
+    static const char *names[DSP_BENCHMARK_COUNT] = {
+        "dot", "fir16", "biquad", "moving_average16", "magnitude3", "add", "rms"
+    };
+    for (int kernel = 0; kernel < DSP_BENCHMARK_COUNT; kernel++) {
+        uint32_t start = counter();
+        for (int round = 0; round < BENCH_ROUNDS; round++) {
+            switch (kernel) {
+                case 0: sink += dsp_dot_q15(input, &input[BENCH_BLOCK], BENCH_BLOCK); break;
+                case 1: dsp_fir_q15(&fir, input, output, BENCH_BLOCK); break;
+                case 2: dsp_biquad_q14(&biquad, input, output, BENCH_BLOCK); break;
+                case 3: dsp_moving_average(&average, input, output, BENCH_BLOCK); break;
+                case 4: dsp_magnitude3_q15(input, (uint16_t *)output, BENCH_BLOCK); break;
+                case 5: dsp_add_q15(input, &input[BENCH_BLOCK], output, BENCH_BLOCK); break;
+                case 6: sink += dsp_rms_q15(input, BENCH_BLOCK); break;
+            }
+        }
+        results[kernel].name = names[kernel];
+        results[kernel].samples = BENCH_BLOCK * BENCH_ROUNDS;
+        results[kernel].elapsed = counter() - start;
+    }
+    (void)sink;
+}
+
+void dsp_benchmark_print(const dsp_benchmark_result_t *results, const char *unit) {
+    printf("DSP kernels (%s, %s per sample):\n", DSP_USE_ACLE ? "ACLE" : "C", unit);
+    for (int i = 0; i < DSP_BENCHMARK_COUNT; i++) {
+        uint32_t per_sample_x100 = (uint32_t)((uint64_t)results[i].elapsed * 100 / results[i].samples);
+        printf("  %-18s %lu.%02lu\n", results[i].name,
+               (unsigned long)(per_sample_x100 / 100), (unsigned long)(per_sample_x100 % 100));
+    }
+}
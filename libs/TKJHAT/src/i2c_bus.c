@@ -0,0 +1,580 @@
+/*
+Asynchronous I2C transaction engine, see tkjhat/i2c_bus.h.
+
+The controller is fed with 16-bit command words (data byte + CMD/STOP/RESTART bits
+of IC_DATA_CMD) by one DMA channel, and a second channel drains the RX FIFO. A byte
+wide DMA write would be replicated to all byte lanes of IC_DATA_CMD and set the
+command bits, so the write bytes are copied to a command buffer first.
+
+A transaction is finished from the I2C interrupt on STOP_DET. The controller sends
+a STOP also after an abort (TX_ABRT, e.g. NACK), so STOP_DET is the single place
+where a transaction ends.
+
+Each client class has its own FIFO queue. The next transaction is picked only when
+the bus is free, so a transaction is never interrupted, but a queued IMU read
+overtakes queued display pages.
+
+Transactions with pre-encoded words (i2c_bus_encode_write()) skip the copy: the
+interrupt points the DMA at the words of the submitter, so starting a display page
+costs the same as starting a register read.
+
+The SCL frequency of the device profile is set right before the transaction starts.
+i2c_set_baudrate() disables the controller for a moment, which is only allowed
+between transactions, so it is skipped when the speed does not change.
+*/
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "pico/sync.h"
+#include "hardware/i2c.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+
+#include <tkjhat/i2c_bus.h>
+
+#define I2C_BUS_DISABLE_TIMEOUT_US 1000
+
+static struct {
+    i2c_inst_t *i2c;
+    bool initialized;
+    uint tx_dma;
+    uint rx_dma;
+    dma_channel_config tx_config;
+    dma_channel_config rx_config;
+    uint irq;
+    spin_lock_t *lock;
+
+    struct {
+        i2c_transaction_t *head;
+        i2c_transaction_t *tail;
+    } queue[I2C_BUS_CLIENT_COUNT];  // submitted transactions per client class
+    i2c_transaction_t *active;      // transaction on the bus
+    bool aborted;                   // TX_ABRT seen for the active transaction
+    uint32_t abort_source;
+    uint64_t started_us;
+    uint32_t baudrate;              // current SCL frequency
+
+    bool acquired;                  // bus taken by i2c_bus_acquire()
+    TaskHandle_t owner;
+    uint32_t acquire_pending;       // tasks waiting in i2c_bus_acquire(), no new transactions start
+
+    struct {
+        uint8_t address;
+        i2c_bus_profile_t profile;
+    } devices[I2C_BUS_MAX_DEVICES];
+    uint8_t device_count;
+
+    i2c_bus_stats_t stats;
+    i2c_bus_client_stats_t client_stats[I2C_BUS_CLIENT_COUNT];
+    uint16_t commands[I2C_BUS_MAX_TRANSFER];
+} bus;
+
+static bool scheduler_running(void) {
+    return xTaskGetSchedulerState() == taskSCHEDULER_RUNNING;
+}
+
+static bool status_is_final(i2c_transaction_status_t status) {
+    return status == I2C_TRANSACTION_DONE || status == I2C_TRANSACTION_NACK
+        || status == I2C_TRANSACTION_TIMEOUT;
+}
+
+static int status_to_result(const i2c_transaction_t *t) {
+    switch (t->status) {
+        case I2C_TRANSACTION_DONE:    return (int)(t->header_len + t->tx_len + t->rx_len);
+        case I2C_TRANSACTION_TIMEOUT: return PICO_ERROR_TIMEOUT;
+        default:                      return PICO_ERROR_GENERIC;
+    }
+}
+
+/* ---- bus control, called with the lock held ---- */
+
+static const i2c_bus_profile_t default_profile = {
+    .client = I2C_BUS_CLIENT_OTHER,
+    .baudrate = I2C_BUS_DEFAULT_BAUDRATE,
+    .timeout_ms = I2C_BUS_TIMEOUT_MS,
+    .retries = 0,
+};
+
+static const i2c_bus_profile_t *profile_of(uint8_t address) {
+    for (int i = 0; i < bus.device_count; i++) {
+        if (bus.devices[i].address == address) {
+            return &bus.devices[i].profile;
+        }
+    }
+    return &default_profile;
+}
+
+static void set_baudrate_locked(uint32_t baudrate) {
+    if (baudrate != bus.baudrate) {
+        i2c_set_baudrate(bus.i2c, baudrate);
+        bus.baudrate = baudrate;
+    }
+}
+
+static void start_next_locked(void) {
+    if (bus.active != NULL || bus.acquired || bus.acquire_pending > 0) {
+        return;
+    }
+    int client = 0;
+    while (client < I2C_BUS_CLIENT_COUNT && bus.queue[client].head == NULL) {
+        client++;
+    }
+    if (client == I2C_BUS_CLIENT_COUNT) {
+        return;
+    }
+    i2c_transaction_t *t = bus.queue[client].head;
+    bus.queue[client].head = t->next;
+    if (bus.queue[client].head == NULL) bus.queue[client].tail = NULL;
+    t->next = NULL;
+    t->status = I2C_TRANSACTION_ACTIVE;
+    bus.active = t;
+    bus.aborted = false;
+    bus.abort_source = 0;
+
+    bus.started_us = time_us_64();
+    uint32_t wait_us = (uint32_t)(bus.started_us - t->submitted_us);
+    i2c_bus_client_stats_t *client_stats = &bus.client_stats[client];
+    client_stats->transactions++;
+    client_stats->wait_us += wait_us;
+    if (wait_us > client_stats->max_wait_us) client_stats->max_wait_us = wait_us;
+
+    size_t n = 0;
+    const uint16_t *commands = bus.commands;
+    if (t->encoded != NULL) {
+        commands = t->encoded;
+        n = t->header_len + t->tx_len;
+    } else {
+        for (size_t i = 0; i < t->header_len; i++) {
+            bus.commands[n++] = t->header[i];
+        }
+        for (size_t i = 0; i < t->tx_len; i++) {
+            bus.commands[n++] = t->tx[i];
+        }
+        for (size_t i = 0; i < t->rx_len; i++) {
+            uint16_t command = I2C_IC_DATA_CMD_CMD_BITS;
+            if (i == 0 && n > 0) command |= I2C_IC_DATA_CMD_RESTART_BITS;
+            bus.commands[n++] = command;
+        }
+        bus.commands[n - 1] |= I2C_IC_DATA_CMD_STOP_BITS;
+    }
+
+    set_baudrate_locked(profile_of(t->address)->baudrate);
+    i2c_hw_t *hw = bus.i2c->hw;
+    hw->enable = 0;
+    hw->tar = t->address;
+    hw->enable = 1;
+    (void)hw->clr_stop_det;
+    (void)hw->clr_tx_abrt;
+    hw->intr_mask = I2C_IC_INTR_MASK_M_STOP_DET_BITS | I2C_IC_INTR_MASK_M_TX_ABRT_BITS;
+    bus.i2c->restart_on_next = false;
+
+    if (t->rx_len > 0) {
+        dma_channel_configure(bus.rx_dma, &bus.rx_config, t->rx, &hw->data_cmd, t->rx_len, true);
+    }
+    dma_channel_configure(bus.tx_dma, &bus.tx_config, &hw->data_cmd, commands, n, true);
+}
+
+// Ends the active transaction and starts the next one. Returns the finished transaction,
+// or NULL if a NACKed transaction went back to the front of its queue for a retry.
+static i2c_transaction_t *finish_active_locked(i2c_transaction_status_t status) {
+    i2c_transaction_t *t = bus.active;
+    bus.active = NULL;
+
+    uint64_t bus_us = time_us_64() - bus.started_us;
+    bus.stats.busy_us += bus_us;
+    bus.client_stats[t->client].bus_us += bus_us;
+
+    if (status == I2C_TRANSACTION_NACK && t->attempts < profile_of(t->address)->retries) {
+        t->attempts++;
+        t->status = I2C_TRANSACTION_QUEUED;
+        t->next = bus.queue[t->client].head;
+        bus.queue[t->client].head = t;
+        if (bus.queue[t->client].tail == NULL) bus.queue[t->client].tail = t;
+        bus.stats.retries++;
+        start_next_locked();
+        return NULL;
+    }
+
+    bus.stats.transactions++;
+    if (status == I2C_TRANSACTION_DONE) {
+        bus.stats.bytes += t->header_len + t->tx_len + t->rx_len;
+    } else {
+        bus.stats.errors++;
+    }
+    t->abort_source = bus.abort_source;
+    // The interrupt calls the callback before the descriptor is given up. A timeout is
+    // ended by i2c_bus_wait() itself and has no callback.
+    t->completing = t->callback != NULL && status != I2C_TRANSACTION_TIMEOUT;
+    t->status = status;
+
+    start_next_locked();
+    return t;
+}
+
+static void i2c_bus_irq_handler(void) {
+    i2c_hw_t *hw = bus.i2c->hw;
+    uint32_t save = spin_lock_blocking(bus.lock);
+    uint32_t status = hw->intr_stat;
+
+    if (status & I2C_IC_INTR_STAT_R_TX_ABRT_BITS) {
+        // The TX FIFO is flushed and held until TX_ABRT is cleared. Stop the DMA first
+        // so it does not refill the FIFO with the rest of the transaction.
+        dma_channel_abort(bus.tx_dma);
+        dma_channel_abort(bus.rx_dma);
+        bus.abort_source = hw->tx_abrt_source;
+        bus.aborted = true;
+        (void)hw->clr_tx_abrt;
+    }
+
+    if (!(status & I2C_IC_INTR_STAT_R_STOP_DET_BITS)) {
+        spin_unlock(bus.lock, save);
+        return;
+    }
+    (void)hw->clr_stop_det;
+    if (bus.active == NULL) {
+        spin_unlock(bus.lock, save);
+        return;
+    }
+
+    // The last byte is in the RX FIFO when STOP is detected, the DMA takes it right after
+    while (!bus.aborted && bus.active->rx_len > 0 && dma_channel_is_busy(bus.rx_dma)) {
+        tight_loop_contents();
+    }
+    // Read before the status changes, the waiting task may return and free the descriptor
+    TaskHandle_t waiter = bus.active->waiter;
+    i2c_transaction_callback_t callback = bus.active->callback;
+    i2c_transaction_t *t = finish_active_locked(bus.aborted ? I2C_TRANSACTION_NACK : I2C_TRANSACTION_DONE);
+    spin_unlock(bus.lock, save);
+    if (t == NULL) {
+        return; // sent again
+    }
+
+    if (callback != NULL) {
+        callback(t);
+        t->completing = false; // last access, i2c_bus_wait() may return from here on
+    }
+    if (waiter != NULL) {
+        BaseType_t woken = pdFALSE;
+        vTaskNotifyGiveIndexedFromISR(waiter, I2C_BUS_NOTIFY_INDEX, &woken);
+        portYIELD_FROM_ISR(woken);
+    }
+}
+
+// Removes a transaction that did not finish in time. Called with the lock held.
+static void cancel_locked(i2c_transaction_t *t) {
+    if (t->status == I2C_TRANSACTION_QUEUED) {
+        i2c_transaction_t **link = &bus.queue[t->client].head;
+        i2c_transaction_t *previous = NULL;
+        while (*link != NULL && *link != t) {
+            previous = *link;
+            link = &(*link)->next;
+        }
+        if (*link == t) {
+            *link = t->next;
+            if (bus.queue[t->client].tail == t) bus.queue[t->client].tail = previous;
+        }
+        t->status = I2C_TRANSACTION_TIMEOUT;
+        bus.stats.errors++;
+        return;
+    }
+    if (bus.active != t) {
+        return;
+    }
+
+    // Stuck on the bus (e.g. clock stretched forever). Disable the controller, which
+    // ends the transfer, and wait until it is really off before the next one starts.
+    i2c_hw_t *hw = bus.i2c->hw;
+    dma_channel_abort(bus.tx_dma);
+    dma_channel_abort(bus.rx_dma);
+    hw->enable = 0;
+    uint64_t start = time_us_64();
+    while ((hw->enable_status & I2C_IC_ENABLE_STATUS_IC_EN_BITS)
+            && time_us_64() - start < I2C_BUS_DISABLE_TIMEOUT_US) {
+        tight_loop_contents();
+    }
+    (void)hw->clr_stop_det;
+    (void)hw->clr_tx_abrt;
+    finish_active_locked(I2C_TRANSACTION_TIMEOUT);
+}
+
+/* ---- public API ---- */
+
+int i2c_bus_init(i2c_inst_t *i2c) {
+    if (bus.initialized) {
+        return 0;
+    }
+    bus.i2c = i2c;
+    i2c_set_baudrate(i2c, I2C_BUS_DEFAULT_BAUDRATE);
+    bus.baudrate = I2C_BUS_DEFAULT_BAUDRATE;
+    if (bus.lock == NULL) {
+        bus.lock = spin_lock_init(spin_lock_claim_unused(true));
+    }
+
+    int tx_dma = dma_claim_unused_channel(false);
+    int rx_dma = dma_claim_unused_channel(false);
+    if (tx_dma < 0 || rx_dma < 0) {
+        if (tx_dma >= 0) dma_channel_unclaim(tx_dma);
+        if (rx_dma >= 0) dma_channel_unclaim(rx_dma);
+        return -1;
+    }
+    bus.tx_dma = tx_dma;
+    bus.rx_dma = rx_dma;
+
+    bus.tx_config = dma_channel_get_default_config(bus.tx_dma);
+    channel_config_set_transfer_data_size(&bus.tx_config, DMA_SIZE_16);
+    channel_config_set_read_increment(&bus.tx_config, true);
+    channel_config_set_write_increment(&bus.tx_config, false);
+    channel_config_set_dreq(&bus.tx_config, i2c_get_dreq(i2c, true));
+
+    bus.rx_config = dma_channel_get_default_config(bus.rx_dma);
+    channel_config_set_transfer_data_size(&bus.rx_config, DMA_SIZE_8);
+    channel_config_set_read_increment(&bus.rx_config, false);
+    channel_config_set_write_increment(&bus.rx_config, true);
+    channel_config_set_dreq(&bus.rx_config, i2c_get_dreq(i2c, false));
+
+    // DMA requests from the controller (i2c_init enables them as well)
+    i2c->hw->dma_cr = I2C_IC_DMA_CR_TDMAE_BITS | I2C_IC_DMA_CR_RDMAE_BITS;
+    i2c->hw->intr_mask = 0;
+
+    bus.irq = i2c_hw_index(i2c) == 0 ? I2C0_IRQ : I2C1_IRQ;
+    irq_set_exclusive_handler(bus.irq, i2c_bus_irq_handler);
+    irq_set_enabled(bus.irq, true);
+
+    memset(&bus.stats, 0, sizeof(bus.stats));
+    memset(bus.client_stats, 0, sizeof(bus.client_stats));
+    bus.initialized = true;
+    return 0;
+}
+
+size_t i2c_bus_encode_write(uint16_t *words, const uint8_t *header, size_t header_len,
+                            const uint8_t *tx, size_t tx_len) {
+    size_t n = 0;
+    for (size_t i = 0; i < header_len; i++) {
+        words[n++] = header[i];
+    }
+    for (size_t i = 0; i < tx_len; i++) {
+        words[n++] = tx[i];
+    }
+    if (n > 0) words[n - 1] |= I2C_IC_DATA_CMD_STOP_BITS;
+    return n;
+}
+
+int i2c_bus_submit(i2c_transaction_t *transaction) {
+    size_t length = transaction->header_len + transaction->tx_len + transaction->rx_len;
+    if (!bus.initialized || length == 0 || length > I2C_BUS_MAX_TRANSFER
+            || transaction->header_len > sizeof(transaction->header)
+            || (transaction->encoded != NULL && transaction->rx_len > 0)) {
+        return -1;
+    }
+    transaction->status = I2C_TRANSACTION_QUEUED;
+    transaction->abort_source = 0;
+    transaction->attempts = 0;
+    transaction->waiter = scheduler_running() ? xTaskGetCurrentTaskHandle() : NULL;
+    transaction->completing = false;
+    transaction->next = NULL;
+
+    uint32_t save = spin_lock_blocking(bus.lock);
+    const i2c_bus_profile_t *profile = profile_of(transaction->address);
+    transaction->client = profile->client;
+    transaction->timeout_ms = profile->timeout_ms;
+    transaction->submitted_us = time_us_64();
+    i2c_bus_client_t client = transaction->client;
+    if (bus.queue[client].tail != NULL) {
+        bus.queue[client].tail->next = transaction;
+    } else {
+        bus.queue[client].head = transaction;
+    }
+    bus.queue[client].tail = transaction;
+    start_next_locked();
+    spin_unlock(bus.lock, save);
+    return 0;
+}
+
+int i2c_bus_wait(i2c_transaction_t *transaction, uint32_t timeout_ms) {
+    if (timeout_ms == I2C_BUS_TIMEOUT_PROFILE) {
+        timeout_ms = transaction->timeout_ms;
+    }
+    uint64_t deadline = time_us_64() + (uint64_t)timeout_ms * 1000;
+    while (!status_is_final(transaction->status) || transaction->completing) {
+        uint64_t now = time_us_64();
+        if (status_is_final(transaction->status)) {
+            tight_loop_contents(); // the callback is running in the interrupt
+            continue;
+        }
+        if (now >= deadline) {
+            uint32_t save = spin_lock_blocking(bus.lock);
+            if (!status_is_final(transaction->status)) {
+                cancel_locked(transaction);
+            }
+            spin_unlock(bus.lock, save);
+            break;
+        }
+        if (transaction->waiter != NULL && transaction->waiter == xTaskGetCurrentTaskHandle()) {
+            // Woken by the interrupt. A notification left from an earlier transaction
+            // only causes one extra round of the loop.
+            TickType_t ticks = pdMS_TO_TICKS((deadline - now + 999) / 1000);
+            ulTaskNotifyTakeIndexed(I2C_BUS_NOTIFY_INDEX, pdTRUE, ticks > 0 ? ticks : 1);
+        } else if (scheduler_running()) {
+            vTaskDelay(1);
+        } else {
+            tight_loop_contents();
+        }
+    }
+    return status_to_result(transaction);
+}
+
+static int transfer_blocking(uint8_t address, const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len) {
+    i2c_inst_t *i2c = bus.initialized ? bus.i2c : i2c_default;
+    const i2c_bus_profile_t *profile = profile_of(address);
+    absolute_time_t deadline = make_timeout_time_ms(profile->timeout_ms);
+    int result = PICO_ERROR_GENERIC;
+    // Inside an i2c_write() without STOP the bus is the caller's, leave it to them
+    int acquired = i2c_bus_acquire(address);
+    if (acquired < 0) {
+        return acquired;
+    }
+    for (int attempt = 0; attempt <= profile->retries && result == PICO_ERROR_GENERIC; attempt++) {
+        result = 0;
+        if (tx_len > 0) {
+            result = i2c_write_blocking_until(i2c, address, tx, tx_len, rx_len > 0, deadline);
+        }
+        if (result == (int)tx_len && rx_len > 0) {
+            int read = i2c_read_blocking_until(i2c, address, rx, rx_len, false, deadline);
+            result = read < 0 ? read : result + read;
+        }
+    }
+    if (acquired > 0) i2c_bus_release();
+    return result;
+}
+
+int i2c_bus_transfer(uint8_t address, const uint8_t *tx, size_t tx_len, uint8_t *rx, size_t rx_len) {
+    bool owned = bus.acquired && bus.owner == (scheduler_running() ? xTaskGetCurrentTaskHandle() : NULL);
+    if (!bus.initialized || !scheduler_running() || owned || tx_len + rx_len > I2C_BUS_MAX_TRANSFER) {
+        return transfer_blocking(address, tx, tx_len, rx, rx_len);
+    }
+
+    i2c_transaction_t transaction = {
+        .address = address,
+        .tx = tx,
+        .tx_len = tx_len,
+        .rx = rx,
+        .rx_len = rx_len,
+    };
+    if (i2c_bus_submit(&transaction) != 0) {
+        return PICO_ERROR_GENERIC;
+    }
+    return i2c_bus_wait(&transaction, I2C_BUS_TIMEOUT_PROFILE);
+}
+
+int i2c_bus_acquire(uint8_t address) {
+    if (!bus.initialized) {
+        return 0;
+    }
+    TaskHandle_t self = scheduler_running() ? xTaskGetCurrentTaskHandle() : NULL;
+    absolute_time_t deadline = make_timeout_time_ms(I2C_BUS_TIMEOUT_MS);
+    bool pending = false;
+    for (;;) {
+        uint32_t save = spin_lock_blocking(bus.lock);
+        if (bus.acquired && bus.owner == self) {
+            spin_unlock(bus.lock, save);
+            return 0; // already ours, e.g. a read after a write without STOP
+        }
+        if (!bus.acquired && bus.active == NULL) {
+            if (pending) bus.acquire_pending--;
+            bus.acquired = true;
+            bus.owner = self;
+            set_baudrate_locked(profile_of(address)->baudrate);
+            // The blocking SDK functions poll the raw interrupt status themselves
+            bus.i2c->hw->intr_mask = 0;
+            spin_unlock(bus.lock, save);
+            return 1;
+        }
+        // Another task keeps the bus too long, e.g. it never ended a transfer without STOP
+        if (time_reached(deadline)) {
+            if (pending) bus.acquire_pending--;
+            start_next_locked();
+            spin_unlock(bus.lock, save);
+            return PICO_ERROR_TIMEOUT;
+        }
+        // Keep queued transactions from starting, so the bus becomes free
+        if (!pending) {
+            bus.acquire_pending++;
+            pending = true;
+        }
+        spin_unlock(bus.lock, save);
+        if (self != NULL) {
+            vTaskDelay(1);
+        } else {
+            tight_loop_contents();
+        }
+    }
+}
+
+void i2c_bus_release(void) {
+    if (!bus.initialized) {
+        return;
+    }
+    uint32_t save = spin_lock_blocking(bus.lock);
+    bus.acquired = false;
+    bus.owner = NULL;
+    start_next_locked();
+    spin_unlock(bus.lock, save);
+}
+
+int i2c_bus_register_device(uint8_t address, const i2c_bus_profile_t *profile) {
+    i2c_bus_profile_t p = *profile;
+    if (p.baudrate == 0) p.baudrate = default_profile.baudrate;
+    if (p.timeout_ms == 0) p.timeout_ms = default_profile.timeout_ms;
+
+    int result = 0;
+    uint32_t save = bus.lock != NULL ? spin_lock_blocking(bus.lock) : 0;
+    int i = 0;
+    while (i < bus.device_count && bus.devices[i].address != address) {
+        i++;
+    }
+    if (i < I2C_BUS_MAX_DEVICES) {
+        bus.devices[i].address = address;
+        bus.devices[i].profile = p;
+        if (i == bus.device_count) bus.device_count++;
+    } else {
+        result = -1;
+    }
+    if (bus.lock != NULL) spin_unlock(bus.lock, save);
+    return result;
+}
+
+int i2c_bus_get_profile(uint8_t address, i2c_bus_profile_t *profile) {
+    const i2c_bus_profile_t *p = profile_of(address);
+    *profile = *p;
+    return p == &default_profile ? -1 : 0;
+}
+
+void i2c_bus_get_stats(i2c_bus_stats_t *stats) {
+    if (!bus.initialized) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    uint32_t save = spin_lock_blocking(bus.lock);
+    *stats = bus.stats;
+    spin_unlock(bus.lock, save);
+}
+
+void i2c_bus_get_client_stats(i2c_bus_client_t client, i2c_bus_client_stats_t *stats) {
+    if (!bus.initialized || client >= I2C_BUS_CLIENT_COUNT) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    uint32_t save = spin_lock_blocking(bus.lock);
+    *stats = bus.client_stats[client];
+    spin_unlock(bus.lock, save);
+}
+
+void i2c_bus_reset_stats(void) {
+    if (!bus.initialized) {
+        return;
+    }
+    uint32_t save = spin_lock_blocking(bus.lock);
+    memset(&bus.stats, 0, sizeof(bus.stats));
+    memset(bus.client_stats, 0, sizeof(bus.client_stats));
+    spin_unlock(bus.lock, save);
+}
@@ -30,9 +30,19 @@ SOFTWARE.
 //#include "tusb.h" //is it needed?
 #include "hardware/irq.h"
 #include "hardware/pwm.h"
+#include "hardware/clocks.h"
+#include "hardware/timer.h"
+#include "hardware/dma.h"
 #include <tkjhat/ssd1306.h>
 #include <tkjhat/pdm_microphone.h>
+#include <tkjhat/dsp.h>
+#include <tkjhat/i2c_bus.h>
+#include <FreeRTOS.h>
+#include <task.h>
+#include <queue.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 
@@ -214,33 +224,391 @@ void stop_rgb_led(){
  *  BUZZER
  * ========================= */
 
+// The buzzer is driven by its PWM slice (GPIO 17: slice 0, channel B). A tone is
+// the divider, the wrap and a 50 % level. Every note is a sequence: a hardware alarm
+// fires at the end of each note and gap and the alarm interrupt starts what comes
+// next, so the CPU does nothing while a melody plays.
+//
+// With sine waves (buzzer_set_waveform()) the slice runs at an ultrasonic carrier
+// instead and its level is the sample: two DMA channels, chained to each other and
+// paced by a DMA timer, write the blocks of synth.blocks into the compare register
+// in turn. When a channel finishes, the other one takes over and the interrupt
+// computes the next samples into the finished block. A note then only sets the
+// phase increment and the gate of the envelope.
+typedef struct {
+    const buzzer_note_t *notes;     // NULL: nothing
+    uint16_t count;
+    uint8_t priority;
+} buzzer_sequence_t;
+
+static struct {
+    uint slice;
+    int alarm;                      // -1: no alarm, only buzzer_play_tone() works
+    volatile bool playing;
+    buzzer_sequence_t current;
+    uint16_t index;                 // next note of current
+    bool gap_next;                  // the note playing is followed by its gap
+    absolute_time_t deadline;       // end of the note or gap playing, where the next one starts
+    buzzer_note_t tone;             // note of buzzer_start_tone()
+    buzzer_sequence_t queue[BUZZER_SEQUENCE_QUEUE_LENGTH];
+    uint8_t queue_head;
+    uint8_t queued;
+} buzzer = { .alarm = -1 };
+
+#define SYNTH_ENVELOPE_FULL     65536   // gain 1.0 of the envelope
+#define SYNTH_PHASE_SILENT      0xC0000000u // sine at -1: level 0 when a tone starts
+
+static struct {
+    volatile bool running;
+    int dma[2];                     // -1: not claimed
+    int timer;
+    uint32_t rate_hz;
+    uint shift;                     // 0: channel A, 16: channel B of the compare register
+    volatile bool gate;             // envelope rises to full while set, falls to 0 otherwise
+    volatile uint32_t increment;    // phase step per sample, 2^32 is one period
+    uint32_t phase;
+    int32_t envelope;               // 0 - SYNTH_ENVELOPE_FULL
+    int32_t attack_step;
+    int32_t release_step;
+    uint32_t started_us;
+    volatile uint32_t blocks_done;
+    volatile uint32_t busy_us;
+    uint32_t blocks[2][BUZZER_SYNTH_BLOCK];
+} synth = { .dma = {-1, -1}, .timer = -1 };
+
+static int16_t synth_sine[256];
+
+// Samples of the next block: (1 + sin) / 2 scaled by the envelope, so the level is
+// 0 when the buzzer is silent
+static void synth_render(uint32_t *block) {
+    uint32_t phase = synth.phase;
+    uint32_t increment = synth.increment;
+    int32_t envelope = synth.envelope;
+    int32_t target = synth.gate ? SYNTH_ENVELOPE_FULL : 0;
+    int32_t step = synth.gate ? synth.attack_step : -synth.release_step;
+
+    for (int i = 0; i < BUZZER_SYNTH_BLOCK; ++i) {
+        if (envelope != target) {
+            envelope += step;
+            if (step > 0 ? envelope > target : envelope < target) envelope = target;
+        }
+        uint32_t sample = (uint32_t)(32768 + synth_sine[phase >> 24]);
+        uint32_t level = (sample * (uint32_t)(envelope >> 8)) >> 16; // 0 - BUZZER_SYNTH_CARRIER_WRAP
+        block[i] = level << synth.shift;
+        phase += increment;
+    }
+    if (envelope == 0) phase = SYNTH_PHASE_SILENT;
+    synth.phase = phase;
+    synth.envelope = envelope;
+}
+
+static void synth_dma_handler(void) {
+    for (int i = 0; i < 2; ++i) {
+        uint channel = (uint)synth.dma[i];
+        if (!dma_channel_get_irq1_status(channel)) continue;
+        dma_channel_acknowledge_irq1(channel);
+        uint32_t start = time_us_32();
+        synth_render(synth.blocks[i]);
+        dma_channel_set_read_addr(channel, synth.blocks[i], false);
+        dma_channel_set_trans_count(channel, BUZZER_SYNTH_BLOCK, false);
+        synth.busy_us += time_us_32() - start;
+        synth.blocks_done++;
+    }
+}
+
+static int32_t synth_envelope_step(uint16_t ms) {
+    uint32_t samples = (uint32_t)ms * synth.rate_hz / 1000;
+    return samples == 0 ? SYNTH_ENVELOPE_FULL : (int32_t)(SYNTH_ENVELOPE_FULL / samples) + 1;
+}
+
+static void synth_release(void) {
+    for (int i = 0; i < 2; ++i) {
+        if (synth.dma[i] >= 0) dma_channel_unclaim((uint)synth.dma[i]);
+        synth.dma[i] = -1;
+    }
+    if (synth.timer >= 0) dma_timer_unclaim((uint)synth.timer);
+    synth.timer = -1;
+}
+
+static bool synth_start(uint16_t attack_ms, uint16_t release_ms) {
+    synth.dma[0] = dma_claim_unused_channel(false);
+    synth.dma[1] = dma_claim_unused_channel(false);
+    synth.timer = dma_claim_unused_timer(false);
+    if (synth.dma[0] < 0 || synth.dma[1] < 0 || synth.timer < 0) {
+        synth_release();
+        return false;
+    }
+    if (synth_sine[64] == 0) {
+        for (int i = 0; i < 256; ++i) {
+            synth_sine[i] = (int16_t)lroundf(32767.0f * sinf((float)i * 2.0f * 3.14159265f / 256.0f));
+        }
+    }
+
+    // The timer paces at clk_sys / divisor
+    uint32_t clock = clock_get_hz(clk_sys);
+    uint32_t divisor = (clock + BUZZER_SYNTH_RATE_HZ / 2) / BUZZER_SYNTH_RATE_HZ;
+    if (divisor > 0xFFFF) divisor = 0xFFFF;
+    dma_timer_set_fraction((uint)synth.timer, 1, (uint16_t)divisor);
+    synth.rate_hz = clock / divisor;
+    synth.shift = pwm_gpio_to_channel(BUZZER_PIN) == PWM_CHAN_B ? 16 : 0;
+    synth.attack_step = synth_envelope_step(attack_ms);
+    synth.release_step = synth_envelope_step(release_ms);
+    synth.gate = false;
+    synth.envelope = 0;
+    synth.phase = SYNTH_PHASE_SILENT;
+    synth.busy_us = 0;
+    synth.blocks_done = 0;
+
+    pwm_set_clkdiv_int_frac(buzzer.slice, 1, 0);
+    pwm_set_wrap(buzzer.slice, BUZZER_SYNTH_CARRIER_WRAP);
+    pwm_set_gpio_level(BUZZER_PIN, 0);
+
+    for (int i = 0; i < 2; ++i) {
+        synth_render(synth.blocks[i]);
+        dma_channel_config config = dma_channel_get_default_config((uint)synth.dma[i]);
+        channel_config_set_transfer_data_size(&config, DMA_SIZE_32);
+        channel_config_set_read_increment(&config, true);
+        channel_config_set_write_increment(&config, false);
+        channel_config_set_dreq(&config, dma_get_timer_dreq((uint)synth.timer));
+        channel_config_set_chain_to(&config, (uint)synth.dma[1 - i]);
+        dma_channel_configure((uint)synth.dma[i], &config, &pwm_hw->slice[buzzer.slice].cc, synth.blocks[i],
+                              BUZZER_SYNTH_BLOCK, false);
+        dma_channel_set_irq1_enabled((uint)synth.dma[i], true);
+    }
+    irq_add_shared_handler(DMA_IRQ_1, synth_dma_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_1, true);
+    synth.started_us = time_us_32();
+    synth.running = true;
+    dma_channel_start((uint)synth.dma[0]);
+    return true;
+}
+
+static void synth_stop(void) {
+    if (!synth.running) return;
+    synth.running = false;
+    for (int i = 0; i < 2; ++i) {
+        // Unchain first so an aborted channel does not start the other one again
+        dma_channel_set_irq1_enabled((uint)synth.dma[i], false);
+        dma_channel_config config = dma_get_channel_config((uint)synth.dma[i]);
+        channel_config_set_chain_to(&config, (uint)synth.dma[i]);
+        dma_channel_set_config((uint)synth.dma[i], &config, false);
+    }
+    for (int i = 0; i < 2; ++i) {
+        dma_channel_abort((uint)synth.dma[i]);
+        dma_channel_acknowledge_irq1((uint)synth.dma[i]);
+    }
+    irq_remove_handler(DMA_IRQ_1, synth_dma_handler);
+    synth_release();
+    pwm_set_gpio_level(BUZZER_PIN, 0);
+}
+
+// The smallest divider (in 1/16 steps) that fits one period in the 16-bit counter
+static bool buzzer_divider(uint32_t frequency, uint32_t *div16, uint32_t *top) {
+    if (frequency == 0) return false;
+    uint64_t clock16 = (uint64_t)clock_get_hz(clk_sys) * 16;
+    uint64_t div = (clock16 + (uint64_t)frequency * 65536 - 1) / ((uint64_t)frequency * 65536);
+    if (div < 16) div = 16;
+    if (div > 0xFFF) return false; // below about 8 Hz at 125 MHz
+    uint64_t period = clock16 / (div * frequency);
+    if (period < 2) return false;
+    *div16 = (uint32_t)div;
+    *top = (uint32_t)period;
+    return true;
+}
+
+// Whether the buzzer can make the frequency with the current waveform
+static bool buzzer_can_play(uint32_t frequency) {
+    uint32_t div16, top;
+    if (synth.running) return frequency > 0 && frequency < synth.rate_hz / 2;
+    return buzzer_divider(frequency, &div16, &top);
+}
+
+static bool buzzer_set_frequency(uint32_t frequency) {
+    if (synth.running) {
+        if (!buzzer_can_play(frequency)) return false;
+        synth.increment = (uint32_t)(((uint64_t)frequency << 32) / synth.rate_hz);
+        synth.gate = true;
+        return true;
+    }
+    uint32_t div16, top;
+    if (!buzzer_divider(frequency, &div16, &top)) return false;
+    pwm_set_clkdiv_int_frac(buzzer.slice, (uint8_t)(div16 >> 4), (uint8_t)(div16 & 0xF));
+    pwm_set_wrap(buzzer.slice, (uint16_t)(top - 1));
+    pwm_set_gpio_level(BUZZER_PIN, (uint16_t)(top / 2));
+    return true;
+}
+
+// Silence: level 0, or the release of the envelope
+static void buzzer_mute(void) {
+    if (synth.running) {
+        synth.gate = false;
+    } else {
+        pwm_set_gpio_level(BUZZER_PIN, 0);
+    }
+}
+
+// Moves the deadline by ms and arms the alarm for it. Counting from the deadline
+// instead of the interrupt keeps the rhythm from drifting by the interrupt latency.
+// Returns false if the time is already over (0 ms, or the interrupt came that late).
+static bool buzzer_arm(uint32_t ms) {
+    if (ms == 0) return false;
+    buzzer.deadline = delayed_by_ms(buzzer.deadline, ms);
+    return !hardware_alarm_set_target((uint)buzzer.alarm, buzzer.deadline);
+}
+
+// Starts the gap or the next note, the next queued sequence when one ends, and arms
+// the alarm for its end. Called with the buzzer locked.
+static void buzzer_advance(void) {
+    for (;;) {
+        buzzer_sequence_t *sequence = &buzzer.current;
+        if (buzzer.gap_next) {
+            buzzer.gap_next = false;
+            buzzer_mute();
+            const buzzer_note_t *played = &sequence->notes[buzzer.index - 1];
+            if (played->led == BUZZER_LED_KEYED) set_red_led_status(false);
+            if (buzzer_arm(played->gap_ms)) return;
+            continue;
+        }
+        if (sequence->notes != NULL && buzzer.index >= sequence->count) {
+            sequence->notes = NULL;
+        }
+        if (sequence->notes == NULL) {
+            if (buzzer.queued == 0) {
+                buzzer_mute();
+                buzzer.playing = false;
+                return;
+            }
+            *sequence = buzzer.queue[buzzer.queue_head];
+            buzzer.queue_head = (uint8_t)((buzzer.queue_head + 1) % BUZZER_SEQUENCE_QUEUE_LENGTH);
+            buzzer.queued--;
+            buzzer.index = 0;
+        }
+
+        const buzzer_note_t *note = &sequence->notes[buzzer.index++];
+        if (note->led != BUZZER_LED_KEEP) {
+            set_red_led_status(note->led == BUZZER_LED_ON || note->led == BUZZER_LED_KEYED);
+        }
+        if (!buzzer_set_frequency(note->frequency)) {
+            buzzer_mute(); // rest
+        }
+        buzzer.playing = true;
+        buzzer.gap_next = true;
+        if (buzzer_arm(note->duration_ms)) return;
+    }
+}
+
+static void buzzer_alarm_callback(uint alarm_num) {
+    (void)alarm_num;
+    UBaseType_t state = taskENTER_CRITICAL_FROM_ISR();
+    buzzer_advance();
+    taskEXIT_CRITICAL_FROM_ISR(state);
+}
+
+// Plays the sequence now if it has a higher priority than the one playing (or
+// replace is set and the priority is the same), otherwise queues it
+static int buzzer_submit(const buzzer_note_t *notes, size_t count, uint8_t priority, bool replace) {
+    if (buzzer.alarm < 0 || notes == NULL || count == 0 || count > UINT16_MAX) return PICO_ERROR_GENERIC;
+
+    buzzer_sequence_t sequence = { .notes = notes, .count = (uint16_t)count, .priority = priority };
+    int result = 0;
+    taskENTER_CRITICAL();
+    const buzzer_sequence_t *current = &buzzer.current;
+    if (current->notes == NULL || priority > current->priority || (replace && priority == current->priority)) {
+        hardware_alarm_cancel((uint)buzzer.alarm);
+        buzzer.current = sequence;
+        buzzer.index = 0;
+        buzzer.gap_next = false;
+        buzzer.deadline = get_absolute_time();
+        buzzer_advance();
+    } else if (buzzer.queued < BUZZER_SEQUENCE_QUEUE_LENGTH) {
+        uint8_t tail = (uint8_t)((buzzer.queue_head + buzzer.queued) % BUZZER_SEQUENCE_QUEUE_LENGTH);
+        buzzer.queue[tail] = sequence;
+        buzzer.queued++;
+    } else {
+        result = PICO_ERROR_GENERIC;
+    }
+    taskEXIT_CRITICAL();
+    return result;
+}
+
  void init_buzzer() {
-    // Initialize the buzzer pin as an output
-    gpio_init(BUZZER_PIN);
-    gpio_set_dir(BUZZER_PIN, GPIO_OUT);
+    gpio_set_function(BUZZER_PIN, GPIO_FUNC_PWM);
+    buzzer.slice = pwm_gpio_to_slice_num(BUZZER_PIN);
+    pwm_set_gpio_level(BUZZER_PIN, 0);
+    pwm_set_enabled(buzzer.slice, true);
+    buzzer.playing = false;
+
+    if (buzzer.alarm < 0) {
+        buzzer.alarm = hardware_alarm_claim_unused(false);
+        if (buzzer.alarm >= 0) hardware_alarm_set_callback((uint)buzzer.alarm, buzzer_alarm_callback);
+    }
 }
 
- void buzzer_play_tone(uint32_t frequency, uint32_t duration_ms) {
-    // Calculate the period (in microseconds) and number of cycles
-    uint32_t period_us = 1000000 / frequency;
-    uint32_t num_cycles = duration_ms * frequency / 1000;
+int buzzer_start_tone(uint32_t frequency, uint32_t duration_ms) {
+    if (duration_ms == 0 || duration_ms > UINT16_MAX || frequency > UINT16_MAX || !buzzer_can_play(frequency)) {
+        return PICO_ERROR_GENERIC;
+    }
+    taskENTER_CRITICAL();
+    buzzer.tone = (buzzer_note_t) { .frequency = (uint16_t)frequency, .duration_ms = (uint16_t)duration_ms };
+    taskEXIT_CRITICAL();
+    return buzzer_submit(&buzzer.tone, 1, BUZZER_PRIORITY_TONE, true);
+}
 
-    // Generate the tone by toggling the buzzer pin at the specified frequency
-    for (uint32_t i = 0; i < num_cycles; i++) {
-        gpio_put(BUZZER_PIN, 1);
-        busy_wait_us(period_us / 2);
-        gpio_put(BUZZER_PIN, 0);
-        busy_wait_us(period_us / 2);
+int buzzer_play_sequence(const buzzer_note_t *notes, size_t count, uint8_t priority) {
+    if (priority >= BUZZER_PRIORITY_TONE) priority = BUZZER_PRIORITY_TONE - 1;
+    return buzzer_submit(notes, count, priority, false);
+}
+
+bool buzzer_is_playing(void) {
+    return buzzer.playing;
+}
+
+ void buzzer_play_tone(uint32_t frequency, uint32_t duration_ms) {
+    // The alarm ends the tone, the calling task sleeps meanwhile
+    if (buzzer_start_tone(frequency, duration_ms) == 0) {
+        sleep_ms(duration_ms);
+        return;
+    }
+    if (buzzer.alarm < 0 && buzzer_set_frequency(frequency)) {
+        sleep_ms(duration_ms);
+        buzzer_mute();
     }
 }
 
  void buzzer_turn_off() {
-    // Turn off the buzzer by setting the pin to low
-    gpio_put(BUZZER_PIN, 0);
+    taskENTER_CRITICAL();
+    if (buzzer.alarm >= 0) hardware_alarm_cancel((uint)buzzer.alarm);
+    buzzer.current.notes = NULL;
+    buzzer.gap_next = false;
+    buzzer.queued = 0;
+    buzzer_mute();
+    buzzer.playing = false;
+    taskEXIT_CRITICAL();
+}
+
+int buzzer_set_waveform(buzzer_waveform_t waveform, uint16_t attack_ms, uint16_t release_ms) {
+    buzzer_turn_off();
+    synth_stop();
+    if (waveform == BUZZER_WAVE_SQUARE) return 0;
+    return synth_start(attack_ms, release_ms) ? 0 : PICO_ERROR_GENERIC;
+}
+
+void buzzer_get_synth_stats(buzzer_synth_stats_t *stats) {
+    if (stats == NULL) return;
+    stats->blocks = synth.blocks_done;
+    stats->busy_us = synth.busy_us;
+    stats->elapsed_us = synth.running ? time_us_32() - synth.started_us : 0;
 }
 
 void deinit_buzzer() {
-    // Deinitialize the buzzer pin
+    buzzer_turn_off();
+    synth_stop();
+    pwm_set_enabled(buzzer.slice, false);
+    if (buzzer.alarm >= 0) {
+        hardware_alarm_set_callback((uint)buzzer.alarm, NULL);
+        hardware_alarm_unclaim((uint)buzzer.alarm);
+        buzzer.alarm = -1;
+    }
     gpio_deinit(BUZZER_PIN);
 }
 
@@ -248,28 +616,227 @@ void deinit_buzzer() {
  *  I2C
  * ========================= */
 // Initialize I2C peripheral
+// Bus profiles of the HAT devices. The ICM-42670 and the SSD1306 run at the speed of
+// their BAUDRATE define, the environmental sensors are specified up to 400 kHz.
+static const i2c_bus_profile_t imu_bus_profile = {
+    .client = I2C_BUS_CLIENT_IMU, .baudrate = ICM42670_I2C_BAUDRATE, .timeout_ms = 10, .retries = 1,
+};
+static const i2c_bus_profile_t sensor_bus_profile = {
+    .client = I2C_BUS_CLIENT_SENSORS, .baudrate = I2C_BUS_DEFAULT_BAUDRATE, .timeout_ms = 20, .retries = 2,
+};
+static const i2c_bus_profile_t display_bus_profile = {
+    .client = I2C_BUS_CLIENT_DISPLAY, .baudrate = SSD1306_I2C_BAUDRATE, .timeout_ms = 50, .retries = 0,
+};
+
 void init_i2c(uint sda_pin, uint scl_pin) {
-    i2c_init(i2c_default, 400*1000);
+    i2c_init(i2c_default, I2C_BUS_DEFAULT_BAUDRATE);
     gpio_set_function(sda_pin, GPIO_FUNC_I2C);
     gpio_set_function(scl_pin, GPIO_FUNC_I2C);
     gpio_pull_up(sda_pin);
     gpio_pull_up(scl_pin);
+    // DMA + interrupt driven transfers. Falls back to blocking transfers if it cannot start.
+    i2c_bus_init(i2c_default);
+    // Arbitration classes and speeds, the IMU is served first and display frames last
+    i2c_bus_register_device(ICM42670_I2C_ADDRESS, &imu_bus_profile);
+    i2c_bus_register_device(ICM42670_I2C_ADDRESS_ALT, &imu_bus_profile);
+    i2c_bus_register_device(HDC2021_I2C_ADDRESS, &sensor_bus_profile);
+    i2c_bus_register_device(VEML6030_I2C_ADDR, &sensor_bus_profile);
+    i2c_bus_register_device(SSD1306_I2C_ADDRESS, &display_bus_profile);
 }
 
 void init_i2c_default(){
     init_i2c(DEFAULT_I2C_SDA_PIN, DEFAULT_I2C_SCL_PIN);
 }
 
+// A transfer without STOP keeps the bus until the one that ends with a STOP. A failed
+// transfer has ended the sequence (the controller sends a STOP when it aborts), so
+// the bus goes back to the engine even if the caller just returns.
+static bool i2c_direct_done(bool ok, bool nostop) {
+    if (!nostop || !ok) {
+        i2c_default->restart_on_next = false;
+        i2c_bus_release();
+    }
+    return ok;
+}
+
 // Generic I2C write function
+// Complete transfers go through the transaction engine. A transfer without STOP keeps
+// the bus (i2c_bus_acquire) until the transfer that ends with a STOP.
 bool i2c_write(uint8_t addr, const uint8_t *src, size_t len, bool nostop) {
+    if (!nostop && !i2c_default->restart_on_next) {
+        return i2c_bus_transfer(addr, src, len, NULL, 0) == (int)len;
+    }
+    if (i2c_bus_acquire(addr) < 0) {
+        return false;
+    }
     int bytes_written = i2c_write_blocking(i2c_default, addr, src, len, nostop);
-    return bytes_written == (int)len;
+    return i2c_direct_done(bytes_written == (int)len, nostop);
 }
 
 // Generic I2C read function
 bool i2c_read(uint8_t addr, uint8_t *dst, size_t len, bool nostop) {
+    if (!nostop && !i2c_default->restart_on_next) {
+        return i2c_bus_transfer(addr, NULL, 0, dst, len) == (int)len;
+    }
+    if (i2c_bus_acquire(addr) < 0) {
+        return false;
+    }
     int bytes_read = i2c_read_blocking(i2c_default, addr, dst, len, nostop);
-    return bytes_read == (int)len;
+    return i2c_direct_done(bytes_read == (int)len, nostop);
+}
+
+// Write (e.g. register address) + repeated start + read as one transaction
+bool i2c_write_read(uint8_t addr, const uint8_t *src, size_t src_len, uint8_t *dst, size_t dst_len) {
+    return i2c_bus_transfer(addr, src, src_len, dst, dst_len) == (int)(src_len + dst_len);
+}
+
+/* =========================
+ *  REGISTER SHADOW CACHE
+ * ========================= */
+// Keeps a copy of the configuration registers of a device, so setters do not need a
+// read-modify-write over I2C each time. Changes are staged in the shadow and written with
+// reg_shadow_flush(): registers whose value did not change are not written at all, and for
+// devices with register auto-increment consecutive dirty registers go out in one burst.
+// Only configuration registers belong here, data and status registers change on their own.
+
+#define REG_SHADOW_MAX_REGS     40
+#define REG_SHADOW_MAX_GAP      2   // clean registers rewritten to join two dirty runs
+
+// Read back and compare after every flush. Costs one read per burst.
+#ifndef TKJHAT_REG_SHADOW_VERIFY
+#define TKJHAT_REG_SHADOW_VERIFY false
+#endif
+
+typedef struct {
+    uint8_t address;                // I2C address of the device
+    uint8_t base;                   // first register of the window
+    uint8_t count;                  // registers in the window
+    uint8_t width;                  // register width in bytes (1 or 2, LSB first)
+    bool auto_increment;            // device supports burst writes over consecutive registers
+    const uint16_t *self_clearing;  // optional, bits per register that clear themselves after a write
+    uint64_t valid;                 // bit i: value[i] is known
+    uint64_t dirty;                 // bit i: value[i] has to be written
+    uint16_t value[REG_SHADOW_MAX_REGS];
+} reg_shadow_t;
+
+static inline int reg_shadow_index(const reg_shadow_t *sh, uint8_t reg) {
+    int i = (int)reg - sh->base;
+    return (i >= 0 && i < sh->count) ? i : -1;
+}
+
+static inline uint16_t reg_shadow_self_clearing(const reg_shadow_t *sh, int i) {
+    return sh->self_clearing ? sh->self_clearing[i] : 0;
+}
+
+// Forget everything, e.g. after a device reset
+static void reg_shadow_invalidate(reg_shadow_t *sh) {
+    sh->valid = 0;
+    sh->dirty = 0;
+}
+
+// Tell the shadow a register value without writing it (e.g. reset default)
+static void reg_shadow_seed(reg_shadow_t *sh, uint8_t reg, uint16_t value) {
+    int i = reg_shadow_index(sh, reg);
+    if (i < 0) return;
+    sh->value[i] = value;
+    sh->valid |= 1ull << i;
+    sh->dirty &= ~(1ull << i);
+}
+
+static int reg_shadow_read(reg_shadow_t *sh, uint8_t reg, uint16_t *value) {
+    int i = reg_shadow_index(sh, reg);
+    if (i < 0) return -1;
+    if (!(sh->valid & (1ull << i))) {
+        uint8_t data[2] = {0, 0};
+        if (!i2c_write_read(sh->address, &reg, 1, data, sh->width)) return -2;
+        sh->value[i] = sh->width == 2 ? (uint16_t)(data[0] | (data[1] << 8)) : data[0];
+        sh->valid |= 1ull << i;
+    }
+    *value = sh->value[i];
+    return 0;
+}
+
+static int reg_shadow_write(reg_shadow_t *sh, uint8_t reg, uint16_t value) {
+    int i = reg_shadow_index(sh, reg);
+    if (i < 0) return -1;
+    uint64_t bit = 1ull << i;
+    if ((sh->valid & bit) && sh->value[i] == value) return 0; // nothing changes
+    sh->value[i] = value;
+    sh->valid |= bit;
+    sh->dirty |= bit;
+    return 0;
+}
+
+static int reg_shadow_update_bits(reg_shadow_t *sh, uint8_t reg, uint16_t mask, uint16_t bits) {
+    uint16_t value;
+    int rc = reg_shadow_read(sh, reg, &value);
+    if (rc != 0) return rc;
+    return reg_shadow_write(sh, reg, (uint16_t)((value & ~mask) | (bits & mask)));
+}
+
+static int reg_shadow_verify(reg_shadow_t *sh, int first, int last) {
+    uint8_t reg = (uint8_t)(sh->base + first);
+    uint8_t data[REG_SHADOW_MAX_REGS * 2];
+    size_t len = (size_t)(last - first + 1) * sh->width;
+    if (!i2c_write_read(sh->address, &reg, 1, data, len)) return -2;
+
+    int rc = 0;
+    for (int i = first; i <= last; i++) {
+        const uint8_t *d = &data[(i - first) * sh->width];
+        uint16_t actual = sh->width == 2 ? (uint16_t)(d[0] | (d[1] << 8)) : d[0];
+        uint16_t ignore = reg_shadow_self_clearing(sh, i);
+        if ((actual & ~ignore) != (sh->value[i] & ~ignore)) {
+            sh->valid &= ~(1ull << i); // read it again next time
+            rc = -3;
+        }
+    }
+    return rc;
+}
+
+// Write all dirty registers. Returns 0 on success, negative if a write or the verify failed.
+static int reg_shadow_flush(reg_shadow_t *sh, bool verify) {
+    int rc = 0;
+    int i = 0;
+    while (i < sh->count) {
+        if (!(sh->dirty & (1ull << i))) {
+            i++;
+            continue;
+        }
+
+        // Collect a run. Known clean registers between two dirty ones are written again
+        // if that saves a transaction.
+        int first = i, last = i;
+        if (sh->auto_increment) {
+            for (int j = first + 1; j < sh->count; j++) {
+                uint64_t bit = 1ull << j;
+                if (!(sh->valid & bit) || j - last > REG_SHADOW_MAX_GAP) break;
+                if (sh->dirty & bit) last = j;
+            }
+        }
+
+        uint8_t buf[1 + REG_SHADOW_MAX_REGS * 2];
+        size_t len = 0;
+        buf[len++] = (uint8_t)(sh->base + first);
+        for (int j = first; j <= last; j++) {
+            buf[len++] = (uint8_t)(sh->value[j] & 0xFF);
+            if (sh->width == 2) buf[len++] = (uint8_t)(sh->value[j] >> 8);
+        }
+
+        if (!i2c_write(sh->address, buf, len, false)) {
+            rc = -1; // keep the run dirty, next flush retries
+        } else {
+            for (int j = first; j <= last; j++) {
+                sh->dirty &= ~(1ull << j);
+                sh->value[j] &= ~reg_shadow_self_clearing(sh, j);
+            }
+            if (verify) {
+                int vrc = reg_shadow_verify(sh, first, last);
+                if (vrc != 0 && rc == 0) rc = vrc;
+            }
+        }
+        i = last + 1;
+    }
+    return rc;
 }
 
 /* =========================
@@ -280,6 +847,17 @@ bool i2c_read(uint8_t addr, uint8_t *dst, size_t len, bool nostop) {
 // Microphone related functions
 // Sample rate: 16Khz
 // Buffer size: 256 samples.
+// set_microphone_lowpass() turns on a low-pass (biquad of dsp.c) for the samples as they are read.
+static dsp_biquad_q14_t mic_lowpass;
+static bool mic_lowpass_enabled;
+
+void set_microphone_lowpass(uint32_t cutoff_hz) {
+    mic_lowpass_enabled = false;
+    if (cutoff_hz == 0) return;
+    dsp_biquad_lowpass_q14(&mic_lowpass, cutoff_hz, MEMS_SAMPLING_FREQUENCY);
+    mic_lowpass_enabled = true;
+}
+
  int init_pdm_microphone() {
     const struct pdm_microphone_config config = {
     // GPIO pin for the PDM DAT signal
@@ -301,6 +879,7 @@ bool i2c_read(uint8_t addr, uint8_t *dst, size_t len, bool nostop) {
     .sample_buffer_size = MEMS_BUFFER_SIZE,
     };
 
+    set_microphone_lowpass(MEMS_LOWPASS_DEFAULT_HZ);
     return pdm_microphone_init(&config);
    
 }
@@ -318,7 +897,15 @@ void pdm_microphone_set_callback(pdm_samples_ready_handler_t handler) {
 }
 
 int get_microphone_samples(int16_t* buffer, size_t samples) {
-    return pdm_microphone_read(buffer,samples);
+    int read = pdm_microphone_read(buffer,samples);
+    if (read > 0 && mic_lowpass_enabled) {
+        dsp_biquad_q14(&mic_lowpass, buffer, buffer, (size_t)read);
+    }
+    return read;
+}
+
+uint16_t get_microphone_level(const int16_t *buffer, size_t samples) {
+    return dsp_rms_q15(buffer, samples);
 }
 
 
@@ -329,6 +916,56 @@ int get_microphone_samples(int16_t* buffer, size_t samples) {
 // Library used can be found at: https://github.com/daschr/pico-ssd1306https://github.com/daschr/pico-ssd1306
  static ssd1306_t disp;
 
+typedef enum {
+    DISPLAY_CMD_CLEAR,
+    DISPLAY_CMD_TEXT,
+    DISPLAY_CMD_LINE,
+    DISPLAY_CMD_SQUARE,
+    DISPLAY_CMD_CIRCLE,
+    DISPLAY_CMD_SPRITE,
+    DISPLAY_CMD_POWER_OFF,
+    DISPLAY_CMD_TICKER,
+    DISPLAY_CMD_FRAME_BEGIN,
+    DISPLAY_CMD_FRAME_END,
+} display_command_type_t;
+
+// One call of the display API, queued to the display task when the service runs
+typedef struct {
+    display_command_type_t type;
+    int32_t x0, y0, x1, y1;     // line end points, square size in x1/y1, circle radius or sprite id in x1
+    uint8_t scale;
+    bool fill;
+    uint16_t dwell_ms;          // time the result stays on screen before the next command
+    char text[DISPLAY_TEXT_MAX_LENGTH + 1];
+    uint8_t *strip;             // ticker: rendered text, the display task frees it (NULL: stop)
+} display_command_t;
+
+#define DISPLAY_DWELL_POLL_MS   10
+
+// Text scrolled by the display task. The strip has the text followed by one
+// display width of empty columns, a frame shows the columns offset .. offset+width-1.
+typedef struct {
+    uint8_t *strip;             // NULL: no ticker
+    uint32_t strip_width;
+    uint32_t text_width;
+    uint32_t char_width;
+    uint32_t offset;
+    uint8_t page, pages;
+    uint16_t speed;             // pixels per second
+    TickType_t start;
+} display_ticker_t;
+
+static struct {
+    QueueHandle_t queue;        // NULL: service not running, the API draws directly
+    TickType_t frame_ticks;
+    display_service_stats_t stats;
+    display_ticker_t ticker;
+    volatile int32_t ticker_position;   // character at the left edge, -1: no ticker
+    uint8_t frame_depth;        // open display_frame_begin() calls, nothing is sent while > 0
+    volatile uint8_t frames_open;   // frame begins submitted but not ended yet, on the side of the callers
+    uint16_t frame_dwell_ms;    // longest dwell of the commands in the open frame
+} display_service;
+
 // Display-related functions
  void init_display() {
     // Initialize the SSD1306 display with external VCC
@@ -340,37 +977,7 @@ int get_microphone_samples(int16_t* buffer, size_t samples) {
 
     // Clear the display
     ssd1306_clear(&disp);
-}
-
-
-void write_text_xy(int16_t x0, int16_t y0, const char *text) {
-    if (!text) return;
-
-    // Clamp negatives (library expects unsigned)
-    if (x0 < 0) x0 = 0;
-    if (y0 < 0) y0 = 0;
-
-    const uint8_t scale = 1; //Default font scale is 1
-
-    ssd1306_draw_string(&disp, (uint32_t)x0, (uint32_t)y0, scale, text);
-    ssd1306_show(&disp);
-
-    // Delay for 800 milliseconds
-    sleep_ms(800);
-}
-
-void write_text(const char *text) {
-
-    if (!text)return;
-
-    // Draw the text at the specified position with a font size of 2
-    ssd1306_draw_string(&disp, 8, 24, 2, text);
-
-    // Update the display
-    ssd1306_show(&disp);
-
-    // Delay for 800 milliseconds
-    sleep_ms(800);
+    display_service.ticker_position = -1;
 }
 
 /**
@@ -397,41 +1004,69 @@ static inline void putp(int16_t x, int16_t y) {
 }
 
 /**
- * @brief Draw a clipped horizontal span into the off-screen buffer.
+ * @brief Draw a clipped vertical span into the off-screen buffer.
  *
- * Draws solid pixels from x1 to x2 inclusive on row y. The span is clipped
- * to display bounds; fully off-screen spans are skipped.
+ * Draws solid pixels from y1 to y2 inclusive in column x. The span is clipped
+ * to display bounds; fully off-screen spans are skipped. The pixels are ORed
+ * into the buffer one page (8 rows) at a time.
  *
  * Preconditions:
  *  - `disp` must be initialized.
  *
- * @param x1 Left end (can be < 0; will be clipped).
- * @param x2 Right end (can be >= width; will be clipped).
- * @param y  Row index (0 .. disp.height-1). Outside rows are ignored.
+ * @param x  Column index (0 .. disp.width-1). Outside columns are ignored.
+ * @param y1 Top end (can be < 0; will be clipped).
+ * @param y2 Bottom end (can be >= height; will be clipped).
  *
  * @note No ssd1306_show() here; meant for filled-shape routines.
  */
-static inline void hspan(int16_t x1, int16_t x2, int16_t y) {
-    if (y < 0 || y >= (int16_t)disp.height) return;
-    if (x1 > x2) { int16_t t = x1; x1 = x2; x2 = t; }
-    if (x2 < 0 || x1 >= (int16_t)disp.width) return;
-    if (x1 < 0) x1 = 0;
-    if (x2 >= (int16_t)disp.width) x2 = (int16_t)disp.width - 1;
-
-    for (int16_t x = x1; x <= x2; ++x)
-        ssd1306_draw_pixel(&disp, (uint32_t)x, (uint32_t)y);
+static inline void vspan(int16_t x, int16_t y1, int16_t y2) {
+    ssd1306_fill_rect(&disp, x, y1, x, y2, true);
 }
 
+/**
+ * @brief Fill a circle column by column.
+ *
+ * Walks the same midpoint circle as the outline in render_circle(). Every column
+ * between two outline points is one vspan(), so a column costs at most one OR per
+ * page instead of one pixel per row.
+ */
+static void fill_circle(int16_t x0, int16_t y0, int16_t r) {
+    int16_t f = 1 - r;
+    int16_t ddF_x = 1;
+    int16_t ddF_y = -2 * r;
+    int16_t x = 0;
+    int16_t y = r;
 
-void draw_circle(int16_t x0, int16_t y0, int16_t r, bool fill) {
+    vspan(x0, (int16_t)(y0 - r), (int16_t)(y0 + r));  // center column
+
+    while (x < y) {
+        if (f >= 0) {
+            // Columns x0 +- y are done, they are as tall as x got
+            vspan((int16_t)(x0 + y), (int16_t)(y0 - x), (int16_t)(y0 + x));
+            vspan((int16_t)(x0 - y), (int16_t)(y0 - x), (int16_t)(y0 + x));
+            y--; ddF_y += 2; f += ddF_y;
+        }
+        x++; ddF_x += 2; f += ddF_x;
+
+        vspan((int16_t)(x0 + x), (int16_t)(y0 - y), (int16_t)(y0 + y));
+        vspan((int16_t)(x0 - x), (int16_t)(y0 - y), (int16_t)(y0 + y));
+    }
+    vspan((int16_t)(x0 + y), (int16_t)(y0 - x), (int16_t)(y0 + x));
+    vspan((int16_t)(x0 - y), (int16_t)(y0 - x), (int16_t)(y0 + x));
+}
+
+static void render_circle(int16_t x0, int16_t y0, int16_t r, bool fill) {
     // Draw a circle using the Bresenham algorithm
     if (r < 0) 
         return;
     if (r == 0) { 
         putp(x0, y0); 
-        ssd1306_show(&disp); 
         return; 
     }
+    if (fill) {
+        fill_circle(x0, y0, r);
+        return;
+    }
 
     // Midpoint circle algorithm
     int16_t f = 1 - r;
@@ -440,66 +1075,479 @@ void draw_circle(int16_t x0, int16_t y0, int16_t r, bool fill) {
     int16_t x = 0;
     int16_t y = r;
 
-    if (fill) {
-        hspan((int16_t)(x0 - r), (int16_t)(x0 + r), y0);  // center row
-    } else {
-        putp(x0, (int16_t)(y0 + r));
-        putp(x0, (int16_t)(y0 - r));
-        putp((int16_t)(x0 + r), y0);
-        putp((int16_t)(x0 - r), y0);
-    }
+    putp(x0, (int16_t)(y0 + r));
+    putp(x0, (int16_t)(y0 - r));
+    putp((int16_t)(x0 + r), y0);
+    putp((int16_t)(x0 - r), y0);
 
     while (x < y) {
         if (f >= 0) { y--; ddF_y += 2; f += ddF_y; }
         x++; ddF_x += 2; f += ddF_x;
 
-        if (fill) {
-            hspan((int16_t)(x0 - x), (int16_t)(x0 + x), (int16_t)(y0 + y));
-            hspan((int16_t)(x0 - x), (int16_t)(x0 + x), (int16_t)(y0 - y));
-            hspan((int16_t)(x0 - y), (int16_t)(x0 + y), (int16_t)(y0 + x));
-            hspan((int16_t)(x0 - y), (int16_t)(x0 + y), (int16_t)(y0 - x));
+        putp((int16_t)(x0 + x), (int16_t)(y0 + y));
+        putp((int16_t)(x0 - x), (int16_t)(y0 + y));
+        putp((int16_t)(x0 + x), (int16_t)(y0 - y));
+        putp((int16_t)(x0 - x), (int16_t)(y0 - y));
+        putp((int16_t)(x0 + y), (int16_t)(y0 + x));
+        putp((int16_t)(x0 - y), (int16_t)(y0 + x));
+        putp((int16_t)(x0 + y), (int16_t)(y0 - x));
+        putp((int16_t)(x0 - y), (int16_t)(y0 - x));
+    }
+}
+
+static void display_ticker_stop_now(void) {
+    free(display_service.ticker.strip);
+    display_service.ticker.strip = NULL;
+    display_service.ticker_position = -1;
+}
+
+// Copies the window of the current time to the frame buffer, true if the frame changed
+static bool display_ticker_step(bool first) {
+    display_ticker_t *t = &display_service.ticker;
+    TickType_t elapsed = xTaskGetTickCount() - t->start;
+    uint64_t offset = (uint64_t)elapsed * t->speed / configTICK_RATE_HZ;
+    if (offset > t->text_width) offset = t->text_width;
+    if (!first && offset == t->offset) return false;
+
+    // Page-wise copy, the diff in ssd1306_show_start() sends what moved
+    t->offset = (uint32_t)offset;
+    ssd1306_blit_pages(&disp, 0, t->page, t->strip + t->offset, t->strip_width, disp.width, t->pages);
+    display_service.ticker_position = (int32_t)(t->offset / t->char_width);
+    if (t->offset == t->text_width) {
+        display_ticker_stop_now();
+    }
+    return true;
+}
+
+// Draws one command into the frame buffer, the panel is updated by the caller
+static void display_render(const display_command_t *cmd) {
+    switch (cmd->type) {
+        case DISPLAY_CMD_CLEAR:
+            display_ticker_stop_now();
+            ssd1306_clear(&disp);
+            break;
+        case DISPLAY_CMD_TEXT:
+            ssd1306_draw_string(&disp, (uint32_t)cmd->x0, (uint32_t)cmd->y0, cmd->scale, cmd->text);
+            break;
+        case DISPLAY_CMD_LINE:
+            ssd1306_draw_line(&disp, cmd->x0, cmd->y0, cmd->x1, cmd->y1);
+            break;
+        case DISPLAY_CMD_SQUARE:
+            if (cmd->fill)
+                ssd1306_draw_square(&disp, (uint32_t)cmd->x0, (uint32_t)cmd->y0, (uint32_t)cmd->x1, (uint32_t)cmd->y1);
+            else
+                ssd1306_draw_empty_square(&disp, (uint32_t)cmd->x0, (uint32_t)cmd->y0, (uint32_t)cmd->x1, (uint32_t)cmd->y1);
+            break;
+        case DISPLAY_CMD_CIRCLE:
+            render_circle((int16_t)cmd->x0, (int16_t)cmd->y0, (int16_t)cmd->x1, cmd->fill);
+            break;
+        case DISPLAY_CMD_SPRITE: {
+            const sprite_t *sprite = &sprites[cmd->x1];
+            ssd1306_blit_pages(&disp, (uint32_t)cmd->x0, (uint32_t)cmd->y0 / 8, sprite_atlas + sprite->offset,
+                               sprite->width, sprite->width, sprite->pages);
+            break;
+        }
+        case DISPLAY_CMD_POWER_OFF:
+            ssd1306_poweroff(&disp);
+            break;
+        case DISPLAY_CMD_TICKER:
+            display_ticker_stop_now();
+            if (cmd->strip == NULL) break;
+            display_service.ticker = (display_ticker_t) {
+                .strip = cmd->strip,
+                .strip_width = (uint32_t)cmd->x0,
+                .text_width = (uint32_t)cmd->x1,
+                .char_width = ssd1306_string_width(cmd->scale, " "),
+                .page = (uint8_t)(cmd->y0 / 8),
+                .pages = cmd->scale,
+                .speed = (uint16_t)cmd->y1,
+                .start = xTaskGetTickCount(),
+            };
+            display_ticker_step(true);
+            break;
+        case DISPLAY_CMD_FRAME_BEGIN:
+            display_service.frame_depth++;
+            break;
+        case DISPLAY_CMD_FRAME_END:
+            if (display_service.frame_depth > 0) display_service.frame_depth--;
+            break;
+    }
+    if (cmd->dwell_ms > display_service.frame_dwell_ms) {
+        display_service.frame_dwell_ms = cmd->dwell_ms;
+    }
+}
+
+// Queues the command to the display task, or draws it right away if the service is not running
+static void display_submit(const display_command_t *cmd) {
+    if (display_service.queue != NULL) {
+        // Frame markers and the commands of an open frame wait for room: a lost end
+        // would keep the frame open, a lost command would leave it incomplete
+        taskENTER_CRITICAL();
+        bool framed = display_service.frames_open > 0 || cmd->type == DISPLAY_CMD_FRAME_BEGIN;
+        if (cmd->type == DISPLAY_CMD_FRAME_BEGIN) {
+            display_service.frames_open++;
+        } else if (cmd->type == DISPLAY_CMD_FRAME_END && display_service.frames_open > 0) {
+            display_service.frames_open--;
+        }
+        taskEXIT_CRITICAL();
+        TickType_t wait = framed ? pdMS_TO_TICKS(DISPLAY_FRAME_SUBMIT_TIMEOUT_MS) : 0;
+        if (xQueueSend(display_service.queue, cmd, wait) != pdTRUE) {
+            taskENTER_CRITICAL();
+            display_service.stats.dropped++;
+            taskEXIT_CRITICAL();
+        }
+        return;
+    }
+    display_render(cmd);
+    display_service.stats.commands++;
+    if (display_service.frame_depth > 0) return;
+    if (cmd->type != DISPLAY_CMD_POWER_OFF) {
+        ssd1306_show(&disp);
+        display_service.stats.frames++;
+    }
+    if (display_service.frame_dwell_ms > 0) {
+        sleep_ms(display_service.frame_dwell_ms);
+        display_service.frame_dwell_ms = 0;
+    }
+}
+
+static TickType_t display_ticks_to_next_frame(TickType_t last_frame) {
+    TickType_t since = xTaskGetTickCount() - last_frame;
+    return since >= display_service.frame_ticks ? 0 : display_service.frame_ticks - since;
+}
+
+// Keeps the current frame on screen. When commands pile up the rest of the dwell
+// is skipped, so the display catches up instead of falling further behind.
+static void display_dwell(uint16_t dwell_ms) {
+    TickType_t start = xTaskGetTickCount();
+    TickType_t dwell = pdMS_TO_TICKS(dwell_ms);
+    TickType_t poll = pdMS_TO_TICKS(DISPLAY_DWELL_POLL_MS) > 0 ? pdMS_TO_TICKS(DISPLAY_DWELL_POLL_MS) : 1;
+    TickType_t elapsed;
+    while ((elapsed = xTaskGetTickCount() - start) < dwell) {
+        if (uxQueueMessagesWaiting(display_service.queue) >= DISPLAY_SERVICE_QUEUE_LENGTH / 2) {
+            display_service.stats.dwell_skipped++;
+            return;
+        }
+        TickType_t left = dwell - elapsed;
+        vTaskDelay(left < poll ? left : poll);
+    }
+}
+
+/*
+The display task owns the frame buffer. Commands are drawn as they arrive and the
+panel is updated at most once per frame period, so a burst of commands (clear,
+text, lines) goes out as one frame. A command with a dwell time is shown in its
+own frame and stays on screen before the next command is drawn.
+
+Frames are sent with ssd1306_show_start(): the DMA pushes the frame while the task
+already draws the next commands. Before a dwell the task sleeps until the I2C
+interrupt reports that the frame is on the panel.
+
+A running ticker is moved to the position of the current time once per frame.
+
+The commands are drawn into the buffer of disp and sent after the last one of a
+frame, so the panel only ever gets complete frames: all commands of a burst, or
+everything between display_frame_begin() and display_frame_end().
+ssd1306_show_start() copies the changed bytes for the DMA, so the next frame can
+be drawn while this one is on the bus.
+*/
+static void display_task(void *arg) {
+    (void)arg;
+    display_command_t cmd;
+    TickType_t last_frame = xTaskGetTickCount() - display_service.frame_ticks;
+    bool dirty = false;
+
+    for (;;) {
+        // An open frame is only sent when it is closed, the task waits for the end command.
+        // If it does not come in time, the frame is shown as it is.
+        bool animating = (dirty || display_service.ticker.strip != NULL) && display_service.frame_depth == 0;
+        TickType_t wait = animating ? display_ticks_to_next_frame(last_frame) : portMAX_DELAY;
+        if (display_service.frame_depth > 0) wait = pdMS_TO_TICKS(DISPLAY_FRAME_TIMEOUT_MS);
+        uint16_t dwell_ms = 0;
+        if (xQueueReceive(display_service.queue, &cmd, wait) == pdTRUE) {
+            display_render(&cmd);
+            display_service.stats.commands++;
+            if (cmd.type != DISPLAY_CMD_POWER_OFF) dirty = true;
+            if (display_service.frame_depth > 0 || display_service.frame_dwell_ms == 0) continue;
+
+            // The result has to be on screen when the dwell starts
+            dwell_ms = display_service.frame_dwell_ms;
+            display_service.frame_dwell_ms = 0;
+            vTaskDelay(display_ticks_to_next_frame(last_frame));
+        } else if (display_service.frame_depth > 0) {
+            display_service.frame_depth = 0;
+            display_service.stats.frame_timeouts++;
+        }
+        if (display_service.frame_depth > 0) continue;
+        if (display_service.ticker.strip != NULL) {
+            if (display_ticker_step(false)) dirty = true;
+            else if (!dirty) last_frame = xTaskGetTickCount();  // nothing moved, look again next frame
+        }
+        if (dirty) {
+            ssd1306_show_start(&disp);
+            last_frame = xTaskGetTickCount();
+            display_service.stats.frames++;
+            dirty = false;
+        }
+        if (dwell_ms > 0) {
+            ssd1306_show_wait(&disp);
+            display_dwell(dwell_ms);
+        }
+    }
+}
+
+int display_service_start(uint32_t priority, uint32_t max_fps) {
+    if (disp.bufsize == 0) return -1;
+    if (display_service.queue != NULL) return 0;
+
+    if (max_fps == 0) max_fps = DISPLAY_SERVICE_MAX_FPS_DEFAULT;
+    TickType_t frame_ticks = pdMS_TO_TICKS(1000 / max_fps);
+    display_service.frame_ticks = frame_ticks > 0 ? frame_ticks : 1;
+
+    QueueHandle_t queue = xQueueCreate(DISPLAY_SERVICE_QUEUE_LENGTH, sizeof(display_command_t));
+    if (queue == NULL) return -2;
+    display_service.queue = queue;
+    if (xTaskCreate(display_task, "display", DISPLAY_SERVICE_STACK_SIZE, NULL, priority, NULL) != pdPASS) {
+        display_service.queue = NULL;
+        vQueueDelete(queue);
+        return -2;
+    }
+    return 0;
+}
+
+void display_service_get_stats(display_service_stats_t *stats) {
+    taskENTER_CRITICAL();
+    *stats = display_service.stats;
+    stats->draws = disp.stats.draws;
+    stats->bytes = disp.stats.bytes;
+    taskEXIT_CRITICAL();
+}
+
+void display_frame_begin(void) {
+    display_submit(&(display_command_t) { .type = DISPLAY_CMD_FRAME_BEGIN });
+}
+
+void display_frame_end(void) {
+    display_submit(&(display_command_t) { .type = DISPLAY_CMD_FRAME_END });
+}
+
+int display_ticker_start(const char *text, int16_t y, uint8_t scale, uint16_t speed) {
+    if (disp.bufsize == 0 || text == NULL || scale == 0 || scale > 4 || speed == 0 || y < 0) return -1;
+
+    // Rendered once here, the display task only copies windows of the strip
+    uint32_t text_width = ssd1306_string_width(scale, text);
+    uint32_t strip_width = text_width + disp.width;
+    uint8_t *strip = calloc((size_t)strip_width * scale, 1);
+    if (strip == NULL) return -2;
+    ssd1306_render_string(strip, strip_width, scale, 0, scale, text);
+
+    display_command_t cmd = {
+        .type = DISPLAY_CMD_TICKER,
+        .x0 = (int32_t)strip_width,
+        .x1 = (int32_t)text_width,
+        .y0 = y,
+        .y1 = speed,
+        .scale = scale,
+        .strip = strip,
+    };
+    if (display_service.queue == NULL) {
+        display_submit(&cmd);
+        return 0;
+    }
+    display_service.ticker_position = 0;
+    if (xQueueSend(display_service.queue, &cmd, 0) != pdTRUE) {
+        display_service.ticker_position = -1;
+        free(strip);
+        taskENTER_CRITICAL();
+        display_service.stats.dropped++;
+        taskEXIT_CRITICAL();
+        return -2;
+    }
+    return 0;
+}
+
+void display_ticker_stop(void) {
+    display_submit(&(display_command_t) { .type = DISPLAY_CMD_TICKER, .strip = NULL });
+}
+
+int32_t display_ticker_position(void) {
+    // Without the display task the ticker moves when it is polled
+    if (display_service.queue == NULL && display_service.ticker.strip != NULL &&
+        display_service.frame_depth == 0 && display_ticker_step(false)) {
+        ssd1306_show(&disp);
+        display_service.stats.frames++;
+    }
+    return display_service.ticker_position;
+}
+
+static void display_submit_text(int16_t x0, int16_t y0, uint8_t scale, const char *text) {
+    display_command_t cmd = {
+        .type = DISPLAY_CMD_TEXT,
+        .x0 = x0,
+        .y0 = y0,
+        .scale = scale,
+        .dwell_ms = DISPLAY_TEXT_DWELL_MS,
+    };
+    strncpy(cmd.text, text, DISPLAY_TEXT_MAX_LENGTH);
+    cmd.text[DISPLAY_TEXT_MAX_LENGTH] = '\0';
+    display_submit(&cmd);
+}
+
+void write_text_xy(int16_t x0, int16_t y0, const char *text) {
+    if (!text) return;
+
+    // Clamp negatives (library expects unsigned)
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+
+    const uint8_t scale = 1; //Default font scale is 1
+
+    display_submit_text(x0, y0, scale, text);
+}
+
+void write_text(const char *text) {
+
+    if (!text)return;
+
+    // Draw the text at the specified position with a font size of 2
+    display_submit_text(8, 24, 2, text);
+}
+
+void text_layout_init(text_layout_t *layout, uint8_t scale) {
+    if (scale < 1) scale = 1;
+    if (scale > 3) scale = 3;
+    layout->text[0] = '\0';
+    layout->length = 0;
+    layout->scale = scale;
+    // The font is fixed width, a line is measured once here
+    layout->columns = (uint8_t)((disp.width > 0 ? disp.width : 128) / ssd1306_string_width(scale, " "));
+    layout->rows = (uint8_t)((disp.pages > 0 ? disp.pages : 8) / scale);
+    if (layout->columns > DISPLAY_TEXT_MAX_LENGTH) layout->columns = DISPLAY_TEXT_MAX_LENGTH;
+    layout->line_count = 0;
+}
+
+// Greedy wrap from pos on, the lines before line_count are kept
+static void text_layout_wrap(text_layout_t *layout, uint16_t pos) {
+    const char *text = layout->text;
+    const uint16_t length = layout->length;
+    const uint16_t columns = layout->columns;
+
+    while (pos < length && layout->line_count < TEXT_LAYOUT_MAX_LINES) {
+        uint16_t end = pos;
+        int32_t lastSpace = -1;
+        while (end < length && text[end] != '\n' && end - pos < columns) {
+            if (text[end] == ' ') lastSpace = end;
+            end++;
+        }
+
+        uint16_t next;
+        if (end < length && text[end] != '\n' && text[end] != ' ' && lastSpace > pos) {
+            // the line is full in the middle of a word: break at the last space
+            end = (uint16_t)lastSpace;
+            next = end + 1;
+        } else if (end < length && (text[end] == '\n' || text[end] == ' ')) {
+            next = end + 1;
         } else {
-            putp((int16_t)(x0 + x), (int16_t)(y0 + y));
-            putp((int16_t)(x0 - x), (int16_t)(y0 + y));
-            putp((int16_t)(x0 + x), (int16_t)(y0 - y));
-            putp((int16_t)(x0 - x), (int16_t)(y0 - y));
-            putp((int16_t)(x0 + y), (int16_t)(y0 + x));
-            putp((int16_t)(x0 - y), (int16_t)(y0 + x));
-            putp((int16_t)(x0 + y), (int16_t)(y0 - x));
-            putp((int16_t)(x0 - y), (int16_t)(y0 - x));
+            next = end; // end of the text, or a word longer than a line
+        }
+        layout->lines[layout->line_count++] = (text_line_t) { .start = pos, .length = (uint8_t)(end - pos) };
+        pos = next;
+    }
+}
+
+uint16_t text_layout_update(text_layout_t *layout, const char *text) {
+    if (text == NULL) text = "";
+
+    // First character that differs from the laid out text
+    uint16_t changed = 0;
+    while (changed < layout->length && changed < TEXT_LAYOUT_MAX_LENGTH && text[changed] == layout->text[changed]) {
+        changed++;
+    }
+    uint16_t length = changed;
+    while (length < TEXT_LAYOUT_MAX_LENGTH && text[length] != '\0') {
+        layout->text[length] = text[length];
+        length++;
+    }
+    layout->text[length] = '\0';
+    if (length == layout->length && changed == length) {
+        return text_layout_pages(layout);
+    }
+    layout->length = length;
+
+    // The line with the change can move its first word up to the line before
+    uint16_t line = 0;
+    while (line + 1 < layout->line_count && layout->lines[line + 1].start <= changed) {
+        line++;
+    }
+    if (line > 0) line--;
+    uint16_t start = layout->line_count > 0 ? layout->lines[line].start : 0;
+    layout->line_count = line;
+    text_layout_wrap(layout, start);
+    return text_layout_pages(layout);
+}
+
+uint16_t text_layout_pages(const text_layout_t *layout) {
+    return (uint16_t)((layout->line_count + layout->rows - 1) / layout->rows);
+}
+
+int write_text_page(const text_layout_t *layout, uint16_t page) {
+    if (page >= text_layout_pages(layout)) return -1;
+
+    uint16_t first = (uint16_t)(page * layout->rows);
+    uint16_t last = first + layout->rows;
+    if (last > layout->line_count) last = layout->line_count;
+    int16_t lineHeight = 8 * layout->scale;
+
+    display_frame_begin();
+    clear_display();
+    for (uint16_t i = first; i < last; i++) {
+        const text_line_t *line = &layout->lines[i];
+        char text[DISPLAY_TEXT_MAX_LENGTH + 1];
+        memcpy(text, layout->text + line->start, line->length);
+        text[line->length] = '\0';
+        if (line->length > 0) {
+            display_submit_text(0, (int16_t)((i - first) * lineHeight), layout->scale, text);
         }
     }
-    ssd1306_show(&disp);  // remove if batching multiple draws
+    display_frame_end();
+    return layout->lines[first].start;
+}
+
+void draw_circle(int16_t x0, int16_t y0, int16_t r, bool fill) {
+    display_submit(&(display_command_t) {
+        .type = DISPLAY_CMD_CIRCLE, .x0 = x0, .y0 = y0, .x1 = r, .fill = fill,
+    });
 }
 
  void draw_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1) {
     // Draw a line between the specified points
-    ssd1306_draw_line(&disp, x0, y0, x1, y1);
+    display_submit(&(display_command_t) {
+        .type = DISPLAY_CMD_LINE, .x0 = x0, .y0 = y0, .x1 = x1, .y1 = y1,
+    });
+}
 
-    // Update the display
-    ssd1306_show(&disp);
+void draw_sprite(sprite_id_t id, int16_t x, int16_t y) {
+    if ((unsigned)id >= SPRITE_COUNT || x < 0 || y < 0) return;
+    display_submit(&(display_command_t) {
+        .type = DISPLAY_CMD_SPRITE, .x0 = x, .y0 = y, .x1 = id,
+    });
 }
 
  void draw_square(uint32_t x, uint32_t y, uint32_t w, uint32_t h, bool fill) {
     // Draw a square at the specified position with the given width and height
-    if (fill)
-        ssd1306_draw_square(&disp, x, y, w, h);
-    else
-        ssd1306_draw_empty_square(&disp, x, y, w, h);
-
-    // Update the display
-    ssd1306_show(&disp);
+    display_submit(&(display_command_t) {
+        .type = DISPLAY_CMD_SQUARE, .x0 = (int32_t)x, .y0 = (int32_t)y, .x1 = (int32_t)w, .y1 = (int32_t)h,
+        .fill = fill,
+    });
 }
 
 void clear_display() {
     // Clear the display
-    ssd1306_clear(&disp);
-    // Update the display
-    ssd1306_show(&disp);
+    display_submit(&(display_command_t) { .type = DISPLAY_CMD_CLEAR });
 }
 
 void stop_display() {
-    ssd1306_poweroff(&disp);
+    display_submit(&(display_command_t) { .type = DISPLAY_CMD_POWER_OFF });
 }
 
 
@@ -509,6 +1557,16 @@ void stop_display() {
 // Useful info at: https://learn.sparkfun.com/tutorials/qwiic-ambient-light-sensor-veml6030-hookup-guide/all#arduino-library
 // Programming application: https://www.vishay.com/docs/84367/designingveml6030.pdf
 // Datasheet: https://www.vishay.com/docs/84366/veml6030.pdf
+
+// 16-bit registers, written one at a time
+static reg_shadow_t veml6030_shadow = {
+    .address = VEML6030_I2C_ADDR,
+    .base = VEML6030_CONFIG_REG,
+    .count = 1,
+    .width = 2,
+    .auto_increment = false,
+};
+
 void init_veml6030() {
     // Configure sensor settings (100ms integration time, gain 1/8, power on)
     //Bit 12:11 = 10 (gain1/8)
@@ -518,14 +1576,11 @@ void init_veml6030() {
     //Bit 0 = 0 Power on
     // 0b0001 0000 0000 0000 -> =0x1000
 
-    uint8_t config[3] = {
-        VEML6030_CONFIG_REG,  // Configuration register
-        0x00,                 // High byte: Gain 1/8 (00), reserved bits
-        0x10                  // Low byte: 100ms integration time (010 in bits 6-8), power on (bit 0 = 0)
-    };
-    
+    // Sent LSB first: 0x00 (100ms integration time, power on (bit 0 = 0)), 0x10 (gain 1/8)
+    reg_shadow_write(&veml6030_shadow, VEML6030_CONFIG_REG, 0x1000);
+
     // Write configuration to sensor
-    i2c_write_blocking(i2c_default, VEML6030_I2C_ADDR, config, sizeof(config), false);
+    reg_shadow_flush(&veml6030_shadow, TKJHAT_REG_SHADOW_VERIFY);
     sleep_ms(10);
 }
 
@@ -558,13 +1613,11 @@ uint32_t veml6030_read_light() {
     uint8_t rxBuffer[2];
     txBuffer[0] = VEML6030_ALS_REG;
     uint16_t value = 0b0000000000000000;    
-    if (i2c_write_blocking(i2c_default, VEML6030_I2C_ADDR, txBuffer, 1, true) != PICO_ERROR_GENERIC) {
-        if (i2c_read_blocking(i2c_default, VEML6030_I2C_ADDR, rxBuffer, 2, false) != PICO_ERROR_GENERIC) {
-            value |= rxBuffer[1]; // MSB
-            value << 8;
-            value |= rxBuffer[0]; //LSB
-            value *= 0.5376;
-        }
+    if (i2c_write_read(VEML6030_I2C_ADDR, txBuffer, 1, rxBuffer, 2)) {
+        value |= rxBuffer[1]; // MSB
+        value << 8;
+        value |= rxBuffer[0]; //LSB
+        value *= 0.5376;
     }
 
     uint32_t luxVal_uncorrected = value; 
@@ -586,23 +1639,18 @@ uint32_t veml6030_read_light() {
 static uint16_t _veml6030_read_register(uint8_t reg) {
     uint8_t data[2] = {0,0};
 
-    // Select ALS output register
-    i2c_write_blocking(i2c_default, VEML6030_I2C_ADDR, &reg, 1, true);
-    // Read two bytes (MSB first)
-    i2c_read_blocking(i2c_default, VEML6030_I2C_ADDR, data, sizeof(data), false);
+    // Select ALS output register and read two bytes (MSB first)
+    i2c_write_read(VEML6030_I2C_ADDR, &reg, 1, data, sizeof(data));
     //data [0] contains the LSB and data[1] the MSB
     return ((uint16_t)data[0]) |((uint16_t) data[1]<<8);
 }
 
 void veml6030_stop(){
-    uint8_t config[3] = {
-        VEML6030_CONFIG_REG,  // Configuration register
-        0x00,                 // High byte: Gain 1/8 (00), reserved bits
-        0x11                  // Low byte: 100ms integration time (010 in bits 6-8), power on (bit 0 = 0). Power off (last bit to 1)
-    };
-    
+    // Sent LSB first: 0x00, 0x11 (gain 1/8, power off)
+    reg_shadow_write(&veml6030_shadow, VEML6030_CONFIG_REG, 0x1100);
+
     // Write configuration to sensor
-    i2c_write_blocking(i2c_default, VEML6030_I2C_ADDR, config, sizeof(config), false);
+    reg_shadow_flush(&veml6030_shadow, TKJHAT_REG_SHADOW_VERIFY);
     sleep_ms(10);
 }
 
@@ -616,72 +1664,83 @@ void veml6030_stop(){
 // https://www.ti.com/lit/ds/symlink/hdc2021.pdf?ts=1757522824481&ref_url=https%253A%252F%252Fwww.ti.com%252Fproduct%252FHDC2021
 // https://www.ti.com/lit/ug/snau250/snau250.pdf?ts=1757438909914
 
- static int8_t read_hdc2021_register(uint8_t reg) {
-    uint8_t data;
-    i2c_write(HDC2021_I2C_ADDRESS, &reg, 1, true);
-    i2c_read(HDC2021_I2C_ADDRESS, &data, 1, false);
-    return data;
-}
+// Configuration window from DEVICE_CONFIG to the last threshold register. The device
+// auto-increments the register address, so consecutive registers are written in one burst.
+#define HDC2021_SHADOW_COUNT (HDC2021_HUMID_THR_H - HDC2021_CONFIG + 1)
 
- static void write_register(uint8_t reg, uint8_t value) {
-    uint8_t data[2] = {reg, value};
-    i2c_write(HDC2021_I2C_ADDRESS, data, sizeof(data), false);
-}
+static const uint16_t hdc2021_self_clearing[HDC2021_SHADOW_COUNT] = {
+    [HDC2021_CONFIG - HDC2021_CONFIG] = 0x80,             // SOFT_RES
+    [HDC2021_MEASUREMENT_CONFIG - HDC2021_CONFIG] = 0x01, // MEAS_TRIG
+};
+
+static reg_shadow_t hdc2021_shadow = {
+    .address = HDC2021_I2C_ADDRESS,
+    .base = HDC2021_CONFIG,
+    .count = HDC2021_SHADOW_COUNT,
+    .width = 1,
+    .auto_increment = true,
+    .self_clearing = hdc2021_self_clearing,
+};
 
  static void hdc2021_reset() {
-    uint8_t configContents = read_hdc2021_register(HDC2021_CONFIG);
-    write_register(HDC2021_CONFIG, configContents | 0x80);
+    reg_shadow_update_bits(&hdc2021_shadow, HDC2021_CONFIG, 0x80, 0x80);
+    reg_shadow_flush(&hdc2021_shadow, false);
     sleep_ms(50);
+    // Registers are back at their reset values
+    reg_shadow_invalidate(&hdc2021_shadow);
+    reg_shadow_seed(&hdc2021_shadow, HDC2021_CONFIG, 0x00);
+    reg_shadow_seed(&hdc2021_shadow, HDC2021_MEASUREMENT_CONFIG, 0x00);
 }
 
+// The following setters only stage the change, call reg_shadow_flush() to write it.
 static void hdc2021_setMeasurementMode() {
-    uint8_t configContents = read_hdc2021_register(HDC2021_MEASUREMENT_CONFIG);
-    write_register(HDC2021_MEASUREMENT_CONFIG, configContents & 0xF9);
+    reg_shadow_update_bits(&hdc2021_shadow, HDC2021_MEASUREMENT_CONFIG, 0x06, 0x00);
 }
 
 static void hdc2021_setRate() {
-    uint8_t configContents = read_hdc2021_register(HDC2021_CONFIG);
-    configContents = (configContents & 0x8F) | 0x50; // Set 1 measurement/second
-    write_register(HDC2021_CONFIG, configContents);
+    reg_shadow_update_bits(&hdc2021_shadow, HDC2021_CONFIG, 0x70, 0x50); // Set 1 measurement/second
 }
 
 static void hdc2021_setTempRes() {
-    uint8_t configContents = read_hdc2021_register(HDC2021_MEASUREMENT_CONFIG);
-    write_register(HDC2021_MEASUREMENT_CONFIG, configContents & 0x3F); // 14-bit
+    reg_shadow_update_bits(&hdc2021_shadow, HDC2021_MEASUREMENT_CONFIG, 0xC0, 0x00); // 14-bit
 }
 
 static void hdc2021_setHumidityRes() {
-    uint8_t configContents = read_hdc2021_register(HDC2021_MEASUREMENT_CONFIG);
-    write_register(HDC2021_MEASUREMENT_CONFIG, configContents & 0xCF); // 14-bit
+    reg_shadow_update_bits(&hdc2021_shadow, HDC2021_MEASUREMENT_CONFIG, 0x30, 0x00); // 14-bit
 }
 
  static void hdc2021_triggerMeasurement() {
-    uint8_t configContents = read_hdc2021_register(HDC2021_MEASUREMENT_CONFIG);
-    write_register(HDC2021_MEASUREMENT_CONFIG, configContents | 0x01);
+    reg_shadow_update_bits(&hdc2021_shadow, HDC2021_MEASUREMENT_CONFIG, 0x01, 0x01);
 }
 
-void hdc2021_set_low_temp_threshold(float temp) {
+static uint8_t hdc2021_temp_to_threshold(float temp) {
     temp = (temp < -40.0f) ? -40.0f : (temp > 125.0f) ? 125.0f : temp;
-    uint8_t temp_thresh = (uint8_t)((temp + 40.0f) * 256.0f / 165.0f);
-    write_register(HDC2021_TEMP_THR_L, temp_thresh);
+    return (uint8_t)((temp + 40.0f) * 256.0f / 165.0f);
+}
+
+static uint8_t hdc2021_humidity_to_threshold(float humid) {
+    humid = (humid < 0.0f) ? 0.0f : (humid > 100.0f) ? 100.0f : humid;
+    return (uint8_t)(humid * 2.56f);
+}
+
+void hdc2021_set_low_temp_threshold(float temp) {
+    reg_shadow_write(&hdc2021_shadow, HDC2021_TEMP_THR_L, hdc2021_temp_to_threshold(temp));
+    reg_shadow_flush(&hdc2021_shadow, TKJHAT_REG_SHADOW_VERIFY);
 }
 
 void hdc2021_set_high_temp_threshold(float temp) {
-    temp = (temp < -40.0f) ? -40.0f : (temp > 125.0f) ? 125.0f : temp;
-    uint8_t temp_thresh = (uint8_t)((temp + 40.0f) * 256.0f / 165.0f);
-    write_register(HDC2021_TEMP_THR_H, temp_thresh);
+    reg_shadow_write(&hdc2021_shadow, HDC2021_TEMP_THR_H, hdc2021_temp_to_threshold(temp));
+    reg_shadow_flush(&hdc2021_shadow, TKJHAT_REG_SHADOW_VERIFY);
 }
 
 void hdc2021_set_high_humidity_threshold(float humid) {
-    humid = (humid < 0.0f) ? 0.0f : (humid > 100.0f) ? 100.0f : humid;
-    uint8_t humid_thresh = (uint8_t)(humid * 2.56f);
-    write_register(HDC2021_HUMID_THR_H, humid_thresh);
+    reg_shadow_write(&hdc2021_shadow, HDC2021_HUMID_THR_H, hdc2021_humidity_to_threshold(humid));
+    reg_shadow_flush(&hdc2021_shadow, TKJHAT_REG_SHADOW_VERIFY);
 }
 
 void hdc2021_set_low_humidity_threshold(float humid) {
-    humid = (humid < 0.0f) ? 0.0f : (humid > 100.0f) ? 100.0f : humid;
-    uint8_t humid_thresh = (uint8_t)(humid * 2.56f);
-    write_register(HDC2021_HUMID_THR_L, humid_thresh);
+    reg_shadow_write(&hdc2021_shadow, HDC2021_HUMID_THR_L, hdc2021_humidity_to_threshold(humid));
+    reg_shadow_flush(&hdc2021_shadow, TKJHAT_REG_SHADOW_VERIFY);
 }
 // By default it sets following modes: 
 // Measurement methods: Temp + Measurement
@@ -689,17 +1748,19 @@ void hdc2021_set_low_humidity_threshold(float humid) {
 // Temperature resolution: 14 bits
 // Humidity resolution: 14 bits
 // It triggers continous measurements. 
+// After the reset everything is staged in the shadow and written with two bursts.
  void init_hdc2021_() {
     hdc2021_reset();
-    hdc2021_set_high_temp_threshold(50);
-    hdc2021_set_low_temp_threshold(-30);
-    hdc2021_set_high_humidity_threshold(100);
-    hdc2021_set_low_humidity_threshold(0);
+    reg_shadow_write(&hdc2021_shadow, HDC2021_TEMP_THR_H, hdc2021_temp_to_threshold(50));
+    reg_shadow_write(&hdc2021_shadow, HDC2021_TEMP_THR_L, hdc2021_temp_to_threshold(-30));
+    reg_shadow_write(&hdc2021_shadow, HDC2021_HUMID_THR_H, hdc2021_humidity_to_threshold(100));
+    reg_shadow_write(&hdc2021_shadow, HDC2021_HUMID_THR_L, hdc2021_humidity_to_threshold(0));
     hdc2021_setMeasurementMode();
     hdc2021_setRate();
     hdc2021_setTempRes();
     hdc2021_setHumidityRes();
     hdc2021_triggerMeasurement();
+    reg_shadow_flush(&hdc2021_shadow, TKJHAT_REG_SHADOW_VERIFY);
 }
 
 // Note that sampling rate is 1Hz
@@ -707,8 +1768,7 @@ float hdc2021_read_temperature() {
     uint8_t reg = HDC2021_TEMP_LOW;
     uint8_t data[2];
     
-    i2c_write(HDC2021_I2C_ADDRESS, &reg, 1, true);
-    i2c_read(HDC2021_I2C_ADDRESS, data, 2, false);
+    i2c_write_read(HDC2021_I2C_ADDRESS, &reg, 1, data, 2);
     uint16_t raw = ((uint16_t) data[1] << 8) | data[0];
     return (raw * 165.0f / 65536.0f) - 40.0f;
 }
@@ -718,25 +1778,18 @@ float hdc2021_read_humidity() {
     uint8_t reg = HDC2021_HUMIDITY_LOW;
     uint8_t data[2];
     
-    i2c_write(HDC2021_I2C_ADDRESS, &reg, 1, true);
-    i2c_read(HDC2021_I2C_ADDRESS, data, 2, false);
+    i2c_write_read(HDC2021_I2C_ADDRESS, &reg, 1, data, 2);
     
     uint16_t raw = ((uint16_t) data[1] << 8) | data[0];
     return (raw * 100.0f / 65536.0f);
 }
 
 void stop_hdc2021() {
-    uint8_t cfg = read_hdc2021_register(HDC2021_CONFIG);  // 0x0E
-    cfg &= 0x8F;  // clear AMM[2:0] (bits 6:4) -> 000 = AMM disabled
-    write_register(HDC2021_CONFIG, cfg);
+    // clear AMM[2:0] (bits 6:4) -> 000 = AMM disabled
+    reg_shadow_update_bits(&hdc2021_shadow, HDC2021_CONFIG, 0x70, 0x00);  // 0x0E
     // Make sure we don't accidentally retrigger
-    uint8_t meas = read_hdc2021_register(HDC2021_MEASUREMENT_CONFIG); // 0x0F
-    meas &= (uint8_t)~0x01; // clear MEAS_TRIG (bit 0)
-    write_register(HDC2021_MEASUREMENT_CONFIG, meas);
-    //turn heater & DRDY pin off to minimize current
-    cfg &= ~(uint8_t)(1<<3); // HEAT_EN=0
-    cfg &= ~(uint8_t)(1<<2); // DRDY/INT_EN=0 (pin Hi-Z)
-
+    reg_shadow_update_bits(&hdc2021_shadow, HDC2021_MEASUREMENT_CONFIG, 0x01, 0x00); // 0x0F, MEAS_TRIG (bit 0)
+    reg_shadow_flush(&hdc2021_shadow, TKJHAT_REG_SHADOW_VERIFY);
 }
 
 /* =========================
@@ -751,43 +1804,70 @@ float aRes, gRes;      // scale resolutions per LSB for the sensors
 static int icm_i2c_write_byte(uint8_t reg, uint8_t value) {
     uint8_t buf[2] = { reg, value };
     //printf("Before writing to i2c reg:0x%x, val:0x%x\n", reg, value);
-    int result = i2c_write_blocking(i2c_default, ICM42670_I2C_ADDRESS, buf, 2, false);
+    int result = i2c_bus_transfer(ICM42670_I2C_ADDRESS, buf, 2, NULL, 0);
     //printf("After writing to i2c. Result: %d\n",result);
     return result == 2 ? 0 : -1;
 }
 
 // helper to read a byte from a register
 static int icm_i2c_read_byte(uint8_t reg, uint8_t *value) {
-    int result = i2c_write_blocking(i2c_default, ICM42670_I2C_ADDRESS, &reg, 1, true);
-    if (result != 1) return -1;
-    result = i2c_read_blocking(i2c_default, ICM42670_I2C_ADDRESS, value, 1, false);
-    return result == 1 ? 0 : -1;
+    int result = i2c_bus_transfer(ICM42670_I2C_ADDRESS, &reg, 1, value, 1);
+    return result == 2 ? 0 : -1;
 }
 
 static int icm_i2c_read_bytes(uint8_t reg, uint8_t *buffer, uint8_t len) {
-    int result = i2c_write_blocking(i2c_default, ICM42670_I2C_ADDRESS, &reg, 1, true);
-    if (result != 1) return -1;
-    result = i2c_read_blocking(i2c_default, ICM42670_I2C_ADDRESS, buffer, len, false);
-    return result == len ? 0 : -2;
+    int result = i2c_bus_transfer(ICM42670_I2C_ADDRESS, &reg, 1, buffer, len);
+    if (result == PICO_ERROR_GENERIC) return -1;
+    return result == 1 + len ? 0 : -2;
+}
+
+// Configuration window from INT_CONFIG (0x06) to INT_SOURCE1 (0x2C). Data registers inside
+// the window are never cached, so flushes do not bridge over them.
+static reg_shadow_t icm_shadow = {
+    .address = ICM42670_I2C_ADDRESS,
+    .base = ICM42670_INT_CONFIG,
+    .count = ICM42670_INT_SOURCE1_REG - ICM42670_INT_CONFIG + 1,
+    .width = 1,
+    .auto_increment = true,
+};
+
+// Write one configuration register through the shadow. Skipped if the value is already there.
+static int icm_write_config(uint8_t reg, uint8_t value) {
+    reg_shadow_write(&icm_shadow, reg, value);
+    return reg_shadow_flush(&icm_shadow, TKJHAT_REG_SHADOW_VERIFY) == 0 ? 0 : -1;
+}
+
+static int icm_read_config(uint8_t reg, uint8_t *value) {
+    uint16_t v;
+    if (reg_shadow_read(&icm_shadow, reg, &v) != 0) return -1;
+    *value = (uint8_t)v;
+    return 0;
 }
 
-static int icm_soft_reset(void) {
-    int rc = icm_i2c_write_byte(ICM42670_REG_SIGNAL_PATH_RESET, ICM42670_RESET_CONFIG_BITS);
-    if (rc != 0) 
-        return -1;
-    busy_wait_us(400);   // small wait: datasheet calls for ~200 µs before other writes
-    //Wait till the MCKL_READY is on (clock is running again)
-        // 2) Poll MCLK_RDY (Bank0 @ 0x00, bit3) with a short timeout
+// Poll MCLK_RDY (Bank0 @ 0x00, bit3) with a short timeout. MREG accesses need the clock.
+static int icm_wait_mclk_ready(void) {
     for (int i = 0; i < 100; ++i) {           // ~5 ms total @ 50 µs step
         uint8_t v = 0;
         if (icm_i2c_read_byte(0x00, &v) == 0 && (v & (1u << 3))) {
-            // 3) Give the spec'd settling gap before next writes
-            busy_wait_us(200);
             return 0;
         }
         busy_wait_us(50);
     }
-    return -2;
+    return -1;
+}
+
+static int icm_soft_reset(void) {
+    reg_shadow_invalidate(&icm_shadow);
+    int rc = icm_i2c_write_byte(ICM42670_REG_SIGNAL_PATH_RESET, ICM42670_RESET_CONFIG_BITS);
+    if (rc != 0) 
+        return -1;
+    busy_wait_us(400);   // small wait: datasheet calls for ~200 µs before other writes
+    //Wait till the MCKL_READY is on (clock is running again)
+    if (icm_wait_mclk_ready() != 0)
+        return -2;
+    // Give the spec'd settling gap before next writes
+    busy_wait_us(200);
+    return 0;
 }
 
 //TRY TO SOLVE PROBLEM OF FLOATING AD0 pin, JUST IN CASE THE ADDRESS IS CHANGING. 
@@ -798,8 +1878,7 @@ static int ICM42670_autodetect_address(void) {
         int hits = 0;
         for (int t = 0; t < 4; ++t) {
             uint8_t who = 0, reg = ICM42670_REG_WHO_AM_I;
-            if (i2c_write_blocking(i2c_default, cand[i], &reg, 1, true) != 1) continue;
-            if (i2c_read_blocking(i2c_default, cand[i], &who, 1, false) != 1) continue;
+            if (i2c_bus_transfer(cand[i], &reg, 1, &who, 1) != 2) continue;
             if (who == ICM42670_WHO_AM_I_RESPONSE) ++hits;
         }
         if (hits >= 3) { return cand[i]; } // majority wins
@@ -852,7 +1931,8 @@ int init_ICM42670() {
     return 0;
 }
 
-int ICM42670_startAccel(uint16_t odr_hz, uint16_t fsr_g) {
+// Only stages ACCEL_CONFIG0 in the shadow
+static int icm_stage_accel(uint16_t odr_hz, uint16_t fsr_g) {
     uint8_t fsr_bits = 0;
     uint8_t odr_bits = 0;
 
@@ -891,13 +1971,21 @@ int ICM42670_startAccel(uint16_t odr_hz, uint16_t fsr_g) {
 
     // Combine into ACCEL_CONFIG0: [7:5] = fsr, [3:0] = odr
     uint8_t accel_config0_val = (fsr_bits << 5) | (odr_bits & 0x0F);
-    int rc = icm_i2c_write_byte(ICM42670_ACCEL_CONFIG0_REG, accel_config0_val);
+    reg_shadow_write(&icm_shadow, ICM42670_ACCEL_CONFIG0_REG, accel_config0_val);
+    return 0;
+}
+
+int ICM42670_startAccel(uint16_t odr_hz, uint16_t fsr_g) {
+    int rc = icm_stage_accel(odr_hz, fsr_g);
+    if (rc != 0) return rc;
+    rc = reg_shadow_flush(&icm_shadow, TKJHAT_REG_SHADOW_VERIFY);
     busy_wait_us(400); 
     if (rc != 0) return -3;
     return 0; // success
 }
 
-int ICM42670_startGyro(uint16_t odr_hz, uint16_t fsr_dps) {
+// Only stages GYRO_CONFIG0 in the shadow
+static int icm_stage_gyro(uint16_t odr_hz, uint16_t fsr_dps) {
     uint8_t fsr_bits = 0;
     uint8_t odr_bits = 0;
  
@@ -936,14 +2024,21 @@ int ICM42670_startGyro(uint16_t odr_hz, uint16_t fsr_dps) {
 
     // Write GYRO_CONFIG0
     uint8_t gyro_config0_val = (fsr_bits << 5) | (odr_bits & 0x0F);
-    if (icm_i2c_write_byte(ICM42670_GYRO_CONFIG0_REG, gyro_config0_val) != 0) return -3;
+    reg_shadow_write(&icm_shadow, ICM42670_GYRO_CONFIG0_REG, gyro_config0_val);
+    return 0;
+}
+
+int ICM42670_startGyro(uint16_t odr_hz, uint16_t fsr_dps) {
+    int rc = icm_stage_gyro(odr_hz, fsr_dps);
+    if (rc != 0) return rc;
+    if (reg_shadow_flush(&icm_shadow, TKJHAT_REG_SHADOW_VERIFY) != 0) return -3;
     busy_wait_us(400); 
     return 0;
 }
 
 //put in low noise both acc and gyr
 int ICM42670_enable_accel_gyro_ln_mode() {
-    int rc = icm_i2c_write_byte(ICM42670_PWR_MGMT0_REG , 0x0F); // bits 3:2 = gyro LN, bits 1:0 = accel LN
+    int rc = icm_write_config(ICM42670_PWR_MGMT0_REG, 0x0F); // bits 3:2 = gyro LN, bits 1:0 = accel LN
     busy_wait_us(400);
     return rc;
 }
@@ -952,7 +2047,7 @@ int ICM42670_enable_accel_gyro_ln_mode() {
 int ICM42670_enable_ultra_low_power_mode(void) {
     // Accel = LP (10), Gyro = OFF (00)
     // PWR_MGMT0 = 0b00000010 = 0x02
-    int rc = icm_i2c_write_byte(ICM42670_PWR_MGMT0_REG , 0x02);
+    int rc = icm_write_config(ICM42670_PWR_MGMT0_REG, 0x02);
     busy_wait_us(200);
     return rc;
 }
@@ -961,11 +2056,62 @@ int ICM42670_enable_ultra_low_power_mode(void) {
 int ICM42670_enable_accel_gyro_lp_mode(void) {
     // Gyro = 10 (LP), Accel = 10 (LP)
     // 0b00001010 = 0x0A
-    int rc = icm_i2c_write_byte(ICM42670_PWR_MGMT0_REG, 0x0A);
+    int rc = icm_write_config(ICM42670_PWR_MGMT0_REG, 0x0A);
     busy_wait_us(200);
     return rc;
 }
 
+static int icm_mreg1_write_byte(uint8_t reg, uint8_t value) {
+    // MREG1 registers are written through BLK_SEL_W / MADDR_W / M_W
+    if (icm_i2c_write_byte(ICM42670_BLK_SEL_W_REG, 0x00) != 0) return -1;
+    if (icm_i2c_write_byte(ICM42670_MADDR_W_REG, reg) != 0) return -1;
+    if (icm_i2c_write_byte(ICM42670_M_W_REG, value) != 0) return -1;
+    busy_wait_us(10); // datasheet: wait 10 µs between MREG accesses
+    return 0;
+}
+
+int ICM42670_enable_wake_on_motion(uint16_t threshold_mg) {
+    // 1 LSB = 1 g / 256
+    uint32_t thr = ((uint32_t)threshold_mg * 256 + 500) / 1000;
+    if (thr < 1) thr = 1;
+    if (thr > 255) thr = 255;
+
+    // The thresholds are MREG1 registers, which need MCLK. It runs while the sensor is
+    // still in LN mode, in accel LP mode it is off, so they are written first.
+    if (icm_wait_mclk_ready() != 0) return -3;
+    if (icm_mreg1_write_byte(ICM42670_MREG1_ACCEL_WOM_X_THR, (uint8_t)thr) != 0) return -3;
+    if (icm_mreg1_write_byte(ICM42670_MREG1_ACCEL_WOM_Y_THR, (uint8_t)thr) != 0) return -3;
+    if (icm_mreg1_write_byte(ICM42670_MREG1_ACCEL_WOM_Z_THR, (uint8_t)thr) != 0) return -3;
+
+    // INT_CONFIG stays at its reset value (INT1 open-drain, active-low, pulsed), writing
+    // it hangs the sensor after a cold power-on (see init_ICM42670). The GPIO has a pull-up.
+    if (icm_write_config(ICM42670_INT_SOURCE1_REG, ICM42670_INT_SOURCE1_WOM_XYZ) != 0) return -4;
+
+    // Keep the FSR, change the ODR to the WOM rate
+    uint8_t accel_config0 = 0;
+    if (icm_read_config(ICM42670_ACCEL_CONFIG0_REG, &accel_config0) != 0) return -1;
+    accel_config0 = (accel_config0 & 0xF0) | (ICM42670_ACCEL_ODR_50HZ & 0x0F);
+    if (icm_write_config(ICM42670_ACCEL_CONFIG0_REG, accel_config0) != 0) return -1;
+
+    // Accel LP, gyro off
+    if (ICM42670_enable_ultra_low_power_mode() != 0) return -2;
+    busy_wait_us(1000); // datasheet: wait 1 ms before enabling WOM
+
+    if (icm_write_config(ICM42670_WOM_CONFIG_REG, ICM42670_WOM_MODE_PREVIOUS | ICM42670_WOM_EN) != 0) return -5;
+    return 0;
+}
+
+int ICM42670_disable_wake_on_motion(void) {
+    if (icm_write_config(ICM42670_WOM_CONFIG_REG, 0x00) != 0) return -1;
+    if (icm_write_config(ICM42670_INT_SOURCE1_REG, 0x00) != 0) return -1;
+    return 0;
+}
+
+int ICM42670_read_wom_status(uint8_t *status) {
+    // INT_STATUS2 is cleared on read
+    return icm_i2c_read_byte(ICM42670_INT_STATUS2_REG, status);
+}
+
 int ICM42670_start_with_default_values(void) {
     int rc;
 
@@ -974,44 +2120,303 @@ int ICM42670_start_with_default_values(void) {
     if (rc != 0) return rc;
 
     // Start accelerometer with defaults (e.g., 100 Hz, ±4 g)
-    rc = ICM42670_startAccel(ICM42670_ACCEL_ODR_DEFAULT,
-                             ICM42670_ACCEL_FSR_DEFAULT);
+    rc = icm_stage_accel(ICM42670_ACCEL_ODR_DEFAULT,
+                         ICM42670_ACCEL_FSR_DEFAULT);
     if (rc != 0) return rc;
 
     // Start gyroscope with defaults (e.g., 100 Hz, ±250 dps)
-    rc = ICM42670_startGyro(ICM42670_GYRO_ODR_DEFAULT,
-                            ICM42670_GYRO_FSR_DEFAULT);
+    rc = icm_stage_gyro(ICM42670_GYRO_ODR_DEFAULT,
+                        ICM42670_GYRO_FSR_DEFAULT);
     if (rc != 0) return rc;
 
+    // GYRO_CONFIG0 and ACCEL_CONFIG0 are next to each other, one burst
+    if (reg_shadow_flush(&icm_shadow, TKJHAT_REG_SHADOW_VERIFY) != 0) return -3;
+    busy_wait_us(400);
 
     return 0;
 }
 
 
-int ICM42670_read_sensor_data(float *ax, float *ay, float *az,
-    float *gx, float *gy, float *gz,float *t) {
-        
+int ICM42670_read_sensor_data_raw(int16_t accel[3], int16_t gyro[3], int16_t *t) {
+
         uint8_t raw[14]; // 14 bytes total from TEMP to GYRO Z
 
         int rc = icm_i2c_read_bytes(ICM42670_SENSOR_DATA_START_REG, raw, sizeof(raw));
         if (rc != 0) return rc;
 
         // Convert to signed 16-bit integers (big-endian)
-        int16_t t_raw = (int16_t)((raw[0] << 8) | raw[1]);
-        int16_t ax_raw = ((int16_t)raw[2] << 8) | raw[3];
-        int16_t ay_raw = ((int16_t)raw[4] << 8) | raw[5];
-        int16_t az_raw = ((int16_t)raw[6] << 8) | raw[7];
-        int16_t gx_raw = (int16_t)((raw[8] << 8) | raw[9]);
-        int16_t gy_raw = (int16_t)((raw[10] << 8) | raw[11]);
-        int16_t gz_raw = (int16_t)((raw[12] << 8) | raw[13]);
+        *t = (int16_t)((raw[0] << 8) | raw[1]);
+        for (int i = 0; i < 3; i++) {
+            accel[i] = (int16_t)((raw[2 + 2*i] << 8) | raw[3 + 2*i]);
+            gyro[i]  = (int16_t)((raw[8 + 2*i] << 8) | raw[9 + 2*i]);
+        }
+        return 0; // success
+}
+
+int ICM42670_read_sensor_data(float *ax, float *ay, float *az,
+    float *gx, float *gy, float *gz,float *t) {
+        
+        int16_t accel_raw[3], gyro_raw[3], t_raw;
+
+        int rc = ICM42670_read_sensor_data_raw(accel_raw, gyro_raw, &t_raw);
+        if (rc != 0) return rc;
 
         *t = ((float)t_raw / 128.0f)+ 25.0;
-        *ax =  (float)ax_raw / aRes; 
-        *ay =  (float)ay_raw / aRes; 
-        *az =  (float)az_raw / aRes;
-        *gx =  (float)gx_raw / gRes; 
-        *gy =  (float)gy_raw / gRes; 
-        *gz =  (float)gz_raw / gRes;
+        *ax =  (float)accel_raw[0] / aRes; 
+        *ay =  (float)accel_raw[1] / aRes; 
+        *az =  (float)accel_raw[2] / aRes;
+        *gx =  (float)gyro_raw[0] / gRes; 
+        *gy =  (float)gyro_raw[1] / gRes; 
+        *gz =  (float)gyro_raw[2] / gRes;
         return 0; // success
 }
 
+/* ---- IMU power state manager ---- */
+// ACTIVE: accel + gyro LN at the configured rates.
+// IDLE:   accel LP with wake-on-motion, gyro off.
+static struct {
+    bool initialized;
+    ICM42670_power_state_t state;
+    uint32_t idle_timeout_ms;
+    uint64_t last_activity_us;
+    uint64_t state_entered_us;
+    uint64_t residency_us[ICM42670_POWER_STATE_COUNT];
+    uint32_t promotions;
+    uint32_t demotions;
+    uint32_t failed_demotions;
+    uint64_t retry_us;            // no demotion before this time, after a failed one
+    uint8_t active_accel_config0; // restored on wake, WOM changes the ODR
+} icm_power;
+
+static void icm_power_enter(ICM42670_power_state_t state) {
+    uint64_t now = time_us_64();
+    icm_power.residency_us[icm_power.state] += now - icm_power.state_entered_us;
+    icm_power.state_entered_us = now;
+    icm_power.state = state;
+}
+
+int ICM42670_power_manager_init(uint32_t idle_timeout_ms) {
+    memset(&icm_power, 0, sizeof(icm_power));
+    icm_power.idle_timeout_ms = idle_timeout_ms;
+    icm_power.state = ICM42670_POWER_ACTIVE;
+    icm_power.state_entered_us = time_us_64();
+    icm_power.last_activity_us = icm_power.state_entered_us;
+    if (icm_read_config(ICM42670_ACCEL_CONFIG0_REG, &icm_power.active_accel_config0) != 0) return -1;
+    icm_power.initialized = true;
+    return 0;
+}
+
+// Back to the ACTIVE configuration: WOM off, the saved accel ODR, accel + gyro LN
+static int icm_power_restore_ln(void) {
+    uint8_t status;
+    ICM42670_read_wom_status(&status); // clear a pending WOM interrupt
+    int rc = ICM42670_disable_wake_on_motion();
+    if (rc != 0) return rc;
+    rc = icm_write_config(ICM42670_ACCEL_CONFIG0_REG, icm_power.active_accel_config0);
+    if (rc != 0) return rc;
+    return ICM42670_enable_accel_gyro_ln_mode();
+}
+
+int ICM42670_power_wake(void) {
+    if (!icm_power.initialized) return -1;
+    icm_power.last_activity_us = time_us_64();
+    if (icm_power.state == ICM42670_POWER_ACTIVE) return 0;
+
+    int rc = icm_power_restore_ln();
+    if (rc != 0) return rc;
+
+    // Gyro needs ~45 ms to start. First samples read as zero.
+    icm_power.promotions++;
+    icm_power_enter(ICM42670_POWER_ACTIVE);
+    return 0;
+}
+
+int ICM42670_power_update(void) {
+    if (!icm_power.initialized || icm_power.state != ICM42670_POWER_ACTIVE) return 0;
+    uint64_t now = time_us_64();
+    uint64_t idle_us = now - icm_power.last_activity_us;
+    if (idle_us < (uint64_t)icm_power.idle_timeout_ms * 1000 || now < icm_power.retry_us) return 0;
+
+    int rc = icm_read_config(ICM42670_ACCEL_CONFIG0_REG, &icm_power.active_accel_config0);
+    if (rc != 0) return rc;
+    rc = ICM42670_enable_wake_on_motion(ICM42670_WOM_THRESHOLD_DEFAULT_MG);
+    if (rc != 0) {
+        // The gyro may be off already. Stay ACTIVE only if LN mode is back, otherwise
+        // go IDLE so that the next wake restores it.
+        icm_power.failed_demotions++;
+        icm_power.retry_us = time_us_64() + (uint64_t)ICM42670_POWER_RETRY_MS * 1000;
+        if (icm_power_restore_ln() != 0) icm_power_enter(ICM42670_POWER_IDLE);
+        return rc;
+    }
+
+    icm_power.demotions++;
+    icm_power_enter(ICM42670_POWER_IDLE);
+    return 0;
+}
+
+ICM42670_power_state_t ICM42670_power_get_state(void) {
+    return icm_power.state;
+}
+
+void ICM42670_power_get_stats(ICM42670_power_stats_t *stats) {
+    stats->state = icm_power.state;
+    memcpy(stats->residency_us, icm_power.residency_us, sizeof(stats->residency_us));
+    if (icm_power.initialized) {
+        stats->residency_us[icm_power.state] += time_us_64() - icm_power.state_entered_us;
+    }
+    stats->promotions = icm_power.promotions;
+    stats->demotions = icm_power.demotions;
+    stats->failed_demotions = icm_power.failed_demotions;
+}
+
+/* =========================
+ *  I2C BUS BENCHMARK
+ * ========================= */
+#define I2C_BENCHMARK_FRAMES    10
+#define I2C_BENCHMARK_BURSTS    200
+
+static void i2c_benchmark_set_baudrate(uint8_t address, const i2c_bus_profile_t *profile, uint32_t baudrate) {
+    i2c_bus_profile_t p = *profile;
+    p.baudrate = baudrate;
+    i2c_bus_register_device(address, &p);
+}
+
+int i2c_benchmark(const uint32_t *baudrates, size_t count, i2c_benchmark_result_t *results) {
+    if (disp.bufsize == 0 || display_service.queue != NULL) return -1;
+    uint8_t *saved = malloc(disp.bufsize);
+    if (saved == NULL) return -2;
+    memcpy(saved, disp.buffer, disp.bufsize);
+
+    i2c_bus_profile_t imu_profile, display_profile;
+    i2c_bus_get_profile(ICM42670_I2C_ADDRESS, &imu_profile);
+    i2c_bus_get_profile(SSD1306_I2C_ADDRESS, &display_profile);
+
+    for (size_t i = 0; i < count; i++) {
+        i2c_benchmark_set_baudrate(ICM42670_I2C_ADDRESS, &imu_profile, baudrates[i]);
+        i2c_benchmark_set_baudrate(SSD1306_I2C_ADDRESS, &display_profile, baudrates[i]);
+        i2c_bus_stats_t before, after;
+        i2c_bus_get_stats(&before);
+        uint32_t failed = 0;
+
+        uint64_t cpu_us = 0;
+        uint64_t start = time_us_64();
+        for (int frame = 0; frame < I2C_BENCHMARK_FRAMES; frame++) {
+            ssd1306_invalidate(&disp);
+            uint64_t frame_start = time_us_64();
+            ssd1306_show_start(&disp);
+            cpu_us += time_us_64() - frame_start;
+            ssd1306_show_wait(&disp);
+        }
+        results[i].frame_us = (uint32_t)((time_us_64() - start) / I2C_BENCHMARK_FRAMES);
+        results[i].frame_cpu_us = (uint32_t)(cpu_us / I2C_BENCHMARK_FRAMES);
+
+        // Like write_text() after clear_display(), the text moves a bit every update
+        uint32_t bytes = disp.stats.bytes;
+        start = time_us_64();
+        for (int frame = 0; frame < I2C_BENCHMARK_FRAMES; frame++) {
+            ssd1306_clear(&disp);
+            ssd1306_draw_string(&disp, 8 + (frame % 4) * 8, 24, 2, "12:34");
+            ssd1306_show(&disp);
+        }
+        results[i].update_us = (uint32_t)((time_us_64() - start) / I2C_BENCHMARK_FRAMES);
+        results[i].update_bytes = (disp.stats.bytes - bytes) / I2C_BENCHMARK_FRAMES;
+
+        int16_t accel[3], gyro[3], t;
+        start = time_us_64();
+        for (int burst = 0; burst < I2C_BENCHMARK_BURSTS; burst++) {
+            if (ICM42670_read_sensor_data_raw(accel, gyro, &t) != 0) failed++;
+        }
+        results[i].imu_burst_us = (uint32_t)((time_us_64() - start) / I2C_BENCHMARK_BURSTS);
+
+        // The engine counts its own errors, the blocking fallback only shows up as failed reads
+        i2c_bus_get_stats(&after);
+        uint32_t engine_errors = after.errors - before.errors;
+        results[i].errors = engine_errors > failed ? engine_errors : failed;
+        results[i].baudrate = baudrates[i];
+    }
+
+    i2c_bus_register_device(ICM42670_I2C_ADDRESS, &imu_profile);
+    i2c_bus_register_device(SSD1306_I2C_ADDRESS, &display_profile);
+
+    memcpy(disp.buffer, saved, disp.bufsize);
+    free(saved);
+    ssd1306_invalidate(&disp);
+    ssd1306_show(&disp);
+    return 0;
+}
+
+void i2c_benchmark_print(const i2c_benchmark_result_t *results, size_t count) {
+    printf("I2C bus throughput:\n");
+    printf("  %8s %10s %8s %6s %10s %10s %14s %7s\n", "kHz", "frame us", "cpu us", "fps", "update us",
+           "update B", "imu burst us", "errors");
+    for (size_t i = 0; i < count; i++) {
+        uint32_t fps = results[i].frame_us > 0 ? 1000000 / results[i].frame_us : 0;
+        printf("  %8lu %10lu %8lu %6lu %10lu %10lu %14lu %7lu\n", (unsigned long)(results[i].baudrate / 1000),
+               (unsigned long)results[i].frame_us, (unsigned long)results[i].frame_cpu_us, (unsigned long)fps,
+               (unsigned long)results[i].update_us, (unsigned long)results[i].update_bytes,
+               (unsigned long)results[i].imu_burst_us, (unsigned long)results[i].errors);
+    }
+}
+
+/* =========================
+ *  LINE DRAWING BENCHMARK
+ * ========================= */
+#define DRAW_BENCHMARK_ROUNDS   20
+
+int draw_benchmark(draw_benchmark_result_t *results, uint32_t (*counter)(void)) {
+    if (disp.bufsize == 0 || display_service.queue != NULL) return -1;
+    uint8_t *saved = malloc(disp.bufsize);
+    if (saved == NULL) return -2;
+    memcpy(saved, disp.buffer, disp.bufsize);
+
+    static const char *names[DRAW_BENCHMARK_COUNT] = {
+        "horizontal", "vertical", "shallow", "steep", "reversed"
+    };
+    const int32_t w = (int32_t)disp.width, h = (int32_t)disp.height;
+    for (int kind = 0; kind < DRAW_BENCHMARK_COUNT; kind++) {
+        uint32_t pixels = 0;
+        uint32_t start = counter();
+        for (int round = 0; round < DRAW_BENCHMARK_ROUNDS; round++) {
+            switch (kind) {
+                case 0:
+                    for (int32_t y = 0; y < h; y++) ssd1306_draw_line(&disp, 0, y, w - 1, y);
+                    pixels += (uint32_t)(w * h);
+                    break;
+                case 1:
+                    for (int32_t x = 0; x < w; x++) ssd1306_draw_line(&disp, x, 0, x, h - 1);
+                    pixels += (uint32_t)(w * h);
+                    break;
+                case 2:
+                    // |dy| < |dx|: one pixel per column
+                    for (int32_t y = 0; y < h; y++) ssd1306_draw_line(&disp, 0, y, w - 1, h - 1 - y);
+                    pixels += (uint32_t)(w * h);
+                    break;
+                case 3:
+                    // |dy| > |dx|: one pixel per row
+                    for (int32_t x = 0; x < w; x += 2) ssd1306_draw_line(&disp, x, 0, w / 4 + x / 2, h - 1);
+                    pixels += (uint32_t)(w / 2) * (uint32_t)h;
+                    break;
+                case 4:
+                    for (int32_t y = 0; y < h; y++) ssd1306_draw_line(&disp, w - 1, y, 0, y / 2);
+                    pixels += (uint32_t)(w * h);
+                    break;
+            }
+        }
+        results[kind].name = names[kind];
+        results[kind].elapsed = counter() - start;
+        results[kind].pixels = pixels;
+    }
+
+    memcpy(disp.buffer, saved, disp.bufsize);
+    free(saved);
+    return 0;
+}
+
+void draw_benchmark_print(const draw_benchmark_result_t *results, uint32_t ticks_per_second) {
+    printf("Line drawing (pixels per second):\n");
+    for (int i = 0; i < DRAW_BENCHMARK_COUNT; i++) {
+        uint64_t per_second = results[i].elapsed > 0
+            ? (uint64_t)results[i].pixels * ticks_per_second / results[i].elapsed : 0;
+        printf("  %-12s %10llu\n", results[i].name, (unsigned long long)per_second);
+    }
+}
@@ -32,15 +32,53 @@ SOFTWARE.
 
 #include <tkjhat/ssd1306.h>
 #include <tkjhat/font.h>
+#include <tkjhat/i2c_bus.h>
+
+// Clean columns inside a changed range that are cheaper to send again than to start a
+// new window (command transaction: address, control byte, 6 command bytes, STOP/START)
+#define SSD1306_WINDOW_GAP 10
+// Transactions ssd1306_show_start keeps in flight on i2c_default
+#define SSD1306_SHOW_BATCH 16
+
+typedef struct {
+    uint8_t x0, x1;         // columns
+    uint8_t page0, page1;   // pages
+} ssd1306_window_t;
+
+// Transfer state on i2c_default. The changed bytes are encoded to controller command
+// words (control byte first) when the frame starts, so the frame buffer can be drawn
+// again while the frame is on the bus and the I2C interrupt starts the DMA of every
+// transaction without copying.
+typedef struct {
+    i2c_transaction_t t[SSD1306_SHOW_BATCH];
+    size_t n;
+    size_t words_used;
+    size_t words_size;
+    bool failed;
+    uint16_t words[];
+} ssd1306_transfer_t;
+
+// Glyphs pre-expanded for scale 2 and 3, direct mapped by character
+#define SSD1306_GLYPH_CACHE_SIZE 32
+#define SSD1306_GLYPH_CACHE_COLUMNS 8
+
+typedef struct {
+    const uint8_t *font;    // NULL: empty slot
+    char c;
+    uint8_t scale;
+    uint32_t columns[SSD1306_GLYPH_CACHE_COLUMNS];  // bit n is row y+n of the glyph
+} ssd1306_glyph_t;
 
 inline static void swap(int32_t *a, int32_t *b) {
-    int32_t *t=a;
+    int32_t t=*a;
     *a=*b;
-    *b=*t;
+    *b=t;
 }
 
-inline static void fancy_write(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, char *name) {
-    switch(i2c_write_blocking(i2c, addr, src, len, false)) {
+inline static int fancy_write(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src, size_t len, char *name) {
+    // i2c_default is driven by the transaction engine, the task sleeps during the transfer
+    int result=i2c==i2c_default?i2c_bus_transfer(addr, src, len, NULL, 0):i2c_write_blocking(i2c, addr, src, len, false);
+    switch(result) {
     case PICO_ERROR_GENERIC:
         printf("[%s] addr not acknowledged!\n", name);
         break;
@@ -51,11 +89,55 @@ inline static void fancy_write(i2c_inst_t *i2c, uint8_t addr, const uint8_t *src
         //printf("[%s] wrote successfully %lu bytes!\n", name, len);
         break;
     }
+    return result;
 }
 
-inline static void ssd1306_write(ssd1306_t *p, uint8_t val) {
-    uint8_t d[2]= {0x00, val};
-    fancy_write(p->i2c_i, p->address, d, 2, "ssd1306_write");
+void ssd1306_cmdlist_begin(ssd1306_cmdlist_t *l) {
+    l->data[0]=0x00; // Co=0, D/C#=0: the rest of the transaction is commands
+    l->len=0;
+    l->overflow=false;
+}
+
+bool ssd1306_cmdlist_add(ssd1306_cmdlist_t *l, const uint8_t *cmds, size_t len) {
+    if(l->overflow || len>(size_t)SSD1306_CMDLIST_SIZE-l->len) {
+        l->overflow=true;
+        return false;
+    }
+    memcpy(l->data+1+l->len, cmds, len);
+    l->len+=len;
+    return true;
+}
+
+int ssd1306_cmdlist_send(ssd1306_t *p, const ssd1306_cmdlist_t *l) {
+    if(l->overflow)
+        return PICO_ERROR_GENERIC;
+    if(l->len==0)
+        return 0;
+    ++p->stats.commands;
+    p->stats.bytes+=1+l->len;
+    return fancy_write(p->i2c_i, p->address, l->data, 1+l->len, "ssd1306_cmdlist");
+}
+
+// one command list for a short fixed sequence
+static void ssd1306_write_commands(ssd1306_t *p, const uint8_t *cmds, size_t len) {
+    ssd1306_cmdlist_t l;
+    ssd1306_cmdlist_begin(&l);
+    ssd1306_cmdlist_add(&l, cmds, len);
+    ssd1306_cmdlist_send(p, &l);
+}
+
+inline static void ssd1306_mark(ssd1306_t *p, uint32_t x, uint32_t page) {
+    if(x<p->dirty_x0[page])
+        p->dirty_x0[page]=x;
+    if(x>p->dirty_x1[page])
+        p->dirty_x1[page]=x;
+}
+
+static void ssd1306_mark_all(ssd1306_t *p) {
+    for(uint8_t i=0; i<p->pages; ++i) {
+        p->dirty_x0[i]=0;
+        p->dirty_x1[i]=p->width-1;
+    }
 }
 
 bool ssd1306_init(ssd1306_t *p, uint16_t width, uint16_t height, uint8_t address, i2c_inst_t *i2c_instance) {
@@ -64,16 +146,39 @@ bool ssd1306_init(ssd1306_t *p, uint16_t width, uint16_t height, uint8_t address
     p->pages=height/8;
     p->address=address;
 
+    if(p->pages>SSD1306_MAX_PAGES) {
+        p->bufsize=0;
+        return false;
+    }
+
     p->i2c_i=i2c_instance;
 
 
     p->bufsize=(p->pages)*(p->width);
-    if((p->buffer=malloc(p->bufsize+1))==NULL) {
+    if((p->buffer=malloc(p->bufsize))==NULL) {
         p->bufsize=0;
         return false;
     }
 
-    ++(p->buffer);
+    // without the copy every dirty column is sent
+    p->shown=malloc(p->bufsize);
+    // without the transfer state the frames are written blocking
+    p->transfer=NULL;
+    if(p->i2c_i==i2c_default) {
+        size_t words=p->bufsize+SSD1306_SHOW_BATCH*8;
+        ssd1306_transfer_t *tr=malloc(sizeof(ssd1306_transfer_t)+words*sizeof(uint16_t));
+        if(tr!=NULL) {
+            tr->n=0;
+            tr->words_used=0;
+            tr->words_size=words;
+            tr->failed=false;
+            p->transfer=tr;
+        }
+    }
+    // without the cache scaled glyphs are expanded on every draw
+    p->glyphs=calloc(SSD1306_GLYPH_CACHE_SIZE, sizeof(ssd1306_glyph_t));
+    memset(&p->stats, 0, sizeof(p->stats));
+    ssd1306_invalidate(p);
 
     // from https://github.com/makerportal/rpi-pico-ssd1306
     uint8_t cmds[]= {
@@ -109,95 +214,247 @@ bool ssd1306_init(ssd1306_t *p, uint16_t width, uint16_t height, uint8_t address
         0x00,  // horizontal
     };
 
-    for(size_t i=0; i<sizeof(cmds); ++i)
-        ssd1306_write(p, cmds[i]);
+    ssd1306_write_commands(p, cmds, sizeof(cmds));
 
     return true;
 }
 
 inline void ssd1306_deinit(ssd1306_t *p) {
-    free(p->buffer-1);
+    ssd1306_show_wait(p);
+    free(p->transfer);
+    free(p->glyphs);
+    free(p->buffer);
+    free(p->shown);
 }
 
 inline void ssd1306_poweroff(ssd1306_t *p) {
-    ssd1306_write(p, SET_DISP|0x00);
+    const uint8_t cmds[]= {SET_DISP|0x00};
+    ssd1306_write_commands(p, cmds, sizeof(cmds));
 }
 
 inline void ssd1306_poweron(ssd1306_t *p) {
-    ssd1306_write(p, SET_DISP|0x01);
+    const uint8_t cmds[]= {SET_DISP|0x01};
+    ssd1306_write_commands(p, cmds, sizeof(cmds));
 }
 
 inline void ssd1306_contrast(ssd1306_t *p, uint8_t val) {
-    ssd1306_write(p, SET_CONTRAST);
-    ssd1306_write(p, val);
+    const uint8_t cmds[]= {SET_CONTRAST, val};
+    ssd1306_write_commands(p, cmds, sizeof(cmds));
 }
 
 inline void ssd1306_invert(ssd1306_t *p, uint8_t inv) {
-    ssd1306_write(p, SET_NORM_INV | (inv & 1));
+    const uint8_t cmds[]= {SET_NORM_INV | (inv & 1)};
+    ssd1306_write_commands(p, cmds, sizeof(cmds));
 }
 
 inline void ssd1306_clear(ssd1306_t *p) {
+    ++p->stats.draws;
     memset(p->buffer, 0, p->bufsize);
+    ssd1306_mark_all(p);
+}
+
+void ssd1306_invalidate(ssd1306_t *p) {
+    p->shown_valid=false;
+    ssd1306_mark_all(p);
 }
 
 void ssd1306_clear_pixel(ssd1306_t *p, uint32_t x, uint32_t y) {
+    ++p->stats.draws;
     if(x>=p->width || y>=p->height) return;
 
     p->buffer[x+p->width*(y>>3)]&=~(0x1<<(y&0x07));
+    ssd1306_mark(p, x, y>>3);
 }
 
-void ssd1306_draw_pixel(ssd1306_t *p, uint32_t x, uint32_t y) {
+// The drawing functions count their calls in stats.draws, the static helpers are
+// what they use internally, so a call counts once
+static inline void ssd1306_put_pixel(ssd1306_t *p, uint32_t x, uint32_t y) {
     if(x>=p->width || y>=p->height) return;
 
     p->buffer[x+p->width*(y>>3)]|=0x1<<(y&0x07); // y>>3==y/8 && y&0x7==y%8
+    ssd1306_mark(p, x, y>>3);
 }
 
-void ssd1306_draw_line(ssd1306_t *p, int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
-    if(x1>x2) {
+void ssd1306_draw_pixel(ssd1306_t *p, uint32_t x, uint32_t y) {
+    ++p->stats.draws;
+    ssd1306_put_pixel(p, x, y);
+}
+
+static void ssd1306_fill(ssd1306_t *p, int32_t x1, int32_t y1, int32_t x2, int32_t y2, bool on) {
+    if(x1>x2)
         swap(&x1, &x2);
+    if(y1>y2)
         swap(&y1, &y2);
+    if(x2<0 || x1>=p->width || y2<0 || y1>=p->height)
+        return;
+    if(x1<0)
+        x1=0;
+    if(x2>=p->width)
+        x2=p->width-1;
+    if(y1<0)
+        y1=0;
+    if(y2>=p->height)
+        y2=p->height-1;
+
+    // one mask per page, ORed (or cleared) over the column run
+    size_t n=x2-x1+1;
+    for(int32_t page=y1>>3; page<=y2>>3; ++page) {
+        uint8_t mask=0xFF;
+        if(page==y1>>3)
+            mask&=0xFF<<(y1&0x07);
+        if(page==y2>>3)
+            mask&=0xFF>>(7-(y2&0x07));
+
+        uint8_t *row=p->buffer+p->width*page+x1;
+        if(mask==0xFF && n>1)
+            memset(row, on?0xFF:0x00, n);
+        else if(on)
+            for(size_t i=0; i<n; ++i)
+                row[i]|=mask;
+        else
+            for(size_t i=0; i<n; ++i)
+                row[i]&=~mask;
+        ssd1306_mark(p, x1, page);
+        ssd1306_mark(p, x2, page);
     }
+}
 
-    if(x1==x2) {
-        if(y1>y2)
-            swap(&y1, &y2);
-        for(int32_t i=y1; i<=y2; ++i)
-            ssd1306_draw_pixel(p, x1, i);
+void ssd1306_fill_rect(ssd1306_t *p, int32_t x1, int32_t y1, int32_t x2, int32_t y2, bool on) {
+    ++p->stats.draws;
+    ssd1306_fill(p, x1, y1, x2, y2, on);
+}
+
+static void ssd1306_line(ssd1306_t *p, int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
+    // horizontal: one bit in each byte of the span, vertical: one byte per page
+    if(y1==y2 || x1==x2) {
+        ssd1306_fill(p, x1, y1, x2, y2, true);
         return;
     }
 
-    float m=(float) (y2-y1) / (float) (x2-x1);
-
-    for(int32_t i=x1; i<=x2; ++i) {
-        float y=m*(float) (i-x1)+(float) y1;
-        ssd1306_draw_pixel(p, i, (uint32_t) y);
+    // Bresenham, all octants with integers only. Pixels outside of the display are skipped
+    // by ssd1306_put_pixel (negative values wrap to large unsigned ones).
+    int32_t dx=abs(x2-x1), dy=-abs(y2-y1);
+    int32_t sx=x1<x2?1:-1, sy=y1<y2?1:-1;
+    int32_t err=dx+dy;
+    for(;;) {
+        ssd1306_put_pixel(p, (uint32_t) x1, (uint32_t) y1);
+        if(x1==x2 && y1==y2)
+            break;
+        int32_t e2=2*err;
+        if(e2>=dy) {
+            err+=dy;
+            x1+=sx;
+        }
+        if(e2<=dx) {
+            err+=dx;
+            y1+=sy;
+        }
     }
 }
 
+void ssd1306_draw_line(ssd1306_t *p, int32_t x1, int32_t y1, int32_t x2, int32_t y2) {
+    ++p->stats.draws;
+    ssd1306_line(p, x1, y1, x2, y2);
+}
+
+// clips the unsigned square to the display before ssd1306_fill
+static void ssd1306_square(ssd1306_t *p, uint32_t x, uint32_t y, uint32_t width, uint32_t height, bool on) {
+    if(width==0 || height==0 || x>=p->width || y>=p->height)
+        return;
+    uint32_t x2=width>p->width-x?p->width-1u:x+width-1;
+    uint32_t y2=height>p->height-y?p->height-1u:y+height-1;
+    ssd1306_fill(p, x, y, x2, y2, on);
+}
+
 void ssd1306_clear_square(ssd1306_t *p, uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
-    for(uint32_t i=0; i<width; ++i)
-        for(uint32_t j=0; j<height; ++j)
-            ssd1306_clear_pixel(p, x+i, y+j);
+    ++p->stats.draws;
+    ssd1306_square(p, x, y, width, height, false);
 }
 
 void ssd1306_draw_square(ssd1306_t *p, uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
-    for(uint32_t i=0; i<width; ++i)
-        for(uint32_t j=0; j<height; ++j)
-            ssd1306_draw_pixel(p, x+i, y+j);
+    ++p->stats.draws;
+    ssd1306_square(p, x, y, width, height, true);
 }
 
 void ssd1306_draw_empty_square(ssd1306_t *p, uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
-    ssd1306_draw_line(p, x, y, x+width, y);
-    ssd1306_draw_line(p, x, y+height, x+width, y+height);
-    ssd1306_draw_line(p, x, y, x, y+height);
-    ssd1306_draw_line(p, x+width, y, x+width, y+height);
+    ++p->stats.draws;
+    ssd1306_line(p, x, y, x+width, y);
+    ssd1306_line(p, x, y+height, x+width, y+height);
+    ssd1306_line(p, x, y, x, y+height);
+    ssd1306_line(p, x+width, y, x+width, y+height);
+}
+
+// ORs one column of up to 32 rows starting at row y into the pages, bit 0 is row y
+static void ssd1306_blit_column(ssd1306_t *p, uint32_t x, uint32_t y, uint32_t bits) {
+    if(x>=p->width)
+        return;
+
+    uint64_t v=(uint64_t) bits<<(y&0x07);
+    for(uint32_t page=y>>3; v && page<p->pages; ++page, v>>=8) {
+        uint8_t b=v&0xFF;
+        if(b) {
+            p->buffer[x+p->width*page]|=b;
+            ssd1306_mark(p, x, page);
+        }
+    }
+}
+
+// every bit of the column repeated scale times
+static uint32_t ssd1306_expand_column(uint32_t bits, uint32_t scale) {
+    if(scale==1)
+        return bits;
+    uint32_t out=0, block=(1u<<scale)-1;
+    for(uint32_t i=0; bits; ++i, bits>>=1) {
+        if(bits&1)
+            out|=block<<(i*scale);
+    }
+    return out;
+}
+
+static uint32_t ssd1306_font_column(const uint8_t *column, uint32_t parts_per_line) {
+    uint32_t bits=0;
+    for(uint32_t lp=0; lp<parts_per_line; ++lp)
+        bits|=(uint32_t) column[lp]<<(lp<<3);
+    return bits;
+}
+
+// columns of a glyph at scale 2 or 3, NULL if the glyph is not cacheable
+static const uint32_t *ssd1306_glyph_columns(ssd1306_t *p, const uint8_t *font, const uint8_t *glyph, char c, uint32_t scale, uint32_t parts_per_line) {
+    ssd1306_glyph_t *cache=p->glyphs;
+    if(cache==NULL || (scale!=2 && scale!=3) || font[1]>SSD1306_GLYPH_CACHE_COLUMNS)
+        return NULL;
+
+    ssd1306_glyph_t *g=&cache[(uint8_t) c%SSD1306_GLYPH_CACHE_SIZE];
+    if(g->font!=font || g->c!=c || g->scale!=scale) {
+        for(uint8_t w=0; w<font[1]; ++w)
+            g->columns[w]=ssd1306_expand_column(ssd1306_font_column(glyph+w*parts_per_line, parts_per_line), scale);
+        g->font=font;
+        g->c=c;
+        g->scale=scale;
+    }
+    return g->columns;
 }
 
 void ssd1306_draw_char_with_font(ssd1306_t *p, uint32_t x, uint32_t y, uint32_t scale, const uint8_t *font, char c) {
-    if(c<font[3]||c>font[4])
+    ++p->stats.draws;
+    if(c<font[3]||c>font[4]||scale==0)
         return;
 
     uint32_t parts_per_line=(font[0]>>3)+((font[0]&7)>0);
+    const uint8_t *glyph=font+5+(c-font[3])*font[1]*parts_per_line;
+    if(parts_per_line*8*scale<=32) {
+        // whole columns with shifts and masks, scale times next to each other
+        const uint32_t *columns=ssd1306_glyph_columns(p, font, glyph, c, scale, parts_per_line);
+        for(uint8_t w=0; w<font[1]; ++w) {
+            uint32_t bits=columns?columns[w]:ssd1306_expand_column(ssd1306_font_column(glyph+w*parts_per_line, parts_per_line), scale);
+            if(bits==0)
+                continue;
+            for(uint32_t i=0; i<scale; ++i)
+                ssd1306_blit_column(p, x+w*scale+i, y, bits);
+        }
+        return;
+    }
+
     for(uint8_t w=0; w<font[1]; ++w) { // width
         uint32_t pp=(c-font[3])*font[1]*parts_per_line+w*parts_per_line+5;
         for(uint32_t lp=0; lp<parts_per_line; ++lp) {
@@ -205,7 +462,7 @@ void ssd1306_draw_char_with_font(ssd1306_t *p, uint32_t x, uint32_t y, uint32_t
 
             for(int8_t j=0; j<8; ++j, line>>=1) {
                 if(line & 1)
-                    ssd1306_draw_square(p, x+w*scale, y+((lp<<3)+j)*scale, scale, scale);
+                    ssd1306_square(p, x+w*scale, y+((lp<<3)+j)*scale, scale, scale, true);
             }
 
             ++pp;
@@ -227,6 +484,50 @@ void ssd1306_draw_string(ssd1306_t *p, uint32_t x, uint32_t y, uint32_t scale, c
     ssd1306_draw_string_with_font(p, x, y, scale, font_8x5, s);
 }
 
+uint32_t ssd1306_string_width(uint32_t scale, const char *s) {
+    return strlen(s)*(font_8x5[1]+font_8x5[2])*scale;
+}
+
+void ssd1306_render_string(uint8_t *dst, uint32_t width, uint32_t pages, uint32_t x, uint32_t scale, const char *s) {
+    const uint8_t *font=font_8x5;
+    uint32_t parts_per_line=(font[0]>>3)+((font[0]&7)>0);
+    if(scale==0 || parts_per_line*8*scale>32)
+        return;
+
+    for(; *s; ++s, x+=(font[1]+font[2])*scale) {
+        char c=*s;
+        if(c<font[3]||c>font[4])
+            continue;
+        const uint8_t *glyph=font+5+(c-font[3])*font[1]*parts_per_line;
+        for(uint8_t w=0; w<font[1]; ++w) {
+            uint32_t bits=ssd1306_expand_column(ssd1306_font_column(glyph+w*parts_per_line, parts_per_line), scale);
+            for(uint32_t i=0; i<scale; ++i) {
+                uint32_t col=x+w*scale+i;
+                if(col>=width)
+                    return;
+                for(uint32_t page=0; page<pages && page<4; ++page)
+                    dst[col+width*page]|=bits>>(page<<3);
+            }
+        }
+    }
+}
+
+void ssd1306_blit_pages(ssd1306_t *p, uint32_t x, uint32_t page, const uint8_t *src, uint32_t src_width, uint32_t width, uint32_t pages) {
+    ++p->stats.draws;
+    if(x>=p->width || page>=p->pages || width==0)
+        return;
+    if(width>p->width-x)
+        width=p->width-x;
+    if(pages>p->pages-page)
+        pages=p->pages-page;
+
+    for(uint32_t i=0; i<pages; ++i) {
+        memcpy(p->buffer+x+p->width*(page+i), src+src_width*i, width);
+        ssd1306_mark(p, x, page+i);
+        ssd1306_mark(p, x+width-1, page+i);
+    }
+}
+
 static inline uint32_t ssd1306_bmp_get_val(const uint8_t *data, const size_t offset, uint8_t size) {
     switch(size) {
     case 1:
@@ -242,6 +543,7 @@ static inline uint32_t ssd1306_bmp_get_val(const uint8_t *data, const size_t off
 }
 
 void ssd1306_bmp_show_image_with_offset(ssd1306_t *p, const uint8_t *data, const long size, uint32_t x_offset, uint32_t y_offset) {
+    ++p->stats.draws;
     if(size<54) // data smaller than header
         return;
 
@@ -280,7 +582,7 @@ void ssd1306_bmp_show_image_with_offset(ssd1306_t *p, const uint8_t *data, const
     for(uint32_t y=biHeight>0?biHeight-1:0; y!=(uint32_t)border; y+=step) {
         for(uint32_t x=0; x<biWidth; ++x) {
             if(((img_data[x>>3]>>(7-(x&7)))&1)==color_val)
-                ssd1306_draw_pixel(p, x_offset+x, y_offset+y);
+                ssd1306_put_pixel(p, x_offset+x, y_offset+y);
         }
         img_data+=bytes_per_line;
     }
@@ -290,17 +592,162 @@ inline void ssd1306_bmp_show_image(ssd1306_t *p, const uint8_t *data, const long
     ssd1306_bmp_show_image_with_offset(p, data, size, 0, 0);
 }
 
-void ssd1306_show(ssd1306_t *p) {
-    uint8_t payload[]= {SET_COL_ADDR, 0, p->width-1, SET_PAGE_ADDR, 0, p->pages-1};
-    if(p->width==64) {
-        payload[1]+=32;
-        payload[2]+=32;
+static void ssd1306_transfer_wait(ssd1306_transfer_t *tr) {
+    for(size_t i=0; i<tr->n; ++i) {
+        if(tr->t[i].status==I2C_TRANSACTION_IDLE)
+            continue; // submit failed
+        int result=i2c_bus_wait(&tr->t[i], I2C_BUS_TIMEOUT_PROFILE);
+        if(result<0) {
+            printf("[ssd1306_show] transfer failed (%d)!\n", result);
+            tr->failed=true;
+        }
+    }
+    tr->n=0;
+    tr->words_used=0;
+}
+
+static void ssd1306_transfer_submit(ssd1306_t *p, ssd1306_transfer_t *tr, uint8_t control, const uint8_t *src, size_t len) {
+    i2c_transaction_t *t=&tr->t[tr->n++];
+    uint16_t *words=tr->words+tr->words_used;
+    tr->words_used+=i2c_bus_encode_write(words, &control, 1, src, len);
+    *t=(i2c_transaction_t) {
+        .address=p->address,
+        .header={control},
+        .header_len=1,
+        .tx_len=len,
+        .encoded=words,
+    };
+    if(i2c_bus_submit(t)!=0) {
+        t->status=I2C_TRANSACTION_IDLE;
+        tr->failed=true;
     }
+}
 
-    for(size_t i=0; i<sizeof(payload); ++i)
-        ssd1306_write(p, payload[i]);
+// Returns false if a blocking write failed, failures of queued transfers show up in ssd1306_show_wait
+static bool ssd1306_send_window(ssd1306_t *p, const uint8_t *buffer, const ssd1306_window_t *w) {
+    uint8_t offset=p->width==64?32:0;
+    uint8_t cmds[6]= {SET_COL_ADDR, w->x0+offset, w->x1+offset, SET_PAGE_ADDR, w->page0, w->page1};
+    size_t len=w->x1-w->x0+1;
+    uint8_t pages=w->page1-w->page0+1;
+
+    ++p->stats.windows;
+
+    ssd1306_transfer_t *tr=p->transfer;
+    if(tr==NULL) {
+        ssd1306_cmdlist_t l;
+        ssd1306_cmdlist_begin(&l);
+        ssd1306_cmdlist_add(&l, cmds, sizeof(cmds));
+        bool ok=ssd1306_cmdlist_send(p, &l)>=0;
+        p->stats.bytes+=pages*(1+len);
+        uint8_t d[256];
+        for(uint8_t page=w->page0; page<=w->page1; ++page) {
+            d[0]=0x40;
+            memcpy(d+1, buffer+page*p->width+w->x0, len);
+            ok&=fancy_write(p->i2c_i, p->address, d, 1+len, "ssd1306_show")>=0;
+        }
+        return ok;
+    }
 
-    *(p->buffer-1)=0x40;
+    // The window is one command transaction and one data transaction per page, so the
+    // bus arbiter can run IMU reads between the pages
+    if(tr->n+1+pages>SSD1306_SHOW_BATCH || tr->words_used+1+sizeof(cmds)+pages*(1+len)>tr->words_size)
+        ssd1306_transfer_wait(tr);
+    ++p->stats.commands;
+    p->stats.bytes+=1+sizeof(cmds)+pages*(1+len);
+    ssd1306_transfer_submit(p, tr, 0x00, cmds, sizeof(cmds));
+    for(uint8_t page=w->page0; page<=w->page1; ++page)
+        ssd1306_transfer_submit(p, tr, 0x40, buffer+page*p->width+w->x0, len);
+    return true;
+}
+
+void ssd1306_show_start(ssd1306_t *p) {
+    ssd1306_window_t w;
+    bool pending=false;
+    bool ok=true;
+
+    // A failed transfer of an earlier show leaves the display RAM unknown. Without
+    // this only ssd1306_show_wait would notice, and the display task calls that only
+    // before a dwell, so ticker and line updates would never send the bytes again.
+    ssd1306_transfer_t *tr=p->transfer;
+    if(tr!=NULL) {
+        ssd1306_transfer_wait(tr);
+        if(tr->failed) {
+            tr->failed=false;
+            ssd1306_invalidate(p);
+        }
+    }
 
-    fancy_write(p->i2c_i, p->address, p->buffer-1, p->bufsize+1, "ssd1306_show");
-}
\ No newline at end of file
+    // The changed bytes are copied into the transfer (or written blocking) before this
+    // returns, so drawing the next frame into the buffer cannot reach the panel early
+    const uint8_t *buffer=p->buffer;
+    uint8_t *x0s=p->dirty_x0;
+    uint8_t *x1s=p->dirty_x1;
+
+    ++p->stats.shows;
+    for(uint8_t page=0; page<p->pages; ++page) {
+        if(x0s[page]>x1s[page])
+            continue;
+
+        const uint8_t *row=buffer+page*p->width;
+        const uint8_t *shown=p->shown_valid?p->shown+page*p->width:NULL;
+        uint32_t x=x0s[page], end=x1s[page];
+        while(x<=end) {
+            if(shown) {
+                while(x<=end && row[x]==shown[x])
+                    ++x;
+                if(x>end)
+                    break;
+            }
+            // extend the window until SSD1306_WINDOW_GAP unchanged columns in a row
+            uint32_t x1=x;
+            for(uint32_t i=x+1, clean=0; i<=end && clean<SSD1306_WINDOW_GAP; ++i) {
+                if(shown && row[i]==shown[i]) {
+                    ++clean;
+                } else {
+                    x1=i;
+                    clean=0;
+                }
+            }
+
+            // the same columns on the next page continue the window
+            if(pending && w.x0==x && w.x1==x1 && w.page1+1==page) {
+                w.page1=page;
+            } else {
+                if(pending)
+                    ok&=ssd1306_send_window(p, buffer, &w);
+                w=(ssd1306_window_t) {x, x1, page, page};
+                pending=true;
+            }
+            x=x1+1;
+        }
+
+        if(p->shown)
+            memcpy(p->shown+page*p->width+x0s[page], row+x0s[page], end-x0s[page]+1);
+        x0s[page]=0xFF;
+        x1s[page]=0;
+    }
+    if(pending)
+        ok&=ssd1306_send_window(p, buffer, &w);
+
+    p->shown_valid=p->shown!=NULL;
+    if(!ok)
+        ssd1306_invalidate(p); // the display RAM is unknown now, send everything next time
+}
+
+int ssd1306_show_wait(ssd1306_t *p) {
+    ssd1306_transfer_t *tr=p->transfer;
+    if(tr==NULL)
+        return 0;
+
+    ssd1306_transfer_wait(tr);
+    if(!tr->failed)
+        return 0;
+    tr->failed=false;
+    ssd1306_invalidate(p);
+    return PICO_ERROR_GENERIC;
+}
+
+void ssd1306_show(ssd1306_t *p) {
+    ssd1306_show_start(p);
+    ssd1306_show_wait(p);
+}
@@ -0,0 +1,127 @@
+#include <string.h>
+#include "gesture.h"
+
+#define GYRO_LSB_PER_DPS 131    // +-250 dps range
+#define SAMPLE_SHIFT 4          // samples are scaled down before squaring so sums fit in 32 bits
+
+enum { AXIS_X, AXIS_Y, AXIS_Z };
+
+static uint16_t ms_to_samples(uint32_t ms, uint16_t sampleRateHz) {
+    uint32_t samples = (ms * sampleRateHz + 999) / 1000;
+    return samples > 0 ? (uint16_t)samples : 1;
+}
+
+static uint32_t dps_to_window_energy(uint32_t dps) {
+    // Energy of one axis rotating at dps for the whole window. gesture_feed() compares
+    // it with the energy of the three axes together, the sum of the squares.
+    uint32_t scaled = (dps * GYRO_LSB_PER_DPS) >> SAMPLE_SHIFT;
+    return scaled * scaled * GESTURE_WINDOW_SIZE;
+}
+
+void gesture_init(GestureRecognizer *recognizer, uint16_t sampleRateHz) {
+    memset(recognizer, 0, sizeof(*recognizer));
+    recognizer->minSamples = ms_to_samples(GESTURE_MIN_MS, sampleRateHz);
+    recognizer->dashSamples = ms_to_samples(GESTURE_DASH_MS, sampleRateHz);
+    recognizer->quietSamples = ms_to_samples(GESTURE_QUIET_MS, sampleRateHz);
+    recognizer->maxSamples = ms_to_samples(GESTURE_MAX_MS, sampleRateHz);
+    recognizer->deadband = GESTURE_DEADBAND_DPS * GYRO_LSB_PER_DPS;
+    recognizer->startEnergy = dps_to_window_energy(GESTURE_START_DPS);
+    recognizer->stopEnergy = dps_to_window_energy(GESTURE_STOP_DPS);
+    for (int axis = 0; axis < 3; axis++) {
+        dsp_biquad_lowpass_q14(&recognizer->filter[axis], GESTURE_FILTER_HZ, sampleRateHz);
+    }
+}
+
+static void segment_clear(GestureRecognizer *recognizer) {
+    recognizer->active = false;
+    recognizer->duration = 0;
+    recognizer->quietCount = 0;
+    memset(recognizer->segmentEnergy, 0, sizeof(recognizer->segmentEnergy));
+    memset(recognizer->zeroCrossings, 0, sizeof(recognizer->zeroCrossings));
+    memset(recognizer->lastSign, 0, sizeof(recognizer->lastSign));
+}
+
+void gesture_reset(GestureRecognizer *recognizer) {
+    // Keeps the configuration but forgets the window, e.g. after sampling was paused
+    memset(recognizer->window, 0, sizeof(recognizer->window));
+    memset(recognizer->windowEnergy, 0, sizeof(recognizer->windowEnergy));
+    recognizer->windowIndex = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        dsp_biquad_q14_t *filter = &recognizer->filter[axis];
+        filter->x1 = filter->x2 = filter->y1 = filter->y2 = 0;
+    }
+    segment_clear(recognizer);
+}
+
+static GestureEvent classify(const GestureRecognizer *recognizer) {
+    // Decision tree described in gesture.h
+    uint16_t duration = recognizer->duration - recognizer->quietCount;
+    if (duration < recognizer->minSamples) {
+        return GESTURE_NONE;
+    }
+    const uint32_t *energy = recognizer->segmentEnergy;
+    bool twist = energy[AXIS_Z] > energy[AXIS_X] && energy[AXIS_Z] > energy[AXIS_Y];
+    if (twist) {
+        return recognizer->zeroCrossings[AXIS_Z] >= 2 ? GESTURE_DELETE : GESTURE_SPACE;
+    }
+    return duration >= recognizer->dashSamples ? GESTURE_DASH : GESTURE_DOT;
+}
+
+GestureEvent gesture_feed(GestureRecognizer *recognizer, const int16_t rawGyro[3]) {
+    uint8_t index = recognizer->windowIndex;
+    int16_t gyro[3];
+    uint32_t totalEnergy = 0;
+
+    for (int axis = 0; axis < 3; axis++) {
+        dsp_biquad_q14(&recognizer->filter[axis], &rawGyro[axis], &gyro[axis], 1);
+
+        // Slide the window: remove the oldest square, add the newest one
+        int32_t oldest = recognizer->window[axis][index] >> SAMPLE_SHIFT;
+        int32_t newest = gyro[axis] >> SAMPLE_SHIFT;
+        recognizer->window[axis][index] = gyro[axis];
+        recognizer->windowEnergy[axis] += (uint32_t)(newest * newest);
+        recognizer->windowEnergy[axis] -= (uint32_t)(oldest * oldest);
+        totalEnergy += recognizer->windowEnergy[axis];
+
+        if (recognizer->active) {
+            recognizer->segmentEnergy[axis] += (uint32_t)(newest * newest) >> SAMPLE_SHIFT;
+
+            int8_t sign = gyro[axis] > recognizer->deadband ? 1 : gyro[axis] < -recognizer->deadband ? -1 : 0;
+            if (sign != 0) {
+                if (recognizer->lastSign[axis] != 0 && sign != recognizer->lastSign[axis]
+                        && recognizer->zeroCrossings[axis] < UINT8_MAX) {
+                    recognizer->zeroCrossings[axis]++;
+                }
+                recognizer->lastSign[axis] = sign;
+            }
+        }
+    }
+    recognizer->windowIndex = (index + 1) & (GESTURE_WINDOW_SIZE - 1);
+
+    if (!recognizer->active) {
+        if (totalEnergy >= recognizer->startEnergy) {
+            recognizer->active = true;
+        }
+        return GESTURE_NONE;
+    }
+
+    if (recognizer->duration <= recognizer->maxSamples) {
+        recognizer->duration++;
+    }
+    recognizer->quietCount = totalEnergy < recognizer->stopEnergy ? recognizer->quietCount + 1 : 0;
+
+    if (recognizer->duration > recognizer->maxSamples) {
+        // Carrying the device around is not a gesture. Wait until it is still again.
+        if (recognizer->quietCount >= recognizer->quietSamples) {
+            segment_clear(recognizer);
+        }
+        return GESTURE_NONE;
+    }
+    if (recognizer->quietCount < recognizer->quietSamples) {
+        return GESTURE_NONE;
+    }
+
+    GestureEvent event = classify(recognizer);
+    segment_clear(recognizer);
+    return event;
+}
@@ -0,0 +1,78 @@
+#ifndef GESTURE_H
+#define GESTURE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "tkjhat/dsp.h"
+
+/*
+Streaming gesture recognizer for morse input.
+
+Raw gyroscope samples are fed one at a time with gesture_feed(). Every axis is
+first low-pass filtered (GESTURE_FILTER_HZ) to remove sensor noise, so a still
+device does not cross zero all the time. A short sliding window keeps the
+rotation energy of every axis up to date, and when the energy of the three axes
+together rises above the energy of GESTURE_START_DPS a gesture segment is opened.
+dps_to_window_energy() in gesture.c converts the thresholds in dps to the energy
+of a single axis rotating at that rate for the whole window, which is compared
+against the total of the three axes. So the thresholds are the rms rate of the
+rotation, whichever axes it is around. While the segment is open the duration,
+energy per axis and zero crossings per axis are collected.
+When the device has been still for GESTURE_QUIET_MS the segment is closed and
+classified with a small decision tree:
+
+    duration < GESTURE_MIN_MS                 -> nothing (noise, bump on the table)
+    most energy around Z, >= 2 zero crossings -> GESTURE_DELETE (twist back and forth)
+    most energy around Z                      -> GESTURE_SPACE  (single twist)
+    most energy around X or Y, long           -> GESTURE_DASH   (slow tilt)
+    most energy around X or Y, short          -> GESTURE_DOT    (quick flick)
+
+Work per sample is constant (a handful of integer operations), so the
+recognizer can run at 200-400 Hz without a noticeable load on one core.
+Thresholds are given in raw sensor units assuming the default +-250 dps gyro
+range (131 LSB/dps).
+*/
+
+#define GESTURE_FILTER_HZ           25      // low-pass cutoff for the gyro samples
+#define GESTURE_WINDOW_SIZE         16      // samples in the energy window, must be a power of two
+#define GESTURE_DEADBAND_DPS        20      // rotation slower than this does not count as zero crossing
+#define GESTURE_START_DPS           60      // rms rotation (all axes) in the window that opens a gesture
+#define GESTURE_STOP_DPS            25      // rms rotation (all axes) in the window that counts as still
+#define GESTURE_MIN_MS              60
+#define GESTURE_DASH_MS             350
+#define GESTURE_QUIET_MS            80
+#define GESTURE_MAX_MS              1500    // longer movements are dropped without an event
+
+typedef enum { GESTURE_NONE, GESTURE_DOT, GESTURE_DASH, GESTURE_SPACE, GESTURE_DELETE } GestureEvent;
+
+typedef struct {
+    // configuration (converted to samples and raw units by gesture_init)
+    uint16_t minSamples;
+    uint16_t dashSamples;
+    uint16_t quietSamples;
+    uint16_t maxSamples;
+    int16_t deadband;
+    uint32_t startEnergy;
+    uint32_t stopEnergy;
+
+    dsp_biquad_q14_t filter[3];
+
+    // sliding energy window
+    int16_t window[3][GESTURE_WINDOW_SIZE];
+    uint32_t windowEnergy[3];
+    uint8_t windowIndex;
+
+    // current gesture segment
+    bool active;
+    uint16_t duration;
+    uint16_t quietCount;
+    uint32_t segmentEnergy[3];
+    uint8_t zeroCrossings[3];
+    int8_t lastSign[3];
+} GestureRecognizer;
+
+void gesture_init(GestureRecognizer *recognizer, uint16_t sampleRateHz);
+void gesture_reset(GestureRecognizer *recognizer);
+GestureEvent gesture_feed(GestureRecognizer *recognizer, const int16_t gyro[3]);
+
+#endif
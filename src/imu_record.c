@@ -0,0 +1,82 @@
+#include <string.h>
+#include "imu_record.h"
+
+static uint8_t checksum(const uint8_t *frame) {
+    uint8_t sum = 0;
+    for (int i = 2; i < IMU_RECORD_FRAME_SIZE - 1; i++) {
+        sum += frame[i];
+    }
+    return 0xFF - sum;
+}
+
+static void put_u16(uint8_t *dst, uint16_t value) {
+    dst[0] = value & 0xFF;
+    dst[1] = value >> 8;
+}
+
+static uint16_t get_u16(const uint8_t *src) {
+    return (uint16_t)(src[0] | (src[1] << 8));
+}
+
+void imu_record_encode(const ImuSample *sample, uint8_t frame[IMU_RECORD_FRAME_SIZE]) {
+    frame[0] = IMU_RECORD_SYNC0;
+    frame[1] = IMU_RECORD_SYNC1;
+    frame[2] = sample->flags;
+    put_u16(&frame[3], sample->timestampUs & 0xFFFF);
+    put_u16(&frame[5], sample->timestampUs >> 16);
+    for (int axis = 0; axis < 3; axis++) {
+        put_u16(&frame[7 + 2 * axis], (uint16_t)sample->accel[axis]);
+        put_u16(&frame[13 + 2 * axis], (uint16_t)sample->gyro[axis]);
+    }
+    frame[IMU_RECORD_FRAME_SIZE - 1] = checksum(frame);
+}
+
+static void decode(const uint8_t *frame, ImuSample *sample) {
+    sample->flags = frame[2];
+    sample->timestampUs = get_u16(&frame[3]) | ((uint32_t)get_u16(&frame[5]) << 16);
+    for (int axis = 0; axis < 3; axis++) {
+        sample->accel[axis] = (int16_t)get_u16(&frame[7 + 2 * axis]);
+        sample->gyro[axis] = (int16_t)get_u16(&frame[13 + 2 * axis]);
+    }
+}
+
+void imu_record_parser_init(ImuRecordParser *parser) {
+    memset(parser, 0, sizeof(*parser));
+}
+
+static void push(ImuRecordParser *parser, uint8_t byte) {
+    // Only keeps bytes that can be the beginning of a frame
+    if (parser->length == 0 && byte != IMU_RECORD_SYNC0) {
+        return;
+    }
+    if (parser->length == 1 && byte != IMU_RECORD_SYNC1) {
+        parser->length = byte == IMU_RECORD_SYNC0 ? 1 : 0;
+        return;
+    }
+    parser->frame[parser->length++] = byte;
+}
+
+bool imu_record_parse(ImuRecordParser *parser, uint8_t byte, ImuSample *sample) {
+    push(parser, byte);
+    if (parser->length < IMU_RECORD_FRAME_SIZE) {
+        return false;
+    }
+
+    if (parser->frame[IMU_RECORD_FRAME_SIZE - 1] == checksum(parser->frame)) {
+        decode(parser->frame, sample);
+        parser->frames++;
+        parser->length = 0;
+        return true;
+    }
+
+    // False sync (e.g. in the middle of printed text). Look for the next one in the
+    // bytes already received. They are fewer than a frame, so no frame can complete here.
+    parser->badFrames++;
+    uint8_t pending[IMU_RECORD_FRAME_SIZE - 1];
+    memcpy(pending, &parser->frame[1], sizeof(pending));
+    parser->length = 0;
+    for (unsigned i = 0; i < sizeof(pending); i++) {
+        push(parser, pending[i]);
+    }
+    return false;
+}
@@ -0,0 +1,51 @@
+#ifndef IMU_RECORD_H
+#define IMU_RECORD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+Compact binary format for raw IMU recordings. The device streams one frame per
+sample over USB and host/imu_replay feeds the recording back through the gesture
+recognizer and the morse decoder.
+
+Frame (20 bytes, multi-byte fields little-endian):
+    0   sync 0xA5 0x5A
+    2   flags (IMU_RECORD_FLAG_*)
+    3   timestamp in microseconds (uint32, wraps after ~71 minutes)
+    7   accel x, y, z (int16, raw sensor units)
+    13  gyro x, y, z (int16, raw sensor units)
+    19  checksum: 0xFF - (sum of bytes 2..18)
+
+Text printed to the same port between frames is skipped by the parser.
+*/
+
+#define IMU_RECORD_SYNC0 0xA5
+#define IMU_RECORD_SYNC1 0x5A
+#define IMU_RECORD_FRAME_SIZE 20
+
+#define IMU_RECORD_FLAG_BUTTON1 0x01 // space button was pressed
+#define IMU_RECORD_FLAG_BUTTON2 0x02 // character button was pressed
+#define IMU_RECORD_FLAG_MOTION  0x04 // wake-on-motion interrupt
+
+typedef struct {
+    uint32_t timestampUs;
+    int16_t accel[3];
+    int16_t gyro[3];
+    uint8_t flags;
+} ImuSample;
+
+typedef struct {
+    uint8_t frame[IMU_RECORD_FRAME_SIZE];
+    uint8_t length;
+    uint32_t frames;
+    uint32_t badFrames;     // sync found but checksum did not match
+} ImuRecordParser;
+
+void imu_record_encode(const ImuSample *sample, uint8_t frame[IMU_RECORD_FRAME_SIZE]);
+
+void imu_record_parser_init(ImuRecordParser *parser);
+// Returns true when the byte completed a valid frame, which is then stored to sample
+bool imu_record_parse(ImuRecordParser *parser, uint8_t byte, ImuSample *sample);
+
+#endif
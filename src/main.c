@@ -5,25 +5,49 @@
 #include <FreeRTOS.h>
 #include <task.h>
 #include "tkjhat/sdk.h"
+#include "tkjhat/dsp.h"
+#include "gesture.h"
+#include "morse.h"
+#include "message.h"
+#include "screens.h"
+#include "imu_record.h"
 
 // Default stack size for the tasks. It can be reduced to 1024 if task is not using lot of memory.
 #define DEFAULT_STACK_SIZE 2048
-#define MESSAGE_MAX_LENGTH 256
 
-#define DOT '.'
-#define DASH '-'
-#define SPACE ' '
+#define DOT MORSE_DOT
+#define DASH MORSE_DASH
+#define SPACE MORSE_SPACE
 
 #define SKIP_CHAR_CHECK false // Set this to true to send all characters valid or not
+#define GESTURE_INPUT true // Set this to false to write only with the buttons
+#define IMU_SAMPLE_RATE_HZ 200
+#define IMU_WAKE_UP_DELAY_MS 50 // gyro start-up time after the IMU leaves the low power mode
+#define IMU_RECORD false // Set this to true to stream raw IMU samples over USB for host/imu_replay
+#define I2C_BENCHMARK false // Set this to true to print display frame and IMU burst times at each bus speed
+#define DRAW_BENCHMARK false // Set this to true to print the line drawing speed in pixels per second
+#define DSP_BENCHMARK false // Set this to true to print the CPU cycles per sample of the DSP kernels
+#define DISPLAY_TASK_PRIORITY 1 // the display task draws in the background
+#define PLAYBACK_MODE PLAYBACK_KEYER // how received messages are shown and played, one of PlaybackMode
+#define PLAYBACK_STEP_MS 1300 // PLAYBACK_STEPPED: time each character of a received message is shown
+#define PLAYBACK_CHARACTER_MS 100 // PLAYBACK_PAGES: pause after the sound of each character
+#define PLAYBACK_WPM 15 // PLAYBACK_KEYER: speed of the characters
+#define PLAYBACK_FARNSWORTH_WPM 8 // overall speed with longer gaps between letters and words, 0 for standard spacing
+#define PLAYBACK_TONE_HZ 600 // sidetone of the keyer
+#define PLAYBACK_TICKER_SPEED 20 // PLAYBACK_TICKER: pixels per second, a character is 12 pixels wide
+#define SOUND_PRIORITY_JINGLE 1 // buzzer sequences of higher priority cut the jingle short, feedback tones always do
+#define SOUND_PRIORITY_KEYER 2
+#define SOUND_SINE true // Set this to false for the square waves of the PWM, which click at every note boundary
+#define SOUND_ATTACK_MS 4 // fade-in and fade-out of each tone with SOUND_SINE
+#define SOUND_RELEASE_MS 4
 
 typedef enum { WRITING_MESSAGE, MESSAGE_READY, RECEIVING_MESSAGE, DISPLAY_MESSAGE } State ;
-typedef enum { OK, INVALID_CHARACTER, MESSAGE_FULL} MessageStatus ;
-
-static const char *morse_codes[] = {
-    // letters from A to Å
-    ".-", "-...", "-.-.", "-..", ".", "..-.", "--.", "....", "..",
-    ".---", "-.-", ".-..", "--", "-.", "---", ".--.", "--.-", ".-.",
-    "...", "-", "..-", "...-", ".--", "-..-", "-.--", "--..",".-.-","---.",".--.-",NULL};
+typedef enum {
+    PLAYBACK_STEPPED,   // one character at a time with its sound
+    PLAYBACK_PAGES,     // a screen at a time, the sounds of its characters one by one
+    PLAYBACK_KEYER,     // a screen at a time, keyed with the PARIS timing
+    PLAYBACK_TICKER     // scrolled over the display, stepped if the ticker cannot start
+} PlaybackMode ;
 
 // Tasks
 static void sensor_task(void *arg);
@@ -33,51 +57,25 @@ static void actuator_task(void *arg);
 // Callbacks
 static void btn_fxn(uint gpio, uint32_t eventMask);
 // Helper functions
-static MessageStatus message_append(char character);
-static void message_clear();
-static char get_char_by_position(float gx, float gy, float gz);
+static void play_character_sound(char character);
+static void play_message_pages(bool keyed);
+static void play_keyed(const char *symbols, int length);
+static bool play_message_ticker(void);
+static void message_displayed(void);
+static void add_symbol(char symbol);
+static void add_space();
+static void handle_gesture(GestureEvent event);
+static void record_imu_sample(const int16_t accel[3], const int16_t gyro[3], uint8_t flags);
 static void send_message_by_characters(int *index);
-static bool check_last_characters();
-static void clear_invalid_characters();
 // Util
 static void debug_print(char *text);
 
 // Global variables
 State programState = WRITING_MESSAGE;
-char message[MESSAGE_MAX_LENGTH];
-uint8_t messageLength = 0;
+Message message;
 volatile bool spaceButtonIsPressed = false;
 volatile bool characterButtonIsPressed = false;
-
-static MessageStatus message_append(char character) {
-    // Handles writing to the message. Caller should handle the possible return statuses
-    bool isValidCharacter = character == DOT || character == DASH || character == SPACE;
-    if (!isValidCharacter) {
-        return INVALID_CHARACTER;
-    }
-    if (messageLength >= MESSAGE_MAX_LENGTH - 1) {
-        message[MESSAGE_MAX_LENGTH - 1] = '\n';
-        message[MESSAGE_MAX_LENGTH - 2] = ' ';
-        message[MESSAGE_MAX_LENGTH - 3] = ' ';
-        messageLength++;
-        return MESSAGE_FULL;
-    }
-    if (character == SPACE && messageLength > 1) {
-        bool isThirdSpace = message[messageLength - 1] == SPACE && message[messageLength - 2] == SPACE;
-        if (isThirdSpace) {
-            message[messageLength] = '\n';
-            messageLength++;
-            return MESSAGE_FULL;
-        }
-    }
-    message[messageLength++] = character;
-    return OK;
-}
-static void message_clear() {
-    //clears every character of the message
-    memset(message, 0, sizeof(message));
-    messageLength = 0;
-}
+volatile bool motionDetected = false;
 
 static void btn_fxn(uint gpio, uint32_t eventMask){
     // Sometimes space button does not work properly
@@ -88,154 +86,181 @@ static void btn_fxn(uint gpio, uint32_t eventMask){
         case BUTTON2:
             characterButtonIsPressed = true;
             break;
+        case ICM42670_INT:
+            // Wake-on-motion interrupt from the IMU while it is in low power mode
+            motionDetected = true;
+            break;
         default:
             debug_print("Unknown gpio");
     }
 }
 
 /*
-See gyro_measurements.ods for measurements when sensor is on table or in another position.
-it is possible to use sum (gx + gy + gz), average ((gx + gy + gz) / 3) or product (gx * gy * gz).
-Using product seems the most accurate method.
+Writes one sample as a binary frame (imu_record.h) to the USB serial port.
+putchar_raw skips the CR/LF translation of stdio.
 */
-static char get_char_by_position(float gx, float gy, float gz) {
-    float gyroPositionProduct = gx * gy * gz;
-    float minProductOnTable = -1;
-    float maxProductOnTable = 1;
-    bool deviceOnTable = gyroPositionProduct > minProductOnTable && gyroPositionProduct < maxProductOnTable;
-    return deviceOnTable ? DOT : DASH;
+static void record_imu_sample(const int16_t accel[3], const int16_t gyro[3], uint8_t flags) {
+    ImuSample sample = { .timestampUs = (uint32_t)time_us_64(), .flags = flags };
+    memcpy(sample.accel, accel, sizeof(sample.accel));
+    memcpy(sample.gyro, gyro, sizeof(sample.gyro));
+
+    uint8_t frame[IMU_RECORD_FRAME_SIZE];
+    imu_record_encode(&sample, frame);
+    for (int i = 0; i < IMU_RECORD_FRAME_SIZE; i++) {
+        putchar_raw(frame[i]);
+    }
+}
+
+/*
+Adds a dot or a dash to the message and gives feedback with the buzzer and display.
+The tones play in the background so the IMU sampling of the calling task goes on.
+*/
+static void add_symbol(char symbol) {
+    switch (symbol) {
+        case DOT:
+            buzzer_start_tone(440, 100);
+            break;
+        case DASH:
+            buzzer_start_tone(350, 150);
+            break;
+    }
+
+    MessageStatus status = message_append(&message, symbol);
+    switch (status) {
+        case MESSAGE_OK:
+            screen_symbol(symbol);
+            break;
+        case MESSAGE_FULL:
+            programState = MESSAGE_READY;
+            break;
+        case MESSAGE_INVALID_CHARACTER:
+            break;
+    }
+}
+
+/*
+Adds a space to the message. Removes the last character if it was not a valid morse code
+(unless SKIP_CHAR_CHECK).
+*/
+static void add_space() {
+    buzzer_start_tone(250, 100);
+    clear_display(); 
+    switch (message_add_space(&message, !SKIP_CHAR_CHECK)) {
+        case MESSAGE_OK:
+        case MESSAGE_INVALID_CHARACTER: // the invalid character was removed
+            break;
+        case MESSAGE_FULL:
+            programState = MESSAGE_READY;
+            break;
+    }
+}
+
+static void handle_gesture(GestureEvent event) {
+    switch (event) {
+        case GESTURE_DOT:
+            add_symbol(DOT);
+            break;
+        case GESTURE_DASH:
+            add_symbol(DASH);
+            break;
+        case GESTURE_SPACE:
+            add_space();
+            break;
+        case GESTURE_DELETE:
+            if (message_remove_last_symbol(&message)) {
+                buzzer_start_tone(200, 60);
+                clear_display();
+            }
+            break;
+        case GESTURE_NONE:
+            break;
+    }
 }
 
 /*
 The task reads ICM42670 sensor data and adds corresponding character to the message
-based on gyro values. State is changed to MESSAGE_READY when the message is finished    
+based on gyro values. State is changed to MESSAGE_READY when the message is finished.
+
+The IMU is sampled continuously at IMU_SAMPLE_RATE_HZ and the samples are fed to the
+gesture recognizer, so characters can be written by moving the device. The buttons
+work as before: button 2 adds a character based on the position and button 1 adds a space.
+
+When the device has not been used for a while the IMU goes to low power mode (gyro off,
+accelerometer waits for motion). Motion, buttons and gestures wake it up again.
 */
 static void sensor_task(void *arg) {
     (void)arg;
-    message_clear();
+    message_clear(&message);
 
     //values read by the ICM42670 sensor
     float ax, ay, az, gx, gy, gz, t;
+    int16_t accelRaw[3], gyroRaw[3], temperatureRaw;
 
-    clear_display();
-    write_text("write");
+    GestureRecognizer recognizer;
+    gesture_init(&recognizer, IMU_SAMPLE_RATE_HZ);
+    const TickType_t samplePeriod = pdMS_TO_TICKS(1000 / IMU_SAMPLE_RATE_HZ);
+    TickType_t lastWakeTime = xTaskGetTickCount();
+
+    screen_write();
     for(;;){
+        uint8_t recordFlags = (spaceButtonIsPressed ? IMU_RECORD_FLAG_BUTTON1 : 0)
+                | (characterButtonIsPressed ? IMU_RECORD_FLAG_BUTTON2 : 0)
+                | (motionDetected ? IMU_RECORD_FLAG_MOTION : 0);
+        bool userActivity = recordFlags != 0;
+        if (userActivity) {
+            motionDetected = false;
+            bool imuWasIdle = ICM42670_power_get_state() == ICM42670_POWER_IDLE;
+            ICM42670_power_wake();
+            if (imuWasIdle) {
+                vTaskDelay(pdMS_TO_TICKS(IMU_WAKE_UP_DELAY_MS));
+            }
+        }
+
         if (programState == WRITING_MESSAGE) {
-            if (messageLength == 0) {
-                // Serial client always displays ?s if there is only one word. 
-                // Adding constant text 'ms ' to the message so ? are not printed.
-                message_append(DASH);
-                message_append(DASH);
-                message_append(SPACE);
-                message_append(DOT);
-                message_append(DOT);
-                message_append(DOT);
-                message_append(SPACE);
-                message_append(SPACE);
+            message_start(&message);
+            bool imuActive = ICM42670_power_get_state() == ICM42670_POWER_ACTIVE;
+            if ((GESTURE_INPUT || IMU_RECORD) && imuActive) {
+                if (ICM42670_read_sensor_data_raw(accelRaw, gyroRaw, &temperatureRaw) == 0) {
+                    if (IMU_RECORD) {
+                        record_imu_sample(accelRaw, gyroRaw, recordFlags);
+                    }
+                    GestureEvent event = GESTURE_INPUT ? gesture_feed(&recognizer, gyroRaw) : GESTURE_NONE;
+                    if (event != GESTURE_NONE) {
+                        ICM42670_power_wake();
+                        handle_gesture(event);
+                    }
+                }
             }
             if (characterButtonIsPressed) {
                 int readStatus = ICM42670_read_sensor_data(&ax, &ay, &az, &gx, &gy, &gz, &t);
-                if (readStatus == OK) {
+                if (readStatus == 0) {
                     /*
                     char debugText[9];
                     sprintf(debugText, "%f,%f,%f", gx, gy, gz);
                     debug_print(debugText);
                     */
 
-                    char characterToAdd = get_char_by_position(gx, gy, gz);
-                    switch (characterToAdd) {
-                        case DOT:
-                            buzzer_play_tone(440, 100);
-                            break;
-                        case DASH:
-                            buzzer_play_tone(350, 150);
-                            break;
-                    }
-
-                    MessageStatus status = message_append(characterToAdd);
-                    switch (status) {
-                        case OK:
-                            clear_display();
-                            char addedCharacter[2];
-                            sprintf(addedCharacter, "%c", characterToAdd);
-                            write_text(addedCharacter);                            
-                            break;
-                        case MESSAGE_FULL:
-                            programState = MESSAGE_READY;
-                            break;
-                    }
+                    add_symbol(morse_char_by_position(gx, gy, gz));
                     characterButtonIsPressed = false;
                 } else {
                     debug_print("Cannot read sensor");
                 }
             }
             if (spaceButtonIsPressed) {
-                buzzer_play_tone(250, 100);
-                clear_display(); 
-                switch (message_append(SPACE)) {
-                    case OK:
-                        bool validCharacterCombination = check_last_characters();
-                        if (!validCharacterCombination && !SKIP_CHAR_CHECK) {
-                            clear_invalid_characters();
-                        }
-                        break;
-                    case MESSAGE_FULL:
-                        programState = MESSAGE_READY;
-                        break;
-                }
+                add_space();
                 spaceButtonIsPressed = false;
             }
         }
-        
-        vTaskDelay(pdMS_TO_TICKS(400));
-    }
-}
 
-static bool check_last_characters() {
-    // This function is called after appending a SPACE and checks
-    // if last character combination was valid or not.
+        ICM42670_power_update();
 
-    int end_of_char = messageLength - 1;
-    if(messageLength == 0 || end_of_char < 0){  //this shouldn't happen though
-        return true;
-    }
-    //finds the starting point of the character (first morse symbol after space)
-    int start_of_char = end_of_char;
-    while (start_of_char > 0 && message[start_of_char -1] != SPACE){
-        start_of_char--;
-    }
-    int length_of_char = end_of_char - start_of_char;
-    //if the length of character symbols is more than 5 (alphabet letters have at most 5 symbols in morse code)
-    bool overMaxLenght = length_of_char > 5;
-    if (overMaxLenght) {
-        return false;
-    }
-     //this happens for example when second space is pressed.
-    if (length_of_char <= 0){ 
-        return true;
-    }
-    //then we take the wanted symbol sequence from the whole message.
-    char charSequence[6];
-    strncpy(charSequence, &message[start_of_char], length_of_char);
-    charSequence[length_of_char] = '\0';
-
-    //checks whether the symbol sequence is valid (returns true) or not (returns false)
-    for(int i=0; morse_codes[i] != NULL; i++){
-        if(strcmp(charSequence, morse_codes[i]) == 0){
-            return true;
+        // Waking the IMU up (IMU_WAKE_UP_DELAY_MS) or waiting for the I2C bus can keep the task
+        // past its sample period and samples are missed. Start over instead of trying to catch up.
+        if (xTaskGetTickCount() - lastWakeTime > samplePeriod) {
+            gesture_reset(&recognizer);
+            lastWakeTime = xTaskGetTickCount();
         }
-    }
-    return false;
-}
-
-static void clear_invalid_characters() {
-    // Removes last symbol combination (invalid character) from message
-    message[--messageLength] = '\0';
-    while (message[messageLength - 1] != SPACE && messageLength >= 0) {
-        message[--messageLength] = '\0';
-    }
-    if (messageLength < 0) {
-        message_clear();
+        vTaskDelayUntil(&lastWakeTime, samplePeriod);
     }
 }
 
@@ -246,13 +271,13 @@ static void send_message_task(void *arg){
     for(;;){
         if (programState == MESSAGE_READY) {
             // Checks wheter the received message is valid
-            if(message != NULL && messageLength > 2) {
+            if(message.length > 2) {
                 //send_message_by_characters(index);
-                puts(message);
-                message_clear();
+                puts(message.text);
+                message_clear(&message);
             }
             programState = RECEIVING_MESSAGE;
-            write_text("receiving");
+            screen_receiving();
         }
         
         vTaskDelay(pdMS_TO_TICKS(1000));
@@ -272,9 +297,8 @@ static void receive_message_task(void *arg){
             int receivedCharacter = getchar_timeout_us(delayMs100);
             if (receivedCharacter != PICO_ERROR_TIMEOUT) {
                 char receivedChar = (char)receivedCharacter;
-                message_append(receivedChar);
+                message_append(&message, receivedChar);
                 if (receivedChar == '\n') {
-                    message[messageLength] = '\0';
                     programState = DISPLAY_MESSAGE;
                     debug_print("Displaying message on lcd screen");                  
                 }
@@ -291,7 +315,7 @@ static void receive_message_task(void *arg){
    displays the correct symbol (DOT or DASH) of the screen.
 
    When the program receives a message from serial client, it displays the message in morse code
-   accompanied by the corresponding buzzer sounds. 
+   accompanied by the corresponding buzzer sounds. PLAYBACK_MODE selects how (PlaybackMode).
    
    When the message is finished, the led light turns on and the buzzer plays a short sound effect.
    It also displays a checmark on the LCD-screen, wich remains lit until a new message is sent.
@@ -300,80 +324,210 @@ static void actuator_task(void *arg){
     (void)arg;
 
     int textBeginIndex = 0;
+    TickType_t lastStepTime = xTaskGetTickCount();
 
     for(;;){
         if (programState == DISPLAY_MESSAGE) {
-            clear_display();
-
-            // Max amount of characters displayed is 10. If there is less
-            // characters after begin index, the amount is reduced.
-            int8_t displayTextLength = 10;
-            int8_t lastIndex = displayTextLength + textBeginIndex;
-            if (lastIndex > messageLength) {
-                int8_t overflow = lastIndex - messageLength;
-                displayTextLength -= overflow;
-            }
-
-            // Write text from the message between current range
-            char display_text[displayTextLength + 1];
-            strncpy(display_text, message + textBeginIndex, displayTextLength);
-            display_text[displayTextLength] = '\0';
-            write_text(display_text);
-
-            // Play sound for the first letter written
-            char firstLetter = display_text[0];
-
-            switch (firstLetter) {
-                case DOT:
-                    buzzer_play_tone(440, 100);
-                    break;
-                case DASH:
-                    buzzer_play_tone(350, 150);
+            bool played = false;
+            switch (PLAYBACK_MODE) {
+                case PLAYBACK_PAGES:
+                case PLAYBACK_KEYER:
+                    play_message_pages(PLAYBACK_MODE == PLAYBACK_KEYER);
+                    played = true;
                     break;
-                case SPACE:
+                case PLAYBACK_TICKER:
+                    played = play_message_ticker();
                     break;
-                case '\n':
-                    break;
-                default:
-                    char debugText[32];
-                    sprintf(debugText, "Invalid character: %c (int: %d)", firstLetter, (int)firstLetter);
-                    debug_print(debugText);  
+                case PLAYBACK_STEPPED:
                     break;
             }
+            if (played) {
+                message_displayed();
+                lastStepTime = xTaskGetTickCount();
+                continue;
+            }
+
+            // Shows SCREEN_STEP_CHARACTERS of the message from the begin index
+            screen_playback_step(message.text, message.length, textBeginIndex);
+
+            // Play sound for the first letter written
+            play_character_sound(message.text[textBeginIndex]);
 
             textBeginIndex++;
-            bool wholeMessageDisplayed = textBeginIndex >= messageLength;
+            bool wholeMessageDisplayed = textBeginIndex >= message.length;
             if (wholeMessageDisplayed) {
                 textBeginIndex = 0;
-                message_clear();
-                programState = WRITING_MESSAGE;
-                debug_print("Message displayed");
-
-                // Draw a checkmark
-                clear_display();
-                draw_line(30, 30, 50, 45);
-                draw_line(50, 45, 80, 10);
-
-                // plays the "Zelda item get" buzzer sound.
-                // Got the correct tones from ChatGPT with prompt: 
-                // "Give tones raging from 200 to 700 so that I can play Zelda item get sound effect".
-                gpio_put(RED_LED_PIN, true);
-                buzzer_play_tone(200, 100);
-                buzzer_play_tone(360, 100);
-                buzzer_play_tone(320, 100);
-                buzzer_play_tone(400, 100);
-                buzzer_play_tone(480, 100);
-                buzzer_play_tone(560, 100); 
-                buzzer_play_tone(640, 100); 
-                buzzer_play_tone(700, 200); 
-                gpio_put(RED_LED_PIN, false);
+                message_displayed();
             }
+
+            // The display task keeps the text on screen, the step period sets the scrolling speed
+            vTaskDelayUntil(&lastStepTime, pdMS_TO_TICKS(PLAYBACK_STEP_MS));
+            continue;
         }
 
         vTaskDelay(pdMS_TO_TICKS(500));
+        lastStepTime = xTaskGetTickCount();
+    }
+}
+
+// Buzzer sound of a received morse character
+static void play_character_sound(char character) {
+    switch (character) {
+        case DOT:
+            buzzer_play_tone(440, 100);
+            break;
+        case DASH:
+            buzzer_play_tone(350, 150);
+            break;
+        case SPACE:
+            break;
+        case '\n':
+            break;
+        default:
+            char debugText[32];
+            sprintf(debugText, "Invalid character: %c (int: %d)", character, (int)character);
+            debug_print(debugText);  
+            break;
     }
 }
 
+/*
+Shows the received message a screen at a time, wrapped at the spaces, and plays the sounds of
+the characters of each screen while it is shown: keyed with play_keyed(), or character by
+character with PLAYBACK_CHARACTER_MS pauses.
+*/
+static void play_message_pages(bool keyed) {
+    static text_layout_t layout;
+    uint16_t pages = screen_message_layout(&layout, message.text);
+
+    for (uint16_t page = 0; page < pages; page++) {
+        int first = screen_message_page(&layout, page);
+        uint16_t nextLine = (uint16_t)((page + 1) * layout.rows);
+        int end = nextLine < layout.line_count ? layout.lines[nextLine].start : layout.length;
+        if (keyed) {
+            play_keyed(layout.text + first, end - first);
+            continue;
+        }
+        for (int i = first; i < end; i++) {
+            play_character_sound(layout.text[i]);
+            vTaskDelay(pdMS_TO_TICKS(PLAYBACK_CHARACTER_MS));
+        }
+    }
+}
+
+/*
+Plays morse symbols with the timing of the PARIS standard at PLAYBACK_WPM and returns when
+they have been played. The symbols become one buzzer sequence, so the hardware alarm of the
+buzzer keys the tone and the led and the rhythm does not depend on the task scheduling.
+*/
+static void play_keyed(const char *symbols, int length) {
+    static char text[TEXT_LAYOUT_MAX_LENGTH + 1];
+    static MorseKey keys[TEXT_LAYOUT_MAX_LENGTH];
+    static buzzer_note_t notes[TEXT_LAYOUT_MAX_LENGTH];
+    MorseTiming timing;
+    morse_timing(&timing, PLAYBACK_WPM, PLAYBACK_FARNSWORTH_WPM);
+
+    if (length > TEXT_LAYOUT_MAX_LENGTH) {
+        length = TEXT_LAYOUT_MAX_LENGTH;
+    }
+    memcpy(text, symbols, length);
+    text[length] = '\0';
+    size_t count = morse_keys(text, &timing, keys, TEXT_LAYOUT_MAX_LENGTH);
+    for (size_t i = 0; i < count; i++) {
+        notes[i] = (buzzer_note_t) {PLAYBACK_TONE_HZ, keys[i].tone_ms, keys[i].gap_ms, BUZZER_LED_KEYED};
+    }
+    if (count == 0 || buzzer_play_sequence(notes, count, SOUND_PRIORITY_KEYER) != 0) {
+        return;
+    }
+    while (buzzer_is_playing()) {
+        vTaskDelay(pdMS_TO_TICKS(20));
+    }
+}
+
+/*
+Scrolls the received message over the display with the ticker of the display task and plays
+the sound of each character when it reaches the left edge. Returns false if the ticker could
+not be started (out of memory or the display queue is full).
+*/
+static bool play_message_ticker(void) {
+    static char text[MESSAGE_MAX_LENGTH + 1];
+    memcpy(text, message.text, message.length);
+    text[message.length] = '\0';
+    if (screen_ticker_start(text, PLAYBACK_TICKER_SPEED) != 0) {
+        return false;
+    }
+
+    int32_t played = -1;
+    int32_t position;
+    while ((position = display_ticker_position()) >= 0) {
+        if (position != played && position < message.length) {
+            play_character_sound(message.text[position]);
+            played = position;
+        }
+        vTaskDelay(pdMS_TO_TICKS(20));
+    }
+    return true;
+}
+
+/*
+End of the playback: clears the message, shows a checkmark and plays a sound effect with the led on.
+*/
+static void message_displayed(void) {
+    message_clear(&message);
+    programState = WRITING_MESSAGE;
+    debug_print("Message displayed");
+
+    screen_checkmark();
+
+    // plays the "Zelda item get" buzzer sound in the background, the led is on while it plays.
+    // Got the correct tones from ChatGPT with prompt: 
+    // "Give tones raging from 200 to 700 so that I can play Zelda item get sound effect".
+    static const buzzer_note_t itemGet[] = {
+        {200, 100, 0, BUZZER_LED_ON},
+        {360, 100, 0, BUZZER_LED_KEEP},
+        {320, 100, 0, BUZZER_LED_KEEP},
+        {400, 100, 0, BUZZER_LED_KEEP},
+        {480, 100, 0, BUZZER_LED_KEEP},
+        {560, 100, 0, BUZZER_LED_KEEP},
+        {640, 100, 0, BUZZER_LED_KEEP},
+        {700, 200, 0, BUZZER_LED_KEEP},
+        {0, 0, 0, BUZZER_LED_OFF},
+    };
+    buzzer_play_sequence(itemGet, sizeof(itemGet) / sizeof(itemGet[0]), SOUND_PRIORITY_JINGLE);
+}
+
+/*
+Measures the display frame time and the IMU burst time at each I2C speed and prints a table.
+Runs before the scheduler, so the transfers use the blocking fallback of the bus engine.
+*/
+static void run_i2c_benchmark(void) {
+    const uint32_t speeds[] = {100 * 1000, 400 * 1000, 1000 * 1000};
+    i2c_benchmark_result_t results[sizeof(speeds) / sizeof(speeds[0])];
+    if (i2c_benchmark(speeds, sizeof(speeds) / sizeof(speeds[0]), results) == 0) {
+        i2c_benchmark_print(results, sizeof(speeds) / sizeof(speeds[0]));
+    }
+}
+
+/*
+Measures how fast lines are drawn into the display buffer and prints pixels per second.
+*/
+static void run_draw_benchmark(void) {
+    draw_benchmark_result_t results[DRAW_BENCHMARK_COUNT];
+    if (draw_benchmark(results, time_us_32) == 0) {
+        draw_benchmark_print(results, 1000000);
+    }
+}
+
+/*
+Measures the DSP kernels and prints CPU cycles per sample.
+Runs before the scheduler, because SysTick counts the cycles and FreeRTOS takes it over.
+*/
+static void run_dsp_benchmark(void) {
+    dsp_benchmark_result_t results[DSP_BENCHMARK_COUNT];
+    dsp_benchmark(results, dsp_cycle_counter);
+    dsp_benchmark_print(results, "cycles");
+}
+
 // Ment for testing the program
 static void debug_print(char *text) {
     // Serial client does not decode text between __
@@ -396,13 +550,38 @@ int main() {
     gpio_set_irq_enabled(BUTTON2, GPIO_IRQ_EDGE_RISE, true);
 
     //Gyroscope initializtion
-    if (init_ICM42670() == OK) {
+    if (init_ICM42670() == 0) {
         ICM42670_start_with_default_values();
+        // Gesture recognition needs a faster output data rate than the default
+        ICM42670_startAccel(IMU_SAMPLE_RATE_HZ, ICM42670_ACCEL_FSR_DEFAULT);
+        ICM42670_startGyro(IMU_SAMPLE_RATE_HZ, ICM42670_GYRO_FSR_DEFAULT);
+        ICM42670_power_manager_init(ICM42670_POWER_IDLE_TIMEOUT_DEFAULT_MS);
     }
+    // IMU wake-on-motion interrupt (INT1, active-low pulse)
+    gpio_init(ICM42670_INT);
+    gpio_set_dir(ICM42670_INT, GPIO_IN);
+    gpio_pull_up(ICM42670_INT); // INT1 is open-drain at its reset configuration
+    gpio_set_irq_enabled(ICM42670_INT, GPIO_IRQ_EDGE_FALL, true);
     // LED, LCD-screen and buzzer initializtions
     init_led();
     init_display();
     init_buzzer();
+    if (SOUND_SINE && buzzer_set_waveform(BUZZER_WAVE_SINE, SOUND_ATTACK_MS, SOUND_RELEASE_MS) != 0) {
+        debug_print("Sine synthesis unavailable, buzzer plays square waves\n");
+    }
+    if (I2C_BENCHMARK) {
+        run_i2c_benchmark();
+    }
+    if (DRAW_BENCHMARK) {
+        run_draw_benchmark();
+    }
+    if (DSP_BENCHMARK) {
+        run_dsp_benchmark();
+    }
+    // From here on the drawing functions only queue commands to the display task
+    if (display_service_start(DISPLAY_TASK_PRIORITY, DISPLAY_SERVICE_MAX_FPS_DEFAULT) != 0) {
+        debug_print("Display task creation failed\n");
+    }
 
     // Task handles and task creation
     TaskHandle_t hSensorTask = NULL, hSendMessageTask = NULL, hReceiveMessageTask = NULL, hActuatorTask = NULL;
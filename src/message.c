@@ -0,0 +1,92 @@
+#include "message.h"
+
+#include <string.h>
+#include "morse.h"
+
+void message_clear(Message *message) {
+    memset(message, 0, sizeof(*message));
+}
+
+void message_start(Message *message) {
+    if (message->length > 0) {
+        return;
+    }
+    for (const char *c = MESSAGE_PREFIX; *c != '\0'; c++) {
+        message_append(message, *c);
+    }
+}
+
+static MessageStatus message_end(Message *message) {
+    message->text[message->length++] = '\n';
+    message->text[message->length] = '\0';
+    return MESSAGE_FULL;
+}
+
+MessageStatus message_append(Message *message, char character) {
+    bool isValidCharacter = character == MORSE_DOT || character == MORSE_DASH || character == MORSE_SPACE;
+    if (!isValidCharacter) {
+        return MESSAGE_INVALID_CHARACTER;
+    }
+    if (message->length >= MESSAGE_MAX_LENGTH - 1) {
+        // No room left: end the message the same way the third space does
+        message->length = MESSAGE_MAX_LENGTH - 3;
+        message->text[message->length++] = MORSE_SPACE;
+        message->text[message->length++] = MORSE_SPACE;
+        return message_end(message);
+    }
+    if (character == MORSE_SPACE && message->length > 1) {
+        bool isThirdSpace = message->text[message->length - 1] == MORSE_SPACE
+                && message->text[message->length - 2] == MORSE_SPACE;
+        if (isThirdSpace) {
+            return message_end(message);
+        }
+    }
+    message->text[message->length++] = character;
+    message->text[message->length] = '\0';
+    return MESSAGE_OK;
+}
+
+static uint16_t last_letter_start(const Message *message, uint16_t end) {
+    uint16_t start = end;
+    while (start > 0 && message->text[start - 1] != MORSE_SPACE) {
+        start--;
+    }
+    return start;
+}
+
+MessageStatus message_add_space(Message *message, bool checkCharacters) {
+    MessageStatus status = message_append(message, MORSE_SPACE);
+    if (status != MESSAGE_OK || !checkCharacters) {
+        return status;
+    }
+    // The letter the space ended, empty after the second space of a word gap
+    uint16_t end = message->length - 1;
+    uint16_t start = last_letter_start(message, end);
+    uint16_t letterLength = end - start;
+    if (letterLength == 0) {
+        return MESSAGE_OK;
+    }
+    char code[MORSE_MAX_SYMBOLS + 1];
+    if (letterLength <= MORSE_MAX_SYMBOLS) {
+        memcpy(code, &message->text[start], letterLength);
+        code[letterLength] = '\0';
+        if (morse_is_valid_code(code)) {
+            return MESSAGE_OK;
+        }
+    }
+    memset(&message->text[start], 0, message->length - start);
+    message->length = start;
+    return MESSAGE_INVALID_CHARACTER;
+}
+
+bool message_remove_last_symbol(Message *message) {
+    if (message->length == 0) {
+        return false;
+    }
+    char lastCharacter = message->text[message->length - 1];
+    if (lastCharacter != MORSE_DOT && lastCharacter != MORSE_DASH) {
+        return false;
+    }
+    message->text[--message->length] = '\0';
+    return true;
+}
@@ -0,0 +1,41 @@
+#ifndef MESSAGE_H
+#define MESSAGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+The message being written: morse symbols separated by spaces, one space between
+letters and two between words. A third space in a row, or running out of room,
+ends the message with '\n' and MESSAGE_FULL, after which it is ready to be sent.
+
+Shared by the device (src/main.c) and host/imu_replay, so a recording is turned
+into the same message on the PC as on the device. No Pico SDK or FreeRTOS
+dependencies.
+*/
+
+#define MESSAGE_MAX_LENGTH 256
+// The serial client always displays ?s if there is only one word, so every message
+// starts with the constant word 'ms'
+#define MESSAGE_PREFIX "-- ...  "
+
+typedef enum { MESSAGE_OK, MESSAGE_INVALID_CHARACTER, MESSAGE_FULL } MessageStatus;
+
+typedef struct {
+    char text[MESSAGE_MAX_LENGTH + 1];  // always terminated
+    uint16_t length;
+} Message;
+
+void message_clear(Message *message);
+// Starts an empty message with MESSAGE_PREFIX. Does nothing if something is written already.
+void message_start(Message *message);
+// Adds a dot, a dash or a space. Other characters are rejected with MESSAGE_INVALID_CHARACTER.
+MessageStatus message_append(Message *message, char character);
+// Adds a space. With checkCharacters the letter it ends is removed again if it is not
+// a valid morse code, and MESSAGE_INVALID_CHARACTER is returned.
+MessageStatus message_add_space(Message *message, bool checkCharacters);
+// Backspace: removes the last dot or dash of the letter being written. Finished letters
+// (followed by a space) are kept. Returns false if nothing was removed.
+bool message_remove_last_symbol(Message *message);
+
+#endif
@@ -0,0 +1,82 @@
+#include <string.h>
+#include "morse.h"
+
+static const char *morse_codes[] = {
+    // letters from A to Å
+    ".-", "-...", "-.-.", "-..", ".", "..-.", "--.", "....", "..",
+    ".---", "-.-", ".-..", "--", "-.", "---", ".--.", "--.-", ".-.",
+    "...", "-", "..-", "...-", ".--", "-..-", "-.--", "--..",".-.-","---.",".--.-",NULL};
+
+static const char *morse_letters[] = {
+    "A", "B", "C", "D", "E", "F", "G", "H", "I",
+    "J", "K", "L", "M", "N", "O", "P", "Q", "R",
+    "S", "T", "U", "V", "W", "X", "Y", "Z", "Ä", "Ö", "Å", NULL};
+
+const char *morse_decode(const char *code) {
+    for (int i = 0; morse_codes[i] != NULL; i++) {
+        if (strcmp(code, morse_codes[i]) == 0) {
+            return morse_letters[i];
+        }
+    }
+    return NULL;
+}
+
+bool morse_is_valid_code(const char *code) {
+    return morse_decode(code) != NULL;
+}
+
+void morse_timing(MorseTiming *timing, unsigned wpm, unsigned farnsworth_wpm) {
+    if (wpm == 0) wpm = 1;
+    uint32_t unit = (1200 + wpm / 2) / wpm;
+    uint32_t letterGap = 3 * unit;
+    uint32_t wordGap = 7 * unit;
+    if (farnsworth_wpm > 0 && farnsworth_wpm < wpm) {
+        // The 19 units of spacing in PARIS take the time the slower speed adds
+        uint32_t spacing = (60000u * wpm - 37200u * farnsworth_wpm) / (farnsworth_wpm * wpm);
+        letterGap = 3 * spacing / 19;
+        wordGap = 7 * spacing / 19;
+    }
+    timing->unit_ms = (uint16_t)unit;
+    timing->dash_ms = (uint16_t)(3 * unit);
+    timing->letter_gap_ms = (uint16_t)(letterGap > UINT16_MAX ? UINT16_MAX : letterGap);
+    timing->word_gap_ms = (uint16_t)(wordGap > UINT16_MAX ? UINT16_MAX : wordGap);
+}
+
+size_t morse_keys(const char *symbols, const MorseTiming *timing, MorseKey *keys, size_t max) {
+    size_t count = 0;
+    int spaces = 0;
+    for (const char *c = symbols; *c != '\0'; c++) {
+        if (*c == MORSE_SPACE) {
+            spaces++;
+            continue;
+        }
+        if (*c != MORSE_DOT && *c != MORSE_DASH) continue;
+        if (count > 0) {
+            // Gap of the previous symbol, now that it is known what follows it
+            keys[count - 1].gap_ms = spaces == 0 ? timing->unit_ms
+                                   : spaces == 1 ? timing->letter_gap_ms : timing->word_gap_ms;
+        }
+        spaces = 0;
+        if (count == max) return count;
+        keys[count].tone_ms = *c == MORSE_DOT ? timing->unit_ms : timing->dash_ms;
+        keys[count].gap_ms = 0;
+        count++;
+    }
+    if (count > 0 && spaces > 0) {
+        keys[count - 1].gap_ms = spaces == 1 ? timing->letter_gap_ms : timing->word_gap_ms;
+    }
+    return count;
+}
+
+/*
+See gyro_measurements.ods for measurements when sensor is on table or in another position.
+it is possible to use sum (gx + gy + gz), average ((gx + gy + gz) / 3) or product (gx * gy * gz).
+Using product seems the most accurate method.
+*/
+char morse_char_by_position(float gx, float gy, float gz) {
+    float gyroPositionProduct = gx * gy * gz;
+    float minProductOnTable = -1;
+    float maxProductOnTable = 1;
+    bool deviceOnTable = gyroPositionProduct > minProductOnTable && gyroPositionProduct < maxProductOnTable;
+    return deviceOnTable ? MORSE_DOT : MORSE_DASH;
+}
@@ -0,0 +1,51 @@
+#ifndef MORSE_H
+#define MORSE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+Morse code helpers shared by the device and the host tools (host/). No Pico SDK
+or FreeRTOS dependencies, so the same code can be run against recordings on a PC.
+*/
+
+#define MORSE_DOT '.'
+#define MORSE_DASH '-'
+#define MORSE_SPACE ' '
+#define MORSE_MAX_SYMBOLS 5 // longest code of the alphabet (Å)
+
+// Returns the letter (UTF-8, "A".."Å") of a code like ".-", or NULL if the code is not valid
+const char *morse_decode(const char *code);
+bool morse_is_valid_code(const char *code);
+
+// Element lengths of the PARIS standard: a dot is one unit, a dash three, the gap
+// inside a letter one, between letters three and between words seven units.
+// The word PARIS is 50 units, so a unit is 1200 ms / WPM.
+typedef struct {
+    uint16_t unit_ms;           // dot and gap inside a letter
+    uint16_t dash_ms;
+    uint16_t letter_gap_ms;     // 3 units, longer with Farnsworth spacing
+    uint16_t word_gap_ms;       // 7 units, longer with Farnsworth spacing
+} MorseTiming;
+
+// Key-down and key-up time of one symbol
+typedef struct {
+    uint16_t tone_ms;
+    uint16_t gap_ms;            // after the tone: inside the letter, or the letter or word gap
+} MorseKey;
+
+// Timing of characters sent at wpm words per minute. If farnsworth_wpm is lower, only the
+// letter and word gaps are stretched so that text as a whole runs at farnsworth_wpm
+// (ARRL formula), otherwise it is ignored. 0 for farnsworth_wpm: standard spacing.
+void morse_timing(MorseTiming *timing, unsigned wpm, unsigned farnsworth_wpm);
+
+// Keys of a symbol stream like ".- -...  ..": one space ends a letter, two or more end a
+// word. Other characters (the '\n' at the end of a message) are skipped. Returns the number
+// of keys, at most max.
+size_t morse_keys(const char *symbols, const MorseTiming *timing, MorseKey *keys, size_t max);
+
+// Classifies the position of the device from gyro values (dps): DOT when it lies on the table, DASH otherwise
+char morse_char_by_position(float gx, float gy, float gz);
+
+#endif
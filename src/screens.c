@@ -0,0 +1,69 @@
+#include "screens.h"
+
+#include <string.h>
+#include "morse.h"
+
+void screen_write(void) {
+    display_frame_begin();
+    clear_display();
+    write_text("write");
+    draw_sprite(SPRITE_PENCIL, 112, 0);
+    display_frame_end();
+}
+
+void screen_symbol(char symbol) {
+    display_frame_begin();
+    clear_display();
+    if (symbol == MORSE_DOT || symbol == MORSE_DASH) {
+        draw_sprite(symbol == MORSE_DOT ? SPRITE_DOT : SPRITE_DASH, 8, 24);
+    } else {
+        char text[2] = {symbol, '\0'};
+        write_text(text);
+    }
+    display_frame_end();
+}
+
+void screen_receiving(void) {
+    display_frame_begin();
+    write_text("receiving");
+    draw_sprite(SPRITE_ENVELOPE, 112, 0);
+    display_frame_end();
+}
+
+int screen_playback_step(const char *message, int length, int begin) {
+    int count = length - begin;
+    if (count > SCREEN_STEP_CHARACTERS) count = SCREEN_STEP_CHARACTERS;
+    if (count < 0) count = 0;
+
+    char text[SCREEN_STEP_CHARACTERS + 1];
+    memcpy(text, message + begin, count);
+    text[count] = '\0';
+
+    display_frame_begin();
+    clear_display();
+    write_text(text);
+    display_frame_end();
+    return count;
+}
+
+uint16_t screen_message_layout(text_layout_t *layout, const char *message) {
+    text_layout_init(layout, SCREEN_PAGE_SCALE);
+    return text_layout_update(layout, message);
+}
+
+int screen_message_page(const text_layout_t *layout, uint16_t page) {
+    return write_text_page(layout, page);
+}
+
+int screen_ticker_start(const char *message, uint16_t speed) {
+    // The ticker only draws its band, the rest of the screen must not show the previous one
+    clear_display();
+    return display_ticker_start(message, SCREEN_TICKER_Y, SCREEN_TICKER_SCALE, speed);
+}
+
+void screen_checkmark(void) {
+    display_frame_begin();
+    clear_display();
+    draw_sprite(SPRITE_CHECKMARK, 48, 16);
+    display_frame_end();
+}
@@ -0,0 +1,35 @@
+#ifndef SCREENS_H
+#define SCREENS_H
+
+#include <stdint.h>
+#include "tkjhat/sdk.h"
+
+/*
+Screens of the application. Drawn by src/main.c on the device and by host/ui_frames
+on the simulated display, which compares them to the reference images in host/frames.
+While the display task runs every screen is one frame (display_frame_begin/end).
+*/
+
+#define SCREEN_STEP_CHARACTERS 10   // window of the stepped playback
+#define SCREEN_PAGE_SCALE 1         // text scale of the message pages
+#define SCREEN_TICKER_Y 24
+#define SCREEN_TICKER_SCALE 2       // a character is 12 pixels wide
+
+// Writing a message
+void screen_write(void);
+// A dot or a dash was added to the message
+void screen_symbol(char symbol);
+// The message was sent, drawn over the previous screen
+void screen_receiving(void);
+// The window of the stepped playback at begin. Returns the number of characters shown.
+int screen_playback_step(const char *message, int length, int begin);
+// Lays the message out for screen_message_page(). Returns the number of pages.
+uint16_t screen_message_layout(text_layout_t *layout, const char *message);
+// One page of the message. Returns the index of its first character in the layout text.
+int screen_message_page(const text_layout_t *layout, uint16_t page);
+// Starts scrolling the message with the ticker of the display task, see display_ticker_start()
+int screen_ticker_start(const char *message, uint16_t speed);
+// The message has been played
+void screen_checkmark(void);
+
+#endif